@@ -0,0 +1,21 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stddef.h>
+#include <time.h>
+
+/*
+*   Helpers shared by the micro benchmarks in bench/, which make bench
+*   builds against the server objects and runs one after another.
+*/
+
+static inline double bench_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/* results are stored here so the measured calls are not optimized away */
+static volatile size_t bench_sink;
+
+#endif
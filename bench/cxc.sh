@@ -0,0 +1,38 @@
+#!/bin/sh
+#
+# Times cxc on a generated template of SIZE_MB megabytes (default 20) of
+# markup, {{=expr}} segments and {{?cond}} blocks, then the rerun that the
+# manifest lets skip. Runs in a temporary directory, the tree is untouched.
+
+set -e
+
+ROOT=$(cd "$(dirname "$0")/.." && pwd)
+SIZE_MB=${1:-20}
+DIR=$(mktemp -d)
+trap 'rm -rf "$DIR"' EXIT
+
+mkdir -p "$DIR/cx_files" "$DIR/src/cxc" "$DIR/src_cxc"
+cp "$ROOT/src_cxc/ctemplate.c" "$ROOT/src_cxc/htemplate.h" "$DIR/src_cxc/"
+
+awk -v size=$((SIZE_MB * 1024 * 1024)) 'BEGIN {
+    printf "({\n    char *title;\n    int n;\n})\n\n<html>\n"
+    for (i = 0; written < size; i++) {
+        block = sprintf("<div class=\"row\">\n  <p>\"quoted\" \\ text</p>\n  {{=props->title}}\n  {{? props->n > %d}}<b>%d</b>{{/}}\n</div>\n", i, i)
+        printf "%s", block
+        written += length(block)
+    }
+    printf "</html>\n"
+}' > "$DIR/cx_files/big.cx"
+
+now_ms() { echo $(($(date +%s%N) / 1000000)); }
+
+cd "$DIR"
+start=$(now_ms)
+"$ROOT/cxc" > /dev/null
+generate=$(($(now_ms) - start))
+
+start=$(now_ms)
+"$ROOT/cxc" > /dev/null
+rerun=$(($(now_ms) - start))
+
+echo "cxc: $(wc -c < cx_files/big.cx) byte template -> $(wc -c < src/cxc/big.c) bytes of C, generate ${generate} ms, unchanged rerun ${rerun} ms"
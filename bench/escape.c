@@ -0,0 +1,93 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bench.h"
+#include "cx.h"
+
+/*
+*   HTML escaping of 4 KB strings: cx_out_write_escaped (SSE2 scan when
+*   built with it), the same loop with a byte at a time scan, and a plain
+*   copy as the lower bound. Once on clean text and once on text with a
+*   special character every 64 bytes.
+*/
+
+#define TEXT_LEN 4096
+#define ROUNDS 200000
+
+static size_t scalar_clean_prefix(const char *src, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        char c = src[i];
+        if (c == '&' || c == '<' || c == '>' || c == '"' || c == '\'') return i;
+    }
+    return len;
+}
+
+static const char *entity(char c) {
+    switch (c) {
+        case '&': return "&amp;";
+        case '<': return "&lt;";
+        case '>': return "&gt;";
+        case '"': return "&quot;";
+        default:  return "&#39;";
+    }
+}
+
+static void scalar_write_escaped(cx_out_t *out, const char *src) {
+    size_t len = strlen(src);
+    while (len > 0) {
+        size_t clean = scalar_clean_prefix(src, len);
+        cx_out_write_len(out, src, clean);
+        if (clean == len) return;
+
+        cx_out_write(out, entity(src[clean]));
+        src += clean + 1;
+        len -= clean + 1;
+    }
+}
+
+typedef enum { ESCAPE_SIMD, ESCAPE_SCALAR, ESCAPE_COPY } escape_kind_t;
+
+static double run(escape_kind_t kind, const char *text) {
+    cx_out_t out;
+    cx_out_init(&out, TEXT_LEN * 2);
+
+    double start = bench_now_ns();
+    for (int i = 0; i < ROUNDS; i++) {
+        out.len = 0;
+        if (kind == ESCAPE_SIMD) cx_out_write_escaped(&out, text);
+        else if (kind == ESCAPE_SCALAR) scalar_write_escaped(&out, text);
+        else cx_out_write_len(&out, text, strlen(text));
+        bench_sink += out.len;
+    }
+    double elapsed = (bench_now_ns() - start) / ROUNDS;
+
+    free(cx_out_finish(&out));
+    return elapsed;
+}
+
+int main(void) {
+    static char clean[TEXT_LEN + 1];
+    static char mixed[TEXT_LEN + 1];
+    const char *words = "lorem ipsum dolor sit amet, consectetur adipiscing elit ";
+    const char *specials = "<>&\"'";
+
+    for (int i = 0; i < TEXT_LEN; i++) {
+        clean[i] = words[i % strlen(words)];
+        mixed[i] = i % 64 == 63 ? specials[(i / 64) % 5] : clean[i];
+    }
+
+    const char *names[] = {"clean", "mixed"};
+    const char *texts[] = {clean, mixed};
+    for (int t = 0; t < 2; t++) {
+        printf("escape: %d bytes %s, %s %.0f ns, scalar %.0f ns, memcpy %.0f ns\n",
+               TEXT_LEN, names[t],
+#ifdef __SSE2__
+               "sse2",
+#else
+               "cx (no sse2)",
+#endif
+               run(ESCAPE_SIMD, texts[t]), run(ESCAPE_SCALAR, texts[t]), run(ESCAPE_COPY, texts[t]));
+    }
+    return 0;
+}
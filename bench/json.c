@@ -0,0 +1,96 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bench.h"
+#include "json/json.h"
+
+/*
+*   json_parse against json_parse_arena on an array of 10000 small objects,
+*   then parsing a 5000 key object and looking up every key in it, which
+*   goes through the object index instead of a linear scan.
+*/
+
+#define ARRAY_ITEMS 10000
+#define ARRAY_ROUNDS 20
+#define OBJECT_KEYS 5000
+#define LOOKUP_ROUNDS 20
+
+static char *make_array(void) {
+    size_t len = 0;
+    char *doc = malloc(ARRAY_ITEMS * 96 + 2);
+    if (!doc) return NULL;
+
+    doc[len++] = '[';
+    for (int i = 0; i < ARRAY_ITEMS; i++) {
+        len += sprintf(doc + len,
+                       "%s{\"id\": %d, \"name\": \"user%d\", \"email\": \"user%d@example.com\", \"tags\": [\"a\", \"b\"]}",
+                       i ? ", " : "", i, i, i);
+    }
+    strcpy(doc + len, "]");
+    return doc;
+}
+
+static char *make_object(void) {
+    size_t len = 0;
+    char *doc = malloc(OBJECT_KEYS * 24 + 32);
+    if (!doc) return NULL;
+
+    doc[len++] = '{';
+    for (int i = 0; i < OBJECT_KEYS; i++) {
+        len += sprintf(doc + len, "%s\"key%d\": %d", i ? ", " : "", i, i);
+    }
+    strcpy(doc + len, "}");
+    return doc;
+}
+
+int main(void) {
+    char *array = make_array();
+    char *object = make_object();
+    if (!array || !object) return 1;
+
+    double start = bench_now_ns();
+    for (int r = 0; r < ARRAY_ROUNDS; r++) {
+        json_t *json = json_parse(array);
+        bench_sink += json != NULL;
+        json_free(json);
+    }
+    double heap_ms = (bench_now_ns() - start) / ARRAY_ROUNDS / 1e6;
+
+    start = bench_now_ns();
+    for (int r = 0; r < ARRAY_ROUNDS; r++) {
+        json_arena_t arena;
+        json_arena_init(&arena, NULL, 0);
+        bench_sink += json_parse_arena(&arena, array) != NULL;
+        json_arena_free(&arena);
+    }
+    double arena_ms = (bench_now_ns() - start) / ARRAY_ROUNDS / 1e6;
+
+    printf("json: %d element array, heap %.2f ms, arena %.2f ms per parse\n",
+           ARRAY_ITEMS, heap_ms, arena_ms);
+
+    start = bench_now_ns();
+    json_t *json = json_parse(object);
+    double parse_ms = (bench_now_ns() - start) / 1e6;
+    if (!json) return 1;
+
+    char key[32];
+    size_t found = 0;
+    start = bench_now_ns();
+    for (int r = 0; r < LOOKUP_ROUNDS; r++) {
+        for (int i = 0; i < OBJECT_KEYS; i++) {
+            snprintf(key, sizeof(key), "key%d", i);
+            found += json_object_get(json, key) != NULL;
+        }
+    }
+    double lookup_ms = (bench_now_ns() - start) / 1e6;
+    bench_sink += found;
+
+    printf("json: %d key object, parse %.2f ms, %d lookups %.2f ms, %zu found\n",
+           OBJECT_KEYS, parse_ms, OBJECT_KEYS * LOOKUP_ROUNDS, lookup_ms, found);
+
+    json_free(json);
+    free(array);
+    free(object);
+    return 0;
+}
@@ -0,0 +1,69 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bench.h"
+#include "cx.h"
+#include "cxc/index.h"
+
+/*
+*   Renders the index template through both generated renderers:
+*   render_index into one malloc'd string and render_index_iov into the
+*   iovecs that cx_send writes. A second case writes a 134 KB page of
+*   6000 segments the way a generated renderer does, which is where
+*   appending through a cursor instead of strcat pays off.
+*/
+
+#define RENDERS 1000000
+#define LARGE_RENDERS 2000
+#define LARGE_ROWS 2000
+
+static void render_large(cx_out_t *out, const char *name) {
+    for (int i = 0; i < LARGE_ROWS; i++) {
+        cx_write_static(out, "<tr class=\"row\"><td class=\"name\">");
+        cx_write(out, name);
+        cx_write_static(out, "</td></tr>\n");
+    }
+}
+
+int main(void) {
+    IndexProps props = {.title = "e45g"};
+
+    size_t bytes = 0;
+    double start = bench_now_ns();
+    for (int i = 0; i < RENDERS; i++) {
+        char *html = render_index(&props);
+        bytes += strlen(html);
+        free(html);
+    }
+    double string_ns = (bench_now_ns() - start) / RENDERS;
+
+    start = bench_now_ns();
+    for (int i = 0; i < RENDERS; i++) {
+        cx_iov_t out;
+        cx_iov_init(&out);
+        render_index_iov(&props, &out);
+        bytes += out.total;
+        cx_iov_free(&out);
+    }
+    double iov_ns = (bench_now_ns() - start) / RENDERS;
+
+    printf("render: render_index %.1f ns, render_index_iov %.1f ns (%d renders each)\n",
+           string_ns, iov_ns, RENDERS);
+
+    size_t page_len = 0;
+    start = bench_now_ns();
+    for (int i = 0; i < LARGE_RENDERS; i++) {
+        cx_out_t out;
+        cx_out_init(&out, 4096);
+        render_large(&out, "a table cell of twenty");
+        char *html = cx_out_finish(&out);
+        page_len = strlen(html);
+        free(html);
+    }
+    double large_us = (bench_now_ns() - start) / LARGE_RENDERS / 1000;
+    bench_sink = bytes + page_len;
+
+    printf("render: %zu byte page of %d segments %.1f us\n", page_len, LARGE_ROWS * 3, large_us);
+    return 0;
+}
@@ -0,0 +1,62 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "bench.h"
+#include "routes.h"
+#include "server.h"
+
+/*
+*   find_route over a table of 400 runtime routes: per resource a static
+*   collection, a static sub path, a :id route, a two parameter route and
+*   a '*' route. Lookups cycle through static hits, parameter hits and
+*   misses.
+*/
+
+#define RESOURCES 80
+#define LOOKUPS 2000000
+
+static void handler(int client_fd __attribute__((unused)), http_req_t *req __attribute__((unused))) {}
+
+int main(void) {
+    char path[128];
+    for (int i = 0; i < RESOURCES; i++) {
+        snprintf(path, sizeof(path), "/api/v1/resource%d", i);
+        add_route("GET", path, NULL, handler);
+        snprintf(path, sizeof(path), "/api/v1/resource%d/list", i);
+        add_route("GET", path, NULL, handler);
+        snprintf(path, sizeof(path), "/api/v1/resource%d/:id", i);
+        add_route("GET", path, NULL, handler);
+        snprintf(path, sizeof(path), "/api/v1/resource%d/:id/items/:item", i);
+        add_route("GET", path, NULL, handler);
+        snprintf(path, sizeof(path), "/static/group%d/*", i);
+        add_route("GET", path, NULL, handler);
+    }
+
+    static char paths[RESOURCES * 4][128];
+    int paths_len = 0;
+    for (int i = 0; i < RESOURCES; i++) {
+        snprintf(paths[paths_len++], 128, "/api/v1/resource%d/list", i);
+        snprintf(paths[paths_len++], 128, "/api/v1/resource%d/%d/items/%d", i, i * 7, i * 13);
+        snprintf(paths[paths_len++], 128, "/static/group%d/app.%d.js", i, i);
+        snprintf(paths[paths_len++], 128, "/api/v2/resource%d/missing", i);
+    }
+
+    http_req_t req;
+    memset(&req, 0, sizeof(req));
+    req.method = "GET";
+
+    size_t found = 0;
+    double start = bench_now_ns();
+    for (int i = 0; i < LOOKUPS; i++) {
+        req.path = paths[i % paths_len];
+        found += find_route(&req) != NULL;
+    }
+    double elapsed = bench_now_ns() - start;
+    bench_sink = found;
+
+    printf("routes: %d routes, %d lookups, %zu matched, %.1f ns/lookup\n",
+           RESOURCES * 5, LOOKUPS, found, elapsed / LOOKUPS);
+
+    free_routes();
+    return 0;
+}
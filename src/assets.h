@@ -0,0 +1,35 @@
+#ifndef ASSETS_H
+#define ASSETS_H
+
+#include <stddef.h>
+
+/*
+*   Static assets embedded into the binary by assetc (src_assetc/main.c).
+*   Every variant carries its fully prebuilt response head, so serving an
+*   asset is two sends and no filesystem access.
+*/
+
+typedef struct {
+    const unsigned char *data;
+    size_t len;
+    const char *headers;
+    size_t headers_len;
+} asset_variant_t;
+
+typedef struct {
+    const char *path;
+    size_t path_len;
+    const char *mime_type;
+    const char *etag;
+    size_t etag_len;
+    asset_variant_t identity;
+    asset_variant_t gzip;
+    asset_variant_t br;
+    const char *not_modified;
+    size_t not_modified_len;
+} asset_t;
+
+const asset_t *asset_lookup(const char *path, size_t path_len);
+size_t asset_count(void);
+
+#endif
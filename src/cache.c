@@ -0,0 +1,272 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/uio.h>
+#include <time.h>
+
+#include "cache.h"
+#include "server.h"
+#include "utils.h"
+
+route_cache_t *route_cache_create(const route_cache_opts_t *opts) {
+    route_cache_t *cache = calloc(1, sizeof(route_cache_t));
+    if (!cache) {
+        LOG("Failed to allocate route cache");
+        return NULL;
+    }
+
+    cache->opts = *opts;
+    if (cache->opts.max_entries <= 0) {
+        cache->opts.max_entries = ROUTE_CACHE_DEFAULT_ENTRIES;
+    }
+
+    cache->entries = calloc(cache->opts.max_entries, sizeof(route_cache_entry_t));
+    if (!cache->entries) {
+        LOG("Failed to allocate route cache entries");
+        free(cache);
+        return NULL;
+    }
+
+    return cache;
+}
+
+void route_cache_free(route_cache_t *cache) {
+    if (!cache) return;
+
+    for (int i = 0; i < cache->entries_len; i++) {
+        free(cache->entries[i].key);
+        free(cache->entries[i].data);
+    }
+    free(cache->entries);
+    free(cache);
+}
+
+static int key_append(char *key, size_t *pos, size_t size, const char *s, size_t len) {
+    if (*pos + len + 1 >= size) return -1;
+    memcpy(key + *pos, s, len);
+    *pos += len;
+    key[*pos] = '\0';
+    return 0;
+}
+
+/*
+*   Key layout: host, path, then every selected query parameter and header
+*   value, each preceded by a separator byte that cannot appear in the
+*   values. The host keeps routes on the * host or reached through
+*   subdomain fallback from serving one host's response to another.
+*/
+static int build_key(const route_cache_t *cache, http_req_t *req, char *key, size_t size) {
+    size_t pos = 0;
+    if (req->host && key_append(key, &pos, size, req->host, req->host_len) != 0) return -1;
+    if (key_append(key, &pos, size, "\x03", 1) != 0) return -1;
+    if (key_append(key, &pos, size, req->path, strlen(req->path)) != 0) return -1;
+
+    for (const char **q = cache->opts.query_keys; q && *q; q++) {
+        slice_t value = get_query_param(req, *q);
+        if (key_append(key, &pos, size, "\x01", 1) != 0) return -1;
+        if (value.data && key_append(key, &pos, size, value.data, value.len) != 0) return -1;
+    }
+
+    for (const char **h = cache->opts.header_keys; h && *h; h++) {
+        const char *value = get_header(req, *h);
+        if (key_append(key, &pos, size, "\x02", 1) != 0) return -1;
+        if (value && key_append(key, &pos, size, value, strlen(value)) != 0) return -1;
+    }
+
+    return 0;
+}
+
+static unsigned long hash_key(const char *key) {
+    unsigned long h = 14695981039346656037UL;
+    for (; *key; key++) {
+        h ^= (unsigned char)*key;
+        h *= 1099511628211UL;
+    }
+    return h;
+}
+
+static route_cache_entry_t *cache_find(route_cache_t *cache, unsigned long hash, const char *key) {
+    for (int i = 0; i < cache->entries_len; i++) {
+        route_cache_entry_t *e = &cache->entries[i];
+        if (e->hash == hash && strcmp(e->key, key) == 0) return e;
+    }
+    return NULL;
+}
+
+static route_cache_entry_t *cache_slot(route_cache_t *cache, unsigned long hash, const char *key) {
+    char *key_copy = strdup(key);
+    if (!key_copy) return NULL;
+
+    route_cache_entry_t *e = NULL;
+    if (cache->entries_len < cache->opts.max_entries) {
+        e = &cache->entries[cache->entries_len++];
+    } else {
+        e = &cache->entries[0];
+        for (int i = 1; i < cache->entries_len; i++) {
+            if (cache->entries[i].created < e->created) e = &cache->entries[i];
+        }
+        free(e->key);
+        free(e->data);
+    }
+
+    memset(e, 0, sizeof(*e));
+    e->hash = hash;
+    e->key = key_copy;
+    return e;
+}
+
+static int header_is(const char *line, size_t line_len, const char *name) {
+    size_t name_len = strlen(name);
+    return line_len > name_len && line[name_len] == ':' && strncasecmp(line, name, name_len) == 0;
+}
+
+/*
+*   Only plain 200 responses meant for anyone are stored. Set-Cookie,
+*   Vary and Cache-Control private or no-store mark responses that must
+*   not be replayed to other clients.
+*/
+static int is_cacheable(const char *data, size_t len) {
+    if (len <= 12 || strncmp(data, "HTTP/1.1 200", 12) != 0) return 0;
+
+    const char *end = memmem(data, len, "\r\n\r\n", 4);
+    if (!end) return 0;
+
+    const char *line = (const char *)memmem(data, end - data + 2, "\r\n", 2) + 2;
+    while (line < end + 2) {
+        const char *next = (const char *)memmem(line, end + 2 - line, "\r\n", 2);
+        size_t line_len = next - line;
+
+        if (header_is(line, line_len, "Set-Cookie") || header_is(line, line_len, "Vary")) return 0;
+        if (header_is(line, line_len, "Cache-Control")) {
+            char value[256];
+            if (line_len >= sizeof(value)) return 0;
+            snprintf(value, sizeof(value), "%.*s", (int)line_len, line);
+            if (strcasestr(value, "private") || strcasestr(value, "no-store")) return 0;
+        }
+
+        line = next + 2;
+    }
+
+    return 1;
+}
+
+/* credentials make the response personal unless they are part of the key */
+static int is_personal(const route_cache_t *cache, http_req_t *req) {
+    if (!get_header(req, "Authorization")) return 0;
+
+    for (const char **h = cache->opts.header_keys; h && *h; h++) {
+        if (strcasecmp(*h, "Authorization") == 0) return 0;
+    }
+    return 1;
+}
+
+/*
+*   Drops the Date line from a captured response, the current one is
+*   slotted in when the entry is sent. Returns the offset of the empty
+*   line that ends the head, or -1 when there is none.
+*/
+static long strip_date(char *data, size_t *len) {
+    char *end = memmem(data, *len, "\r\n\r\n", 4);
+    if (!end) return -1;
+
+    char *blank = end + 2;
+    char *line = memmem(data, blank - data, "\r\n", 2) + 2;
+    while (line < blank) {
+        char *next = (char *)memmem(line, blank - line, "\r\n", 2) + 2;
+        if (strncasecmp(line, "Date:", 5) == 0) {
+            size_t line_len = next - line;
+            memmove(line, next, data + *len - next);
+            *len -= line_len;
+            blank -= line_len;
+        } else {
+            line = next;
+        }
+    }
+
+    return blank - data;
+}
+
+static void send_entry(int client_fd, const route_cache_entry_t *e) {
+    slice_t date = clock_date_header();
+    struct iovec iov[3] = {
+        {e->data, e->head_len},
+        {(void *)date.data, date.len},
+        {e->data + e->head_len, e->len - e->head_len}
+    };
+    send_iov(client_fd, iov, 3);
+}
+
+/*
+*   Runs the handler with the response captured. With client_fd -1 nothing
+*   is sent, which is how stale entries are refreshed after the stale copy
+*   went out.
+*/
+static void regenerate(route_t *r, route_cache_t *cache, route_cache_entry_t *e,
+                       unsigned long hash, const char *key, int client_fd, http_req_t *req) {
+    response_capture_begin(client_fd);
+    r->callback(client_fd, req);
+
+    size_t len = 0;
+    char *data = response_capture_end(&len);
+    long head_len = data && is_cacheable(data, len) ? strip_date(data, &len) : -1;
+    if (head_len < 0) {
+        free(data);
+        return;
+    }
+
+    if (!e) {
+        e = cache_find(cache, hash, key);
+        if (!e) e = cache_slot(cache, hash, key);
+        if (!e) {
+            free(data);
+            return;
+        }
+    }
+
+    free(e->data);
+    e->data = data;
+    e->len = len;
+    e->head_len = head_len;
+    e->created = clock_now();
+}
+
+/*
+*   Serves GET requests of a cached route. Returns 0 when the request was
+*   answered, -1 when the caller should run the handler directly.
+*
+*   Requests are handled one at a time, so a miss can never overlap the
+*   regeneration of the same entry and there is nothing to coalesce. A
+*   stale entry is sent first and regenerated right after.
+*/
+int route_cache_handle(route_t *r, int client_fd, http_req_t *req) {
+    route_cache_t *cache = r->cache;
+    if (strcmp(req->method, "GET") != 0 || is_personal(cache, req)) return -1;
+
+    char key[MAX_PATH_LENGTH + MAX_HEADER_LENGTH];
+    if (build_key(cache, req, key, sizeof(key)) != 0) return -1;
+
+    unsigned long hash = hash_key(key);
+    route_cache_entry_t *e = cache_find(cache, hash, key);
+    time_t now = clock_now();
+
+    if (e && e->data) {
+        time_t age = now - e->created;
+
+        if (age < cache->opts.ttl) {
+            send_entry(client_fd, e);
+            return 0;
+        }
+
+        if (age < cache->opts.ttl + cache->opts.stale_ttl) {
+            send_entry(client_fd, e);
+            regenerate(r, cache, e, hash, key, -1, req);
+            return 0;
+        }
+    }
+
+    regenerate(r, cache, e, hash, key, client_fd, req);
+    return 0;
+}
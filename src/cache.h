@@ -0,0 +1,45 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <time.h>
+
+#include "server.h"
+
+#define ROUTE_CACHE_DEFAULT_ENTRIES 64
+
+/*
+*   ttl:          seconds a response is served without calling the handler
+*   stale_ttl:    extra seconds a response may be served stale while it is
+*                 regenerated (stale-while-revalidate), 0 disables
+*   query_keys:   NULL terminated list of query parameters in the cache key
+*   header_keys:  NULL terminated list of headers in the cache key
+*   max_entries:  number of cached variants, defaults to 64
+*/
+typedef struct {
+    int ttl;
+    int stale_ttl;
+    const char **query_keys;
+    const char **header_keys;
+    int max_entries;
+} route_cache_opts_t;
+
+typedef struct {
+    unsigned long hash;
+    char *key;
+    char *data;
+    size_t len;
+    size_t head_len;
+    time_t created;
+} route_cache_entry_t;
+
+typedef struct route_cache {
+    route_cache_opts_t opts;
+    route_cache_entry_t *entries;
+    int entries_len;
+} route_cache_t;
+
+route_cache_t *route_cache_create(const route_cache_opts_t *opts);
+void route_cache_free(route_cache_t *cache);
+int route_cache_handle(route_t *r, int client_fd, http_req_t *req);
+
+#endif
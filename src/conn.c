@@ -0,0 +1,377 @@
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/sendfile.h>
+#include <sys/uio.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "conn.h"
+#include "server.h"
+#include "utils.h"
+
+#define FLUSH_MAX_IOV 64
+
+extern server_t server;
+
+static connection_pool_t conn_pool = {0};
+static client_con_t **conn_table = NULL;
+static size_t conn_table_len = 0;
+
+static int table_set(int fd, client_con_t *conn) {
+    if ((size_t)fd >= conn_table_len) {
+        size_t len = conn_table_len ? conn_table_len : 256;
+        while (len <= (size_t)fd) len *= 2;
+
+        client_con_t **table = realloc(conn_table, len * sizeof(*table));
+        if (!table) return -1;
+        memset(table + conn_table_len, 0, (len - conn_table_len) * sizeof(*table));
+        conn_table = table;
+        conn_table_len = len;
+    }
+    conn_table[fd] = conn;
+    return 0;
+}
+
+client_con_t *get_connection(int fd) {
+    client_con_t *conn;
+
+    if (conn_pool.free_connections) {
+        conn = conn_pool.free_connections;
+        conn_pool.free_connections = conn->next;
+    } else if (conn_pool.total_count < CONNECTION_POOL_SIZE) {
+        conn = malloc(sizeof(client_con_t));
+        if (!conn) return NULL;
+        conn_pool.total_count++;
+    } else {
+        return NULL;
+    }
+
+    memset(conn, 0, sizeof(*conn));
+    conn->fd = fd;
+    conn->last_activity = clock_now();
+    conn->stream.conn = conn;
+
+    if (table_set(fd, conn) != 0) {
+        conn->next = conn_pool.free_connections;
+        conn_pool.free_connections = conn;
+        return NULL;
+    }
+
+    conn->next = conn_pool.active_connections;
+    if (conn->next) conn->next->prev = conn;
+    conn_pool.active_connections = conn;
+    conn_pool.active_count++;
+
+    return conn;
+}
+
+void release_connection(client_con_t *conn) {
+    if (conn->prev) conn->prev->next = conn->next;
+    else conn_pool.active_connections = conn->next;
+    if (conn->next) conn->next->prev = conn->prev;
+    conn_pool.active_count--;
+
+    if (conn_lookup(conn->fd) == conn) conn_table[conn->fd] = NULL;
+
+    conn->prev = NULL;
+    conn->next = conn_pool.free_connections;
+    conn_pool.free_connections = conn;
+}
+
+client_con_t *conn_lookup(int fd) {
+    if (fd < 0 || (size_t)fd >= conn_table_len) return NULL;
+    return conn_table[fd];
+}
+
+static void set_write_interest(client_con_t *conn, int want) {
+    if (conn->want_write == want) return;
+
+    struct epoll_event ev = {0};
+    ev.events = EPOLLIN | (want ? EPOLLOUT : 0);
+    ev.data.fd = conn->fd;
+    if (epoll_ctl(server.epoll_fd, EPOLL_CTL_MOD, conn->fd, &ev) != 0) {
+        LOG("epoll_ctl failed for fd %d", conn->fd);
+        return;
+    }
+    conn->want_write = want;
+}
+
+static void queue_append(client_con_t *conn, out_seg_t *seg) {
+    seg->next = NULL;
+    if (conn->out_tail) conn->out_tail->next = seg;
+    else conn->out_head = seg;
+    conn->out_tail = seg;
+    conn->out_bytes += seg->len - seg->off;
+    set_write_interest(conn, 1);
+}
+
+static void free_seg(out_seg_t *seg) {
+    if (seg->file_fd >= 0) close(seg->file_fd);
+    if (seg->shared) shared_buf_release(seg->shared);
+    free(seg);
+}
+
+shared_buf_t *shared_buf_create(size_t len) {
+    shared_buf_t *buf = malloc(sizeof(shared_buf_t) + len);
+    if (!buf) return NULL;
+    buf->refs = 1;
+    buf->len = len;
+    return buf;
+}
+
+void shared_buf_release(shared_buf_t *buf) {
+    if (buf && --buf->refs == 0) free(buf);
+}
+
+/*
+*   Copies whatever the socket did not take. The caller's buffers may be
+*   gone by the time the queue is flushed.
+*/
+server_status_t conn_queue(client_con_t *conn, const struct iovec *iov, int iov_count) {
+    size_t total = 0;
+    for (int i = 0; i < iov_count; i++) total += iov[i].iov_len;
+    if (total == 0) return SERVER_OK;
+
+    out_seg_t *seg = malloc(sizeof(out_seg_t) + total);
+    if (!seg) return SERVER_ERR_MEMORY;
+
+    seg->shared = NULL;
+    seg->data = (char *)(seg + 1);
+    seg->len = total;
+    seg->off = 0;
+    seg->file_fd = -1;
+    seg->file_off = 0;
+
+    size_t pos = 0;
+    for (int i = 0; i < iov_count; i++) {
+        memcpy(seg->data + pos, iov[i].iov_base, iov[i].iov_len);
+        pos += iov[i].iov_len;
+    }
+
+    queue_append(conn, seg);
+    return SERVER_OK;
+}
+
+/*
+*   Queues a file range by duplicating file_fd, the caller keeps ownership
+*   of its descriptor.
+*/
+server_status_t conn_queue_file(client_con_t *conn, int file_fd, off_t offset, size_t len) {
+    if (len == 0) return SERVER_OK;
+
+    out_seg_t *seg = malloc(sizeof(out_seg_t));
+    if (!seg) return SERVER_ERR_MEMORY;
+
+    seg->file_fd = dup(file_fd);
+    if (seg->file_fd < 0) {
+        free(seg);
+        return SERVER_ERR_FILE;
+    }
+    seg->shared = NULL;
+    seg->data = NULL;
+    seg->len = len;
+    seg->off = 0;
+    seg->file_off = offset;
+
+    queue_append(conn, seg);
+    return SERVER_OK;
+}
+
+/*
+*   Writes a shared buffer straight to the socket when nothing is queued.
+*   Only the part the socket did not take is queued, as a reference to buf
+*   instead of a copy, so a fast client costs no allocation.
+*/
+server_status_t conn_send_shared(client_con_t *conn, shared_buf_t *buf) {
+    size_t off = 0;
+
+    if (!conn->out_head) {
+        while (off < buf->len) {
+            ssize_t sent = write(conn->fd, buf->data + off, buf->len - off);
+            if (sent < 0) {
+                if (errno == EINTR) continue;
+                if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+                return SERVER_ERR_NETWORK;
+            }
+            off += sent;
+        }
+        if (off == buf->len) return SERVER_OK;
+    }
+
+    out_seg_t *seg = malloc(sizeof(out_seg_t));
+    if (!seg) return SERVER_ERR_MEMORY;
+
+    buf->refs++;
+    seg->shared = buf;
+    seg->data = buf->data;
+    seg->len = buf->len;
+    seg->off = off;
+    seg->file_fd = -1;
+    seg->file_off = 0;
+
+    queue_append(conn, seg);
+    return SERVER_OK;
+}
+
+static void queue_advance(client_con_t *conn, size_t sent) {
+    conn->out_bytes -= sent;
+    while (sent > 0) {
+        out_seg_t *seg = conn->out_head;
+        size_t left = seg->len - seg->off;
+        if (sent < left) {
+            seg->off += sent;
+            return;
+        }
+        sent -= left;
+        conn->out_head = seg->next;
+        if (!conn->out_head) conn->out_tail = NULL;
+        free_seg(seg);
+    }
+}
+
+static int flush_file(client_con_t *conn, out_seg_t *seg) {
+    size_t left = seg->len - seg->off;
+    size_t chunk_size = left > SENDFILE_CHUNK_SIZE ? SENDFILE_CHUNK_SIZE : left;
+    off_t pos = seg->file_off + seg->off;
+
+    ssize_t sent = sendfile(conn->fd, seg->file_fd, &pos, chunk_size);
+    if (sent < 0) {
+        if (errno == EINTR) return 0;
+        if (errno == EAGAIN || errno == EWOULDBLOCK) return 1;
+        return -1;
+    }
+    if (sent == 0) return -1;
+
+    queue_advance(conn, sent);
+    return 0;
+}
+
+/*
+*   Writes queued output until the socket pushes back. Consecutive memory
+*   segments go out in one writev. Returns 0 when the queue is empty,
+*   1 when output is still pending and -1 when the connection failed.
+*/
+int conn_flush(client_con_t *conn) {
+    while (conn->out_head) {
+        if (conn->out_head->file_fd >= 0) {
+            int result = flush_file(conn, conn->out_head);
+            if (result != 0) return result;
+            continue;
+        }
+
+        struct iovec iov[FLUSH_MAX_IOV];
+        int iov_count = 0;
+        for (out_seg_t *seg = conn->out_head; seg && seg->file_fd < 0 && iov_count < FLUSH_MAX_IOV; seg = seg->next) {
+            iov[iov_count++] = (struct iovec){seg->data + seg->off, seg->len - seg->off};
+        }
+
+        ssize_t sent = writev(conn->fd, iov, iov_count);
+        if (sent < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return 1;
+            return -1;
+        }
+
+        queue_advance(conn, sent);
+    }
+
+    return 0;
+}
+
+/*
+*   EPOLLOUT handler. A paused stream is resumed once the queue is below
+*   the low watermark; the callback may end the stream and close conn.
+*/
+void conn_writable(client_con_t *conn) {
+    int result = conn_flush(conn);
+    if (result < 0) {
+        conn_close(conn);
+        return;
+    }
+
+    conn->last_activity = clock_now();
+
+    if (result == 0) {
+        set_write_interest(conn, 0);
+        if (conn->closing) {
+            conn_close(conn);
+            return;
+        }
+    }
+
+    stream_t *stream = &conn->stream;
+    if (stream->active && stream->paused && conn->out_bytes <= STREAM_LOW_WATERMARK) {
+        stream->paused = 0;
+        if (stream->on_drain) stream->on_drain(stream, stream->ctx);
+    }
+}
+
+/*
+*   Called when the request handler has returned. The connection stays
+*   open while a stream is active and until queued output is written.
+*/
+void conn_finish(client_con_t *conn) {
+    conn->last_activity = clock_now();
+    if (conn->dispatching || conn->stream.active) return;
+
+    conn->closing = 1;
+    if (!conn->out_head) conn_close(conn);
+}
+
+void conn_close(client_con_t *conn) {
+    stream_t *stream = &conn->stream;
+    if (stream->active) {
+        stream->active = 0;
+        if (stream->on_close) stream->on_close(stream, stream->ctx);
+    }
+
+    while (conn->out_head) {
+        out_seg_t *next = conn->out_head->next;
+        free_seg(conn->out_head);
+        conn->out_head = next;
+    }
+    conn->out_tail = NULL;
+    conn->out_bytes = 0;
+
+    int fd = conn->fd;
+    release_connection(conn);
+    close(fd);
+}
+
+/*
+*   Closes idle connections. An active stream with nothing queued is only
+*   waiting for its producer and is left alone.
+*/
+void cleanup_expired_connections(void) {
+    time_t now = clock_now();
+    client_con_t *conn = conn_pool.active_connections;
+
+    while (conn) {
+        client_con_t *next = conn->next;
+        int idle = now - conn->last_activity > KEEPALIVE_TIMEOUT;
+        if (idle && (!conn->stream.active || conn->out_head)) {
+            conn_close(conn);
+        }
+        conn = next;
+    }
+}
+
+void shutdown_connections(void) {
+    while (conn_pool.active_connections) {
+        conn_close(conn_pool.active_connections);
+    }
+
+    client_con_t *curr_conn = conn_pool.free_connections;
+    while (curr_conn) {
+        client_con_t *next = curr_conn->next;
+        free(curr_conn);
+        curr_conn = next;
+    }
+    conn_pool.free_connections = NULL;
+
+    free(conn_table);
+    conn_table = NULL;
+    conn_table_len = 0;
+}
@@ -0,0 +1,34 @@
+#ifndef CONN_H
+#define CONN_H
+
+#include <sys/types.h>
+#include <sys/uio.h>
+
+#include "server.h"
+
+/*
+*   Connections are allocated at accept time and found by fd. Output the
+*   socket does not take right away is queued on the connection and
+*   flushed from the epoll loop on EPOLLOUT, so a slow client never blocks
+*   the loop. A connection marked closing is closed once its queue drains.
+*/
+
+client_con_t *get_connection(int fd);
+void release_connection(client_con_t *conn);
+client_con_t *conn_lookup(int fd);
+
+server_status_t conn_queue(client_con_t *conn, const struct iovec *iov, int iov_count);
+server_status_t conn_queue_file(client_con_t *conn, int file_fd, off_t offset, size_t len);
+server_status_t conn_send_shared(client_con_t *conn, shared_buf_t *buf);
+int conn_flush(client_con_t *conn);
+void conn_writable(client_con_t *conn);
+void conn_finish(client_con_t *conn);
+void conn_close(client_con_t *conn);
+
+shared_buf_t *shared_buf_create(size_t len);
+void shared_buf_release(shared_buf_t *buf);
+
+void cleanup_expired_connections(void);
+void shutdown_connections(void);
+
+#endif
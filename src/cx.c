@@ -1,77 +1,569 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
+#include <time.h>
 
-void fast_strcat(char *dest, const char *src){
-    while (*dest) dest++;
-    while((*dest++ = *src++));
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "cx.h"
+#include "response.h"
+#include "utils.h"
+
+int cx_out_init(cx_out_t *out, size_t size_hint) {
+    out->len = 0;
+    out->cap = size_hint ? size_hint : 256;
+    out->failed = 0;
+    out->data = malloc(out->cap + 1);
+    if (!out->data) {
+        out->failed = 1;
+        return -1;
+    }
+    return 0;
 }
 
-void process_text(char *s) {
-    if (!s) return;
+int cx_out_grow(cx_out_t *out, size_t extra) {
+    if (out->failed) return -1;
 
-    char *temp_buf = malloc(strlen(s) * 2 + 1);
-    if(!temp_buf) {
-        perror("Malloc failed");
-        return;
+    size_t cap = out->cap * 2;
+    while (cap < out->len + extra) cap *= 2;
+
+    char *data = realloc(out->data, cap + 1);
+    if (!data) {
+        out->failed = 1;
+        return -1;
     }
+    out->data = data;
+    out->cap = cap;
+    return 0;
+}
 
-    char *read_ptr = s;
-    char *write_ptr = temp_buf;
+/*
+*   Terminates the output and hands it to the caller, who frees it.
+*/
+char *cx_out_finish(cx_out_t *out) {
+    if (out->failed) {
+        free(out->data);
+        return NULL;
+    }
+    out->data[out->len] = '\0';
+    return out->data;
+}
 
-    while (*read_ptr != '\0') {
-        if (*read_ptr == '\n') {
-            *write_ptr++ = '\\';
-            *write_ptr++ = 'n';
-            read_ptr++;
-        }
-        else if (*read_ptr == '"') {
-            *write_ptr++ = '\\';
-            *write_ptr++ = '"';
-            read_ptr++;
+void cx_iov_init(cx_iov_t *out) {
+    out->iov = out->inline_iov;
+    out->iov_len = 0;
+    out->iov_cap = CX_INLINE_IOV;
+    out->total = 0;
+    out->scratch = out->inline_scratch;
+    out->scratch_len = 0;
+    out->scratch_cap = CX_INLINE_SCRATCH;
+    out->blocks = NULL;
+    out->failed = 0;
+    out->sink = NULL;
+    out->sink_ctx = NULL;
+}
+
+int cx_iov_grow(cx_iov_t *out) {
+    if (out->failed) return -1;
+    if (out->sink) {
+        cx_iov_flush(out);
+        return 0;
+    }
+
+    int cap = out->iov_cap * 2;
+    struct iovec *iov = out->iov == out->inline_iov
+        ? malloc(cap * sizeof(struct iovec))
+        : realloc(out->iov, cap * sizeof(struct iovec));
+    if (!iov) {
+        out->failed = 1;
+        return -1;
+    }
+    if (out->iov == out->inline_iov) memcpy(iov, out->inline_iov, sizeof(out->inline_iov));
+    out->iov = iov;
+    out->iov_cap = cap;
+    return 0;
+}
+
+/*
+*   Starts a new scratch block that fits at least len bytes. The old
+*   block keeps its contents since iovecs already point into it.
+*/
+int cx_iov_scratch(cx_iov_t *out, size_t len) {
+    if (out->failed) return -1;
+    if (out->sink) {
+        cx_iov_flush(out);
+        if (len <= out->scratch_cap) return 0;
+    }
+
+    size_t cap = len > CX_SCRATCH_BLOCK ? len : CX_SCRATCH_BLOCK;
+    cx_block_t *block = malloc(sizeof(cx_block_t) + cap);
+    if (!block) {
+        out->failed = 1;
+        return -1;
+    }
+    block->next = out->blocks;
+    out->blocks = block;
+    out->scratch = block->data;
+    out->scratch_len = 0;
+    out->scratch_cap = cap;
+    return 0;
+}
+
+static void free_blocks(cx_iov_t *out) {
+    while (out->blocks) {
+        cx_block_t *next = out->blocks->next;
+        free(out->blocks);
+        out->blocks = next;
+    }
+    out->scratch = out->inline_scratch;
+    out->scratch_len = 0;
+    out->scratch_cap = CX_INLINE_SCRATCH;
+}
+
+/*
+*   Hands the pending output to the sink and starts over with the inline
+*   iovecs and scratch. Without a sink this does nothing. Output rendered
+*   after the sink failed is dropped.
+*/
+void cx_iov_flush(cx_iov_t *out) {
+    if (!out->sink) return;
+
+    if (!out->failed && out->iov_len > 0 &&
+        out->sink(out->sink_ctx, out->iov, out->iov_len, out->total) < 0) {
+        out->failed = 1;
+    }
+    out->iov_len = 0;
+    out->total = 0;
+    free_blocks(out);
+}
+
+void cx_iov_free(cx_iov_t *out) {
+    free_blocks(out);
+    if (out->iov != out->inline_iov) free(out->iov);
+    out->iov = out->inline_iov;
+    out->iov_cap = CX_INLINE_IOV;
+    out->iov_len = 0;
+}
+
+static int chunk_sink(void *ctx, const struct iovec *iov, int iov_len, size_t len) {
+    return resp_write_chunk_iov(ctx, iov, iov_len, len) < 0 ? -1 : 0;
+}
+
+int cx_stream_begin(cx_iov_t *out, int client_fd) {
+    cx_iov_init(out);
+    if (response_capture_active(client_fd)) return -1;
+
+    response_t resp;
+    resp_init(&resp, OK_OK);
+    resp_header(&resp, "Content-Type", "text/html; charset=utf-8");
+    stream_t *stream = resp_begin_chunked(client_fd, &resp);
+    if (!stream) return -1;
+
+    out->sink = chunk_sink;
+    out->sink_ctx = stream;
+    return 0;
+}
+
+/*
+*   Chunks already sent cannot be taken back, so a render that fails
+*   midway ends as a truncated page.
+*/
+server_status_t cx_stream_end(cx_iov_t *out, int client_fd) {
+    if (out->sink != chunk_sink) return cx_send(client_fd, out);
+
+    stream_t *stream = out->sink_ctx;
+    cx_iov_flush(out);
+    int failed = out->failed;
+    cx_iov_free(out);
+    if (resp_end(stream) != 0 || failed) return SERVER_ERR_NETWORK;
+    return SERVER_OK;
+}
+
+/*
+*   Takes the rendered body and frees it.
+*/
+int cx_page_build(cx_page_t *page, char *body, const char *content_type) {
+    if (!body) return -1;
+
+    size_t body_len = strlen(body);
+    char head[512];
+    int head_len = snprintf(head, sizeof(head),
+                            "HTTP/1.1 200 OK\r\n"
+                            "Content-Type: %s\r\n"
+                            "Content-Length: %zu\r\n"
+                            "Connection: close\r\n"
+                            "Server: hehe/1.0\r\n"
+                            "\r\n",
+                            content_type, body_len);
+    if (head_len < 0 || (size_t)head_len >= sizeof(head)) {
+        free(body);
+        return -1;
+    }
+
+    char *data = malloc(head_len + body_len);
+    if (!data) {
+        LOG("Failed to allocate page of %zu bytes", body_len);
+        free(body);
+        return -1;
+    }
+    memcpy(data, head, head_len);
+    memcpy(data + head_len, body, body_len);
+    free(body);
+
+    free(page->data);
+    page->data = data;
+    page->len = head_len + body_len;
+    page->head_len = head_len;
+    return 0;
+}
+
+server_status_t cx_page_send(int client_fd, const cx_page_t *page) {
+    if (!page || !page->data) {
+        send_error_response(client_fd, ERR_INTERR);
+        return SERVER_ERR_RESOURCE;
+    }
+
+    slice_t date = clock_date_header();
+    struct iovec iov[3] = {
+        {page->data, page->head_len - 2},
+        {(void *)date.data, date.len},
+        {page->data + page->head_len - 2, page->len - page->head_len + 2}
+    };
+    return send_iov(client_fd, iov, 3);
+}
+
+static const char *html_entity(char c, size_t *len) {
+    switch (c) {
+        case '&': *len = 5; return "&amp;";
+        case '<': *len = 4; return "&lt;";
+        case '>': *len = 4; return "&gt;";
+        case '"': *len = 6; return "&quot;";
+        default:  *len = 5; return "&#39;";
+    }
+}
+
+static inline int html_special(unsigned char c) {
+    return c == '&' || c == '<' || c == '>' || c == '"' || c == '\'';
+}
+
+/*
+*   Scans 16 bytes per step. '<' (0x3c) and '>' (0x3e) differ only in bit
+*   1, '&' (0x26) and '\'' (0x27) only in bit 0, so three compares cover
+*   all five characters.
+*/
+size_t cx_html_clean_prefix(const char *src, size_t len) {
+    size_t i = 0;
+#ifdef __SSE2__
+    const __m128i bit0 = _mm_set1_epi8(0x01);
+    const __m128i bit1 = _mm_set1_epi8(0x02);
+    const __m128i amp_apos = _mm_set1_epi8('\'');
+    const __m128i lt_gt = _mm_set1_epi8('>');
+    const __m128i quot = _mm_set1_epi8('"');
+
+    for (; i + 16 <= len; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(src + i));
+        __m128i hit = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(_mm_or_si128(v, bit0), amp_apos),
+                         _mm_cmpeq_epi8(_mm_or_si128(v, bit1), lt_gt)),
+            _mm_cmpeq_epi8(v, quot));
+        int mask = _mm_movemask_epi8(hit);
+        if (mask) return i + __builtin_ctz(mask);
+    }
+#endif
+    for (; i < len; i++) {
+        if (html_special((unsigned char)src[i])) return i;
+    }
+    return len;
+}
+
+void cx_out_write_escaped(cx_out_t *out, const char *src) {
+    if (!src) return;
+
+    size_t len = strlen(src);
+    while (len > 0) {
+        size_t clean = cx_html_clean_prefix(src, len);
+        cx_out_write_len(out, src, clean);
+        if (clean == len) return;
+
+        size_t entity_len;
+        const char *entity = html_entity(src[clean], &entity_len);
+        cx_out_write_len(out, entity, entity_len);
+        src += clean + 1;
+        len -= clean + 1;
+    }
+}
+
+/* entities are copied too, so they join the surrounding fragment's iovec */
+void cx_iov_write_escaped(cx_iov_t *out, const char *src) {
+    if (!src) return;
+
+    size_t len = strlen(src);
+    while (len > 0) {
+        size_t clean = cx_html_clean_prefix(src, len);
+        cx_iov_write_len(out, src, clean);
+        if (clean == len) return;
+
+        size_t entity_len;
+        const char *entity = html_entity(src[clean], &entity_len);
+        cx_iov_write_len(out, entity, entity_len);
+        src += clean + 1;
+        len -= clean + 1;
+    }
+}
+
+/*
+*   Sends a rendered page as text/html with a single writev per batch of
+*   iovecs and frees the output.
+*/
+server_status_t cx_send(int client_fd, cx_iov_t *out) {
+    if (out->failed) {
+        cx_iov_free(out);
+        send_error_response(client_fd, ERR_INTERR);
+        return SERVER_ERR_RESOURCE;
+    }
+
+    response_t resp;
+    resp_init(&resp, OK_OK);
+    resp_header(&resp, "Content-Type", "text/html; charset=utf-8");
+    resp_body_iov(&resp, out->iov, out->iov_len, out->total);
+    server_status_t result = resp_send(client_fd, &resp);
+
+    cx_iov_free(out);
+    return result;
+}
+
+typedef struct {
+    unsigned long hash;
+    char *path;
+    char *data;
+    size_t len;
+    struct timespec mtime;
+    off_t size;
+    time_t checked;
+    time_t used;
+} cx_include_entry_t;
+
+static cx_include_entry_t includes[CX_INCLUDE_ENTRIES];
+static int includes_len = 0;
+
+static unsigned long hash_key(const char *key) {
+    unsigned long h = 14695981039346656037UL;
+    for (; *key; key++) {
+        h ^= (unsigned char)*key;
+        h *= 1099511628211UL;
+    }
+    return h;
+}
+
+static int include_load(cx_include_entry_t *e, const struct stat *st) {
+    if (st->st_size > CX_INCLUDE_MAX_SIZE) {
+        LOG("Include %s exceeds %d bytes", e->path, CX_INCLUDE_MAX_SIZE);
+        return -1;
+    }
+
+    FILE *f = fopen(e->path, "rb");
+    if (!f) return -1;
+
+    char *data = malloc(st->st_size + 1);
+    if (!data) {
+        LOG("Failed to allocate include %s", e->path);
+        fclose(f);
+        return -1;
+    }
+    size_t len = fread(data, 1, st->st_size, f);
+    fclose(f);
+
+    free(e->data);
+    e->data = data;
+    e->len = len;
+    e->mtime = st->st_mtim;
+    e->size = st->st_size;
+    return 0;
+}
+
+static void include_drop(cx_include_entry_t *e) {
+    free(e->path);
+    free(e->data);
+    *e = includes[--includes_len];
+}
+
+static cx_include_entry_t *include_slot(unsigned long hash, const char *path) {
+    char *path_copy = strdup(path);
+    if (!path_copy) return NULL;
+
+    cx_include_entry_t *e = NULL;
+    if (includes_len < CX_INCLUDE_ENTRIES) {
+        e = &includes[includes_len++];
+    } else {
+        e = &includes[0];
+        for (int i = 1; i < includes_len; i++) {
+            if (includes[i].used < e->used) e = &includes[i];
         }
-        else if (*read_ptr == '\\') {
-            *write_ptr++ = '\\';
-            *write_ptr++ = '\\';
-            read_ptr++;
+        free(e->path);
+        free(e->data);
+    }
+
+    memset(e, 0, sizeof(*e));
+    e->hash = hash;
+    e->path = path_copy;
+    return e;
+}
+
+int cx_include(const char *path, const char **data, size_t *len) {
+    if (!path) return -1;
+
+    unsigned long hash = hash_key(path);
+    time_t now = clock_now();
+
+    cx_include_entry_t *e = NULL;
+    for (int i = 0; i < includes_len; i++) {
+        if (includes[i].hash == hash && strcmp(includes[i].path, path) == 0) {
+            e = &includes[i];
+            break;
         }
-        else if (*read_ptr == '\t') {
-            *write_ptr++ = '\\';
-            *write_ptr++ = 't';
-            read_ptr++;
+    }
+
+    if (!e || now - e->checked >= CX_INCLUDE_CHECK_INTERVAL) {
+        struct stat st;
+        if (stat(path, &st) != 0 || !S_ISREG(st.st_mode)) {
+            if (e) include_drop(e);
+            return -1;
         }
-        else if (*read_ptr == '\r') {
-            read_ptr++;
-            *write_ptr++ = '\\';
-            *write_ptr++ = 'r';
-            read_ptr++;
+
+        int changed = !e || st.st_size != e->size ||
+                      st.st_mtim.tv_sec != e->mtime.tv_sec ||
+                      st.st_mtim.tv_nsec != e->mtime.tv_nsec;
+        if (!e) e = include_slot(hash, path);
+        if (!e) return -1;
+        if (changed && include_load(e, &st) != 0) {
+            include_drop(e);
+            return -1;
         }
-        else if (((unsigned char)*read_ptr) >= 0x80) {
-            unsigned char byte = (unsigned char)*read_ptr;
+        e->checked = now;
+    }
 
-            int utf8_len = 1;
-            if ((byte & 0xE0) == 0xC0) utf8_len = 2;      // 110xxxxx
-            else if ((byte & 0xF0) == 0xE0) utf8_len = 3; // 1110xxxx
-            else if ((byte & 0xF8) == 0xF0) utf8_len = 4; // 11110xxx
+    e->used = now;
+    *data = e->data;
+    *len = e->len;
+    return 0;
+}
 
-            for (int i = 0; i < utf8_len && *read_ptr != '\0'; i++) {
-                *write_ptr++ = *read_ptr++;
-            }
-        }
-        else {
-            *write_ptr++ = *read_ptr++;
+void cx_include_clear(void) {
+    for (int i = 0; i < includes_len; i++) {
+        free(includes[i].path);
+        free(includes[i].data);
+    }
+    includes_len = 0;
+}
+
+typedef struct {
+    unsigned long hash;
+    char *key;
+    char *data;
+    size_t len;
+    time_t expires;
+    time_t used;
+} cx_fragment_entry_t;
+
+static cx_fragment_entry_t fragments[CX_FRAGMENT_ENTRIES];
+static int fragments_len = 0;
+static size_t fragments_bytes = 0;
+
+static cx_fragment_entry_t *fragment_find(unsigned long hash, const char *key) {
+    for (int i = 0; i < fragments_len; i++) {
+        if (fragments[i].hash == hash && strcmp(fragments[i].key, key) == 0) return &fragments[i];
+    }
+    return NULL;
+}
+
+static int fragment_expired(const cx_fragment_entry_t *e, time_t now) {
+    return e->expires && now >= e->expires;
+}
+
+static void fragment_drop(cx_fragment_entry_t *e) {
+    fragments_bytes -= e->len;
+    free(e->key);
+    free(e->data);
+    *e = fragments[--fragments_len];
+}
+
+/*
+*   Evicts until a fragment of len bytes fits: expired fragments first,
+*   then the least recently used.
+*/
+static void fragment_make_room(size_t len, time_t now) {
+    for (int i = 0; i < fragments_len; ) {
+        if (fragment_expired(&fragments[i], now)) fragment_drop(&fragments[i]);
+        else i++;
+    }
+
+    while (fragments_len > 0 &&
+           (fragments_len == CX_FRAGMENT_ENTRIES || fragments_bytes + len > CX_FRAGMENT_MAX_BYTES)) {
+        cx_fragment_entry_t *oldest = &fragments[0];
+        for (int i = 1; i < fragments_len; i++) {
+            if (fragments[i].used < oldest->used) oldest = &fragments[i];
         }
+        fragment_drop(oldest);
+    }
+}
+
+int cx_fragment_get(const char *key, const char **data, size_t *len) {
+    if (!key) return -1;
+
+    time_t now = clock_now();
+    cx_fragment_entry_t *e = fragment_find(hash_key(key), key);
+    if (!e) return -1;
+    if (fragment_expired(e, now)) {
+        fragment_drop(e);
+        return -1;
+    }
+
+    e->used = now;
+    *data = e->data;
+    *len = e->len;
+    return 0;
+}
+
+void cx_fragment_put(const char *key, int ttl, cx_out_t *fragment) {
+    size_t len = fragment->len;
+    char *data = cx_out_finish(fragment);
+    if (!data || !key || len > CX_FRAGMENT_MAX_BYTES) {
+        free(data);
+        return;
+    }
+
+    unsigned long hash = hash_key(key);
+    cx_fragment_entry_t *e = fragment_find(hash, key);
+    if (e) fragment_drop(e);
+
+    char *key_copy = strdup(key);
+    if (!key_copy) {
+        LOG("Failed to allocate fragment key");
+        free(data);
+        return;
     }
 
-    *write_ptr = '\0';
+    time_t now = clock_now();
+    fragment_make_room(len, now);
 
-    strcpy(s, temp_buf);
-    free(temp_buf);
+    e = &fragments[fragments_len++];
+    e->hash = hash;
+    e->key = key_copy;
+    e->data = data;
+    e->len = len;
+    e->expires = ttl > 0 ? now + ttl : 0;
+    e->used = now;
+    fragments_bytes += len;
 }
 
-int get_file_length(FILE *f){
-    fseek(f, 0L, SEEK_END);
-    long length = ftell(f);
-    fseek(f, 0L, SEEK_SET);
-    return length;
+void cx_fragment_clear(void) {
+    for (int i = 0; i < fragments_len; i++) {
+        free(fragments[i].key);
+        free(fragments[i].data);
+    }
+    fragments_len = 0;
+    fragments_bytes = 0;
 }
@@ -2,9 +2,213 @@
 #define CX_H
 
 #include <stdio.h>
+#include <string.h>
+#include <sys/uio.h>
 
-void fast_strcat(char *dest, const char *src);
-int get_file_length(FILE *f);
-void process_text(char *s);
+#include "server.h"
+
+/*
+*   Output of a generated renderer. It starts at the size cxc computed
+*   for the template and doubles when dynamic segments need more. After
+*   a failed allocation further writes are dropped and cx_out_finish
+*   returns NULL.
+*/
+typedef struct {
+    char *data;
+    size_t len;
+    size_t cap;
+    int failed;
+} cx_out_t;
+
+int cx_out_init(cx_out_t *out, size_t size_hint);
+int cx_out_grow(cx_out_t *out, size_t extra);
+char *cx_out_finish(cx_out_t *out);
+
+static inline void cx_out_write_len(cx_out_t *out, const char *src, size_t len) {
+    if (out->len + len > out->cap && cx_out_grow(out, len) != 0) return;
+    memcpy(out->data + out->len, src, len);
+    out->len += len;
+}
+
+static inline void cx_out_write(cx_out_t *out, const char *src) {
+    if (src) cx_out_write_len(out, src, strlen(src));
+}
+
+#define CX_INLINE_IOV 64
+#define CX_INLINE_SCRATCH 1024
+#define CX_SCRATCH_BLOCK 4096
+#define CX_IOV_COPY_MAX 128
+
+typedef struct cx_block {
+    struct cx_block *next;
+    char data[];
+} cx_block_t;
+
+/*
+*   Output of a generated renderer as an iovec list for writev. Static
+*   segments point at the string literals in the binary, only dynamic
+*   fragments are copied into scratch memory. Scratch blocks never move,
+*   so every iovec stays valid until cx_iov_free. The struct holds its
+*   first iovecs and scratch bytes inline and must not be copied.
+*
+*   With a sink the output streams: {{flush}} and running out of inline
+*   iovecs or scratch hand everything pending to the sink and start over,
+*   so memory stays bounded however large the page is.
+*/
+typedef struct {
+    struct iovec *iov;
+    int iov_len;
+    int iov_cap;
+    size_t total;
+    char *scratch;
+    size_t scratch_len;
+    size_t scratch_cap;
+    cx_block_t *blocks;
+    int failed;
+    int (*sink)(void *ctx, const struct iovec *iov, int iov_len, size_t len);
+    void *sink_ctx;
+    struct iovec inline_iov[CX_INLINE_IOV];
+    char inline_scratch[CX_INLINE_SCRATCH];
+} cx_iov_t;
+
+void cx_iov_init(cx_iov_t *out);
+int cx_iov_grow(cx_iov_t *out);
+int cx_iov_scratch(cx_iov_t *out, size_t len);
+void cx_iov_flush(cx_iov_t *out);
+void cx_iov_free(cx_iov_t *out);
+
+static inline void cx_iov_borrow(cx_iov_t *out, const char *src, size_t len) {
+    if (len == 0) return;
+    if (out->iov_len == out->iov_cap && cx_iov_grow(out) != 0) return;
+    out->iov[out->iov_len++] = (struct iovec){(void *)src, len};
+    out->total += len;
+}
+
+/* the iovec slot is reserved first, a flush would discard the scratch bytes */
+static inline void cx_iov_write_len(cx_iov_t *out, const char *src, size_t len) {
+    if (len == 0) return;
+    if (out->iov_len == out->iov_cap && cx_iov_grow(out) != 0) return;
+    if (out->scratch_len + len > out->scratch_cap && cx_iov_scratch(out, len) != 0) return;
+
+    char *dst = out->scratch + out->scratch_len;
+    memcpy(dst, src, len);
+    out->scratch_len += len;
+    out->total += len;
+
+    /* consecutive dynamic fragments share one iovec */
+    struct iovec *last = out->iov_len > 0 ? &out->iov[out->iov_len - 1] : NULL;
+    if (last && (char *)last->iov_base + last->iov_len == dst) {
+        last->iov_len += len;
+        return;
+    }
+    out->iov[out->iov_len++] = (struct iovec){dst, len};
+}
+
+static inline void cx_iov_write(cx_iov_t *out, const char *src) {
+    if (src) cx_iov_write_len(out, src, strlen(src));
+}
+
+/*
+*   Short static segments, e.g. the markup around each item of a loop, are
+*   cheaper to copy next to their dynamic neighbours than to send as
+*   iovecs of their own.
+*/
+static inline void cx_iov_static(cx_iov_t *out, const char *src, size_t len) {
+    if (len < CX_IOV_COPY_MAX) cx_iov_write_len(out, src, len);
+    else cx_iov_borrow(out, src, len);
+}
+
+/*
+*   HTML escaping of <>&"' for {{=expr}}. cx_html_clean_prefix returns the
+*   length of the leading span that needs no escaping.
+*/
+size_t cx_html_clean_prefix(const char *src, size_t len);
+void cx_out_write_escaped(cx_out_t *out, const char *src);
+void cx_iov_write_escaped(cx_iov_t *out, const char *src);
+
+/*
+*   Generated code and {{ code }} blocks write through these, so the same
+*   template body renders into either output.
+*/
+#define cx_write_len(out, src, len) _Generic((out), \
+    cx_iov_t *: cx_iov_write_len, \
+    cx_out_t *: cx_out_write_len)((out), (src), (len))
+
+#define cx_write(out, src) _Generic((out), \
+    cx_iov_t *: cx_iov_write, \
+    cx_out_t *: cx_out_write)((out), (src))
+
+#define cx_write_escaped(out, src) _Generic((out), \
+    cx_iov_t *: cx_iov_write_escaped, \
+    cx_out_t *: cx_out_write_escaped)((out), (src))
+
+/* a string is complete only when rendering ends, flushing it is a no-op */
+static inline void cx_out_flush(cx_out_t *out) {
+    (void)out;
+}
+
+#define cx_flush(out) _Generic((out), \
+    cx_iov_t *: cx_iov_flush, \
+    cx_out_t *: cx_out_flush)(out)
+
+/* static segments are string literals, their length is a constant */
+#define cx_write_static(out, literal) _Generic((out), \
+    cx_iov_t *: cx_iov_static, \
+    cx_out_t *: cx_out_write_len)((out), (literal), sizeof(literal) - 1)
+
+server_status_t cx_send(int client_fd, cx_iov_t *out);
+
+/*
+*   Streams a page with chunked encoding: cx_stream_begin sends the head
+*   and attaches a sink to out, cx_stream_end flushes the rest and ends
+*   the stream. Responses that are being captured (route cache, HTTP/2)
+*   are rendered whole and sent by cx_stream_end with cx_send instead.
+*/
+int cx_stream_begin(cx_iov_t *out, int client_fd);
+server_status_t cx_stream_end(cx_iov_t *out, int client_fd);
+
+/*
+*   A template rendered once with constant props (const ({...}) in the .cx
+*   file), kept as a complete 200 response with Content-Length. The head
+*   ends in an empty line; Date is slotted in before it when sending, as
+*   for embedded assets, so a request costs one writev.
+*/
+typedef struct {
+    char *data;
+    size_t len;
+    size_t head_len;
+} cx_page_t;
+
+int cx_page_build(cx_page_t *page, char *body, const char *content_type);
+server_status_t cx_page_send(int client_fd, const cx_page_t *page);
+
+#define CX_INCLUDE_ENTRIES 64
+#define CX_INCLUDE_MAX_SIZE (8 * 1024 * 1024)
+#define CX_INCLUDE_CHECK_INTERVAL 1
+
+/*
+*   Contents of a file included by a dynamic path ({{=%expr}}). Files are
+*   read once and kept in a table of CX_INCLUDE_ENTRIES paths; a cached
+*   file is checked with stat at most every CX_INCLUDE_CHECK_INTERVAL
+*   seconds and reread when its mtime or size changed. The data stays
+*   valid until the next cx_include call.
+*/
+int cx_include(const char *path, const char **data, size_t *len);
+void cx_include_clear(void);
+
+#define CX_FRAGMENT_ENTRIES 256
+#define CX_FRAGMENT_MAX_BYTES (4 * 1024 * 1024)
+
+/*
+*   Shared cache of rendered {{cache key ttl}} blocks. Keys are global, so
+*   templates that use the same key share the fragment. At most
+*   CX_FRAGMENT_ENTRIES fragments and CX_FRAGMENT_MAX_BYTES bytes are kept;
+*   expired fragments are evicted first, then the least recently used.
+*   A ttl of 0 or less keeps the fragment until it is evicted.
+*   cx_fragment_put takes the rendered output and frees it.
+*/
+int cx_fragment_get(const char *key, const char **data, size_t *len);
+void cx_fragment_put(const char *key, int ttl, cx_out_t *fragment);
+void cx_fragment_clear(void);
 
 #endif
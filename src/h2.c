@@ -0,0 +1,1023 @@
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "h2.h"
+#include "conn.h"
+#include "response.h"
+#include "utils.h"
+
+enum {
+    H2_DATA = 0x0,
+    H2_HEADERS = 0x1,
+    H2_PRIORITY = 0x2,
+    H2_RST_STREAM = 0x3,
+    H2_SETTINGS = 0x4,
+    H2_PUSH_PROMISE = 0x5,
+    H2_PING = 0x6,
+    H2_GOAWAY = 0x7,
+    H2_WINDOW_UPDATE = 0x8,
+    H2_CONTINUATION = 0x9
+};
+
+enum {
+    H2_FLAG_ACK = 0x1,
+    H2_FLAG_END_STREAM = 0x1,
+    H2_FLAG_END_HEADERS = 0x4,
+    H2_FLAG_PADDED = 0x8,
+    H2_FLAG_PRIORITY = 0x20
+};
+
+enum {
+    H2_NO_ERROR = 0x0,
+    H2_PROTOCOL_ERROR = 0x1,
+    H2_FLOW_CONTROL_ERROR = 0x3,
+    H2_STREAM_CLOSED = 0x5,
+    H2_FRAME_SIZE_ERROR = 0x6,
+    H2_REFUSED_STREAM = 0x7,
+    H2_COMPRESSION_ERROR = 0x9,
+    H2_ENHANCE_YOUR_CALM = 0xB
+};
+
+enum {
+    SETTINGS_HEADER_TABLE_SIZE = 0x1,
+    SETTINGS_ENABLE_PUSH = 0x2,
+    SETTINGS_MAX_CONCURRENT_STREAMS = 0x3,
+    SETTINGS_INITIAL_WINDOW_SIZE = 0x4,
+    SETTINGS_MAX_FRAME_SIZE = 0x5
+};
+
+#define H2_MAX_WINDOW 0x7FFFFFFF
+
+/* response header blocks are encoded here, one at a time */
+static unsigned char response_block[H2_MAX_HEADER_BLOCK];
+
+static uint32_t read_u32(const unsigned char *p) {
+    return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+}
+
+static void write_u32(unsigned char *p, uint32_t v) {
+    p[0] = v >> 24;
+    p[1] = v >> 16;
+    p[2] = v >> 8;
+    p[3] = v;
+}
+
+static void frame_header(unsigned char *head, size_t len, int type, int flags, uint32_t id) {
+    head[0] = len >> 16;
+    head[1] = len >> 8;
+    head[2] = len;
+    head[3] = type;
+    head[4] = flags;
+    write_u32(head + 5, id & H2_MAX_WINDOW);
+}
+
+static void h2_send_frame(h2_conn_t *h2, int type, int flags, uint32_t id, const void *payload, size_t len) {
+    unsigned char head[H2_FRAME_HEADER];
+    frame_header(head, len, type, flags, id);
+
+    struct iovec iov[2] = {{head, H2_FRAME_HEADER}, {(void *)payload, len}};
+    if (send_iov(h2->conn->fd, iov, len ? 2 : 1) != SERVER_OK) h2->finished = 1;
+}
+
+static void h2_send_settings(h2_conn_t *h2) {
+    unsigned char payload[6];
+    payload[0] = 0;
+    payload[1] = SETTINGS_MAX_CONCURRENT_STREAMS;
+    write_u32(payload + 2, H2_MAX_STREAMS);
+    h2_send_frame(h2, H2_SETTINGS, 0, 0, payload, sizeof(payload));
+}
+
+/*
+*   Connection error: tells the peer which streams were processed and
+*   ends the connection once the frame is written.
+*/
+static void h2_goaway(h2_conn_t *h2, uint32_t code) {
+    if (h2->finished) return;
+
+    unsigned char payload[8];
+    write_u32(payload, h2->last_stream_id);
+    write_u32(payload + 4, code);
+    h2_send_frame(h2, H2_GOAWAY, 0, 0, payload, sizeof(payload));
+    h2->finished = 1;
+}
+
+static void h2_rst_stream(h2_conn_t *h2, uint32_t id, uint32_t code) {
+    unsigned char payload[4];
+    write_u32(payload, code);
+    h2_send_frame(h2, H2_RST_STREAM, 0, id, payload, sizeof(payload));
+}
+
+static void h2_window_update(h2_conn_t *h2, uint32_t id, uint32_t increment) {
+    unsigned char payload[4];
+    write_u32(payload, increment);
+    h2_send_frame(h2, H2_WINDOW_UPDATE, 0, id, payload, sizeof(payload));
+}
+
+static h2_stream_t *stream_find(h2_conn_t *h2, uint32_t id) {
+    for (h2_stream_t *s = h2->streams; s; s = s->next) {
+        if (s->id == id) return s;
+    }
+    return NULL;
+}
+
+static h2_stream_t *stream_create(h2_conn_t *h2, uint32_t id) {
+    h2_stream_t *s = calloc(1, sizeof(h2_stream_t));
+    if (!s) return NULL;
+
+    s->req.headers = calloc(MAX_HEADER_COUNT, sizeof(header_t));
+    if (!s->req.headers) {
+        free(s);
+        return NULL;
+    }
+
+    s->id = id;
+    s->send_window = h2->peer_initial_window;
+
+    if (h2->streams_tail) h2->streams_tail->next = s;
+    else h2->streams = s;
+    h2->streams_tail = s;
+    h2->streams_len++;
+    return s;
+}
+
+static void stream_free(h2_stream_t *s) {
+    http_req_free(&s->req);
+    free(s->body);
+    free(s->resp);
+    for (int i = s->file_index; i < s->files_len; i++) close(s->files[i].fd);
+    free(s->files);
+    free(s);
+}
+
+static void stream_remove(h2_conn_t *h2, h2_stream_t *s) {
+    h2_stream_t *prev = NULL;
+    for (h2_stream_t *it = h2->streams; it && it != s; it = it->next) prev = it;
+
+    if (prev) prev->next = s->next;
+    else h2->streams = s->next;
+    if (h2->streams_tail == s) h2->streams_tail = prev;
+    h2->streams_len--;
+    stream_free(s);
+}
+
+static int stream_pending(h2_stream_t *s) {
+    return s->resp_pos < s->resp_len || s->file_index < s->files_len;
+}
+
+/*
+*   A file range comes before the bytes captured after it.
+*/
+static int piece_is_file(h2_stream_t *s) {
+    return s->file_index < s->files_len && s->files[s->file_index].pos <= s->resp_pos;
+}
+
+/*
+*   Frames the next piece of the response body, bounded by the peer's
+*   frame size and both flow control windows.
+*/
+static void h2_send_data(h2_conn_t *h2, h2_stream_t *s) {
+    size_t limit = h2->peer_max_frame;
+    if ((int64_t)limit > h2->send_window) limit = h2->send_window;
+    if ((int64_t)limit > s->send_window) limit = s->send_window;
+
+    unsigned char head[H2_FRAME_HEADER];
+    struct iovec iov[2] = {{head, H2_FRAME_HEADER}, {NULL, 0}};
+    captured_file_t *file = NULL;
+    off_t file_offset = 0;
+    size_t n;
+
+    if (piece_is_file(s)) {
+        file = &s->files[s->file_index];
+        n = file->len - s->file_sent;
+        if (n > limit) n = limit;
+        file_offset = file->offset + s->file_sent;
+        s->file_sent += n;
+        if (s->file_sent == file->len) {
+            s->file_index++;
+            s->file_sent = 0;
+        } else {
+            file = NULL;
+        }
+    } else {
+        size_t end = s->file_index < s->files_len ? s->files[s->file_index].pos : s->resp_len;
+        n = end - s->resp_pos;
+        if (n > limit) n = limit;
+        iov[1].iov_base = s->resp + s->resp_pos;
+        iov[1].iov_len = n;
+        s->resp_pos += n;
+    }
+
+    h2->send_window -= n;
+    s->send_window -= n;
+
+    int flags = stream_pending(s) ? 0 : H2_FLAG_END_STREAM;
+    frame_header(head, n, H2_DATA, flags, s->id);
+
+    if (iov[1].iov_len) {
+        if (send_iov(h2->conn->fd, iov, 2) != SERVER_OK) h2->finished = 1;
+        return;
+    }
+
+    if (send_iov(h2->conn->fd, iov, 1) != SERVER_OK) h2->finished = 1;
+
+    /* a file that is done was advanced past, the range still uses its fd */
+    captured_file_t *range = file ? file : &s->files[s->file_index];
+    if (n > 0 && !h2->finished &&
+        send_file_range(h2->conn->fd, range->fd, file_offset, n) != SERVER_OK) {
+        h2->finished = 1;
+    }
+    if (file) close(file->fd);
+}
+
+static void set_cork(client_con_t *conn, int on) {
+    setsockopt(conn->fd, IPPROTO_TCP, TCP_CORK, &on, sizeof(on));
+}
+
+/*
+*   Round-robins DATA frames over the streams with a response until the
+*   connection window closes or the socket backs up. A paused connection
+*   resumes from h2_drained. The socket is corked meanwhile so frame
+*   headers leave in the same segments as file data sent with sendfile.
+*   After an upgrade the body of stream 1 waits for the client preface,
+*   clients only buffer so much behind the 101 response.
+*/
+static void h2_pump(h2_conn_t *h2) {
+    client_con_t *conn = h2->conn;
+    int progress = 1;
+
+    if (h2->preface_pos < H2_PREFACE_LEN) return;
+
+    set_cork(conn, 1);
+    while (progress && !h2->finished && h2->send_window > 0) {
+        progress = 0;
+        h2_stream_t *s = h2->streams;
+        while (s && !h2->finished && h2->send_window > 0) {
+            h2_stream_t *next = s->next;
+
+            if (conn->out_bytes >= STREAM_HIGH_WATERMARK) {
+                conn->stream.paused = 1;
+                break;
+            }
+
+            if (s->resp && s->send_window > 0) {
+                h2_send_data(h2, s);
+                progress = 1;
+                if (!stream_pending(s)) stream_remove(h2, s);
+            }
+            s = next;
+        }
+        if (conn->stream.paused) break;
+    }
+    set_cork(conn, 0);
+}
+
+static int skip_response_header(const char *name) {
+    static const char *hop_by_hop[] = {
+        "connection", "keep-alive", "proxy-connection", "transfer-encoding", "upgrade", NULL
+    };
+    for (int i = 0; hop_by_hop[i]; i++) {
+        if (strcmp(name, hop_by_hop[i]) == 0) return 1;
+    }
+    return 0;
+}
+
+static size_t encode_field(h2_conn_t *h2, size_t block_len, const char *name, size_t name_len,
+                           const char *value, size_t value_len) {
+    ssize_t n = hpack_encode(&h2->encoder, response_block + block_len, sizeof(response_block) - block_len,
+                             name, name_len, value, value_len);
+    if (n < 0) {
+        LOG("h2: response header %.*s does not fit", (int)name_len, name);
+        return 0;
+    }
+    return n;
+}
+
+static void h2_send_headers(h2_conn_t *h2, uint32_t id, size_t len, int end_stream) {
+    size_t n = len < h2->peer_max_frame ? len : h2->peer_max_frame;
+    int flags = (end_stream ? H2_FLAG_END_STREAM : 0) | (n == len ? H2_FLAG_END_HEADERS : 0);
+    h2_send_frame(h2, H2_HEADERS, flags, id, response_block, n);
+
+    for (size_t pos = n; pos < len; pos += n) {
+        n = len - pos < h2->peer_max_frame ? len - pos : h2->peer_max_frame;
+        h2_send_frame(h2, H2_CONTINUATION, pos + n == len ? H2_FLAG_END_HEADERS : 0, id, response_block + pos, n);
+    }
+}
+
+/*
+*   Converts the captured HTTP/1.1 response of a stream: the status line
+*   becomes :status, header names are lowercased and hop-by-hop headers
+*   dropped. The body is framed by h2_pump.
+*/
+static void h2_respond(h2_conn_t *h2, h2_stream_t *s, int head_only, char *data, size_t len,
+                       captured_file_t *files, int files_len) {
+    s->resp = data;
+    s->resp_len = len;
+    s->files = files;
+    s->files_len = files_len;
+
+    const char *head_end = data ? memmem(data, len, "\r\n\r\n", 4) : NULL;
+    int status = head_end && len > 12 && memcmp(data, "HTTP/1.", 7) == 0 ? atoi(data + 9) : 0;
+    if (status < 200 || status > 599) {
+        LOG("h2: stream %u has no valid response", s->id);
+        status = ERR_INTERR;
+        head_end = NULL;
+        head_only = 1;
+    }
+
+    ssize_t block_len = hpack_encode_begin(&h2->encoder, response_block, sizeof(response_block));
+    if (block_len < 0) block_len = 0;
+
+    char status_buf[4];
+    snprintf(status_buf, sizeof(status_buf), "%d", status);
+    block_len += encode_field(h2, block_len, ":status", 7, status_buf, 3);
+
+    if (head_end) {
+        const char *end = head_end + 2;
+        const char *line = (const char *)memchr(data, '\n', end - data) + 1;
+        while (line < end) {
+            const char *eol = memchr(line, '\n', end - line);
+            if (!eol) break;
+
+            const char *colon = memchr(line, ':', eol - line);
+            char name[128];
+            size_t name_len = colon ? (size_t)(colon - line) : 0;
+            if (name_len > 0 && name_len < sizeof(name)) {
+                for (size_t i = 0; i < name_len; i++) {
+                    name[i] = line[i] >= 'A' && line[i] <= 'Z' ? line[i] + 32 : line[i];
+                }
+                name[name_len] = '\0';
+
+                const char *value = colon + 1;
+                const char *value_end = eol > value && eol[-1] == '\r' ? eol - 1 : eol;
+                while (value < value_end && *value == ' ') value++;
+
+                if (!skip_response_header(name)) {
+                    block_len += encode_field(h2, block_len, name, name_len, value, value_end - value);
+                }
+            }
+            line = eol + 1;
+        }
+        s->resp_pos = head_end + 4 - data;
+    }
+
+    if (head_only) {
+        s->resp_pos = s->resp_len;
+        for (; s->file_index < s->files_len; s->file_index++) close(s->files[s->file_index].fd);
+    }
+
+    int end_stream = !stream_pending(s);
+    h2_send_headers(h2, s->id, block_len, end_stream);
+    if (end_stream) stream_remove(h2, s);
+}
+
+/*
+*   Runs a complete request through the regular dispatcher with its
+*   output captured, then answers the stream with it.
+*/
+static void h2_run(h2_conn_t *h2, h2_stream_t *s, http_req_t *req) {
+    response_capture_begin(H2_STREAM_FD);
+    response_capture_keep_files();
+
+    if (s->bad_request) {
+        send_error_response(H2_STREAM_FD, ERR_BADREQ);
+    } else {
+        LOG("request: %s %s (h2 stream %u)", req->method, req->path, s->id);
+        dispatch_request(H2_STREAM_FD, req);
+    }
+
+    size_t len;
+    captured_file_t *files;
+    int files_len;
+    char *data = response_capture_end_files(&len, &files, &files_len);
+
+    int head_only = req->method && strcmp(req->method, "HEAD") == 0;
+    if (req == &s->req) {
+        http_req_free(req);
+        memset(req, 0, sizeof(http_req_t));
+    }
+
+    h2_respond(h2, s, head_only, data, len, files, files_len);
+}
+
+static void h2_dispatch(h2_conn_t *h2, h2_stream_t *s) {
+    s->remote_closed = 1;
+    s->req.body = s->body;
+    s->body = NULL;
+    h2_run(h2, s, &s->req);
+}
+
+typedef struct {
+    h2_stream_t *stream;
+    char *path;
+    char *authority;
+    int regular;
+    int malformed;
+} header_ctx_t;
+
+static int h2_on_header(void *ctx, char *name, size_t name_len, char *value, size_t value_len) {
+    header_ctx_t *h = ctx;
+    http_req_t *req = h->stream ? &h->stream->req : NULL;
+    (void)name_len;
+    (void)value_len;
+
+    if (!req) goto discard;
+
+    if (name[0] == ':') {
+        if (h->regular) {
+            h->malformed = 1;
+        } else if (strcmp(name, ":method") == 0 && !req->method) {
+            req->method = value;
+            free(name);
+            return 0;
+        } else if (strcmp(name, ":path") == 0 && !h->path) {
+            h->path = value;
+            free(name);
+            return 0;
+        } else if (strcmp(name, ":authority") == 0 && !h->authority) {
+            h->authority = value;
+            free(name);
+            return 0;
+        } else if (strcmp(name, ":scheme") != 0) {
+            h->malformed = 1;
+        }
+        goto discard;
+    }
+
+    h->regular = 1;
+    if (req->headers_len < MAX_HEADER_COUNT && validate_header(name, value)) {
+        req->headers[req->headers_len].name = name;
+        req->headers[req->headers_len].value = value;
+        req->headers_len++;
+        return 0;
+    }
+
+discard:
+    free(name);
+    free(value);
+    return 0;
+}
+
+/*
+*   Fills in the parts of the request HTTP/1.1 takes from the request
+*   line. :authority stands in for a missing Host header.
+*/
+static int stream_build_request(h2_stream_t *s, header_ctx_t *h) {
+    http_req_t *req = &s->req;
+
+    if (h->malformed || !req->method || !h->path) {
+        free(h->path);
+        free(h->authority);
+        return -1;
+    }
+
+    if (!validate_http_method(req->method)) s->bad_request = 1;
+
+    req->version = strdup("HTTP/2.0");
+
+    char *query = strchr(h->path, '?');
+    if (query) {
+        *query++ = '\0';
+        req->query = strdup(query);
+    }
+    req->path = sanitize_path(h->path);
+    free(h->path);
+    if (!req->path) s->bad_request = 1;
+
+    if (h->authority && !get_header(req, "Host") && req->headers_len < MAX_HEADER_COUNT) {
+        req->headers[req->headers_len].name = strdup("Host");
+        req->headers[req->headers_len].value = h->authority;
+        req->headers_len++;
+    } else {
+        free(h->authority);
+    }
+
+    return req->version ? 0 : -1;
+}
+
+static void h2_headers_done(h2_conn_t *h2, const unsigned char *block, size_t len) {
+    h2_stream_t *s = stream_find(h2, h2->block_id);
+    header_ctx_t ctx = {h2->block_new ? s : NULL, NULL, NULL, 0, 0};
+
+    /* refused streams and trailers are decoded too, the table must stay in sync */
+    if (hpack_decode(&h2->decoder, block, len, h2_on_header, &ctx) != 0) {
+        free(ctx.path);
+        free(ctx.authority);
+        h2_goaway(h2, H2_COMPRESSION_ERROR);
+        return;
+    }
+
+    if (!h2->block_new) {
+        h2_dispatch(h2, s);
+        return;
+    }
+
+    if (!s) {
+        h2_rst_stream(h2, h2->block_id, H2_REFUSED_STREAM);
+        return;
+    }
+
+    if (stream_build_request(s, &ctx) != 0) {
+        h2_rst_stream(h2, s->id, H2_PROTOCOL_ERROR);
+        stream_remove(h2, s);
+        return;
+    }
+
+    if (h2->block_end_stream) h2_dispatch(h2, s);
+}
+
+static int strip_padding(int flags, const unsigned char **payload, size_t *len) {
+    if (!(flags & H2_FLAG_PADDED)) return 0;
+    if (*len < 1 || (*payload)[0] >= *len) return -1;
+
+    *len -= 1 + (*payload)[0];
+    *payload += 1;
+    return 0;
+}
+
+static void h2_on_headers(h2_conn_t *h2, int flags, uint32_t id, const unsigned char *payload, size_t len) {
+    if (id == 0 || !(id & 1) || strip_padding(flags, &payload, &len) != 0) {
+        h2_goaway(h2, H2_PROTOCOL_ERROR);
+        return;
+    }
+    if (flags & H2_FLAG_PRIORITY) {
+        if (len < 5) {
+            h2_goaway(h2, H2_FRAME_SIZE_ERROR);
+            return;
+        }
+        payload += 5;
+        len -= 5;
+    }
+
+    h2_stream_t *s = stream_find(h2, id);
+    if (id > h2->last_stream_id) {
+        h2->last_stream_id = id;
+        h2->block_new = 1;
+        if (h2->streams_len < H2_MAX_STREAMS) stream_create(h2, id);
+    } else if (s && !s->remote_closed && (flags & H2_FLAG_END_STREAM)) {
+        h2->block_new = 0;
+    } else {
+        h2_goaway(h2, s ? H2_PROTOCOL_ERROR : H2_STREAM_CLOSED);
+        return;
+    }
+
+    h2->block_id = id;
+    h2->block_end_stream = flags & H2_FLAG_END_STREAM;
+
+    if (flags & H2_FLAG_END_HEADERS) {
+        h2_headers_done(h2, payload, len);
+        return;
+    }
+
+    h2->continuation_id = id;
+    h2->header_block_len = 0;
+    if (h2->header_block_cap < len) {
+        unsigned char *block = realloc(h2->header_block, H2_MAX_HEADER_BLOCK);
+        if (!block) {
+            h2_goaway(h2, H2_ENHANCE_YOUR_CALM);
+            return;
+        }
+        h2->header_block = block;
+        h2->header_block_cap = H2_MAX_HEADER_BLOCK;
+    }
+    memcpy(h2->header_block, payload, len);
+    h2->header_block_len = len;
+}
+
+static void h2_on_continuation(h2_conn_t *h2, int flags, const unsigned char *payload, size_t len) {
+    if (h2->header_block_len + len > h2->header_block_cap) {
+        h2_goaway(h2, H2_ENHANCE_YOUR_CALM);
+        return;
+    }
+    memcpy(h2->header_block + h2->header_block_len, payload, len);
+    h2->header_block_len += len;
+
+    if (flags & H2_FLAG_END_HEADERS) {
+        h2->continuation_id = 0;
+        h2_headers_done(h2, h2->header_block, h2->header_block_len);
+        h2->header_block_len = 0;
+    }
+}
+
+/*
+*   Request bodies are acknowledged as they arrive, so the client is only
+*   limited by MAX_REQUEST_SIZE.
+*/
+static void h2_on_data(h2_conn_t *h2, int flags, uint32_t id, const unsigned char *payload, size_t len) {
+    size_t flow = len;
+    if (id == 0 || strip_padding(flags, &payload, &len) != 0) {
+        h2_goaway(h2, H2_PROTOCOL_ERROR);
+        return;
+    }
+    if (flow) h2_window_update(h2, 0, flow);
+
+    h2_stream_t *s = stream_find(h2, id);
+    if (!s || s->remote_closed) {
+        if (id > h2->last_stream_id) h2_goaway(h2, H2_PROTOCOL_ERROR);
+        else h2_rst_stream(h2, id, H2_STREAM_CLOSED);
+        return;
+    }
+
+    if (!s->bad_request && s->body_len + len > MAX_REQUEST_SIZE) {
+        s->bad_request = 1;
+        free(s->body);
+        s->body = NULL;
+        s->body_len = 0;
+    }
+    if (!s->bad_request && len > 0) {
+        char *body = realloc(s->body, s->body_len + len + 1);
+        if (!body) {
+            s->bad_request = 1;
+        } else {
+            memcpy(body + s->body_len, payload, len);
+            s->body_len += len;
+            body[s->body_len] = '\0';
+            s->body = body;
+        }
+    }
+
+    if (flags & H2_FLAG_END_STREAM) {
+        h2_dispatch(h2, s);
+    } else if (flow) {
+        h2_window_update(h2, id, flow);
+    }
+}
+
+static uint32_t h2_apply_settings(h2_conn_t *h2, const unsigned char *p, size_t len) {
+    for (size_t i = 0; i + 6 <= len; i += 6) {
+        int key = p[i] << 8 | p[i + 1];
+        uint32_t value = read_u32(p + i + 2);
+
+        switch (key) {
+            case SETTINGS_HEADER_TABLE_SIZE:
+                hpack_encoder_set_max(&h2->encoder, value);
+                break;
+            case SETTINGS_ENABLE_PUSH:
+                if (value > 1) return H2_PROTOCOL_ERROR;
+                break;
+            case SETTINGS_INITIAL_WINDOW_SIZE: {
+                if (value > H2_MAX_WINDOW) return H2_FLOW_CONTROL_ERROR;
+                int64_t delta = (int64_t)value - h2->peer_initial_window;
+                for (h2_stream_t *s = h2->streams; s; s = s->next) {
+                    s->send_window += delta;
+                    if (s->send_window > H2_MAX_WINDOW) return H2_FLOW_CONTROL_ERROR;
+                }
+                h2->peer_initial_window = value;
+                break;
+            }
+            case SETTINGS_MAX_FRAME_SIZE:
+                if (value < H2_MAX_FRAME || value > 0xFFFFFF) return H2_PROTOCOL_ERROR;
+                h2->peer_max_frame = value;
+                break;
+            default:
+                break;
+        }
+    }
+    return H2_NO_ERROR;
+}
+
+static void h2_on_settings(h2_conn_t *h2, int flags, uint32_t id, const unsigned char *payload, size_t len) {
+    if (id != 0) {
+        h2_goaway(h2, H2_PROTOCOL_ERROR);
+        return;
+    }
+    if (flags & H2_FLAG_ACK) {
+        if (len != 0) h2_goaway(h2, H2_FRAME_SIZE_ERROR);
+        return;
+    }
+    if (len % 6 != 0) {
+        h2_goaway(h2, H2_FRAME_SIZE_ERROR);
+        return;
+    }
+
+    uint32_t code = h2_apply_settings(h2, payload, len);
+    if (code != H2_NO_ERROR) {
+        h2_goaway(h2, code);
+        return;
+    }
+    h2_send_frame(h2, H2_SETTINGS, H2_FLAG_ACK, 0, NULL, 0);
+}
+
+static void h2_on_window_update(h2_conn_t *h2, uint32_t id, const unsigned char *payload, size_t len) {
+    if (len != 4) {
+        h2_goaway(h2, H2_FRAME_SIZE_ERROR);
+        return;
+    }
+
+    uint32_t increment = read_u32(payload) & H2_MAX_WINDOW;
+    if (id == 0) {
+        h2->send_window += increment;
+        if (increment == 0) h2_goaway(h2, H2_PROTOCOL_ERROR);
+        else if (h2->send_window > H2_MAX_WINDOW) h2_goaway(h2, H2_FLOW_CONTROL_ERROR);
+        return;
+    }
+
+    h2_stream_t *s = stream_find(h2, id);
+    if (!s) return;
+
+    s->send_window += increment;
+    if (increment == 0 || s->send_window > H2_MAX_WINDOW) {
+        h2_rst_stream(h2, id, increment ? H2_FLOW_CONTROL_ERROR : H2_PROTOCOL_ERROR);
+        stream_remove(h2, s);
+    }
+}
+
+static void h2_frame(h2_conn_t *h2, int type, int flags, uint32_t id, const unsigned char *payload, size_t len) {
+    if (h2->continuation_id && (type != H2_CONTINUATION || id != h2->continuation_id)) {
+        h2_goaway(h2, H2_PROTOCOL_ERROR);
+        return;
+    }
+
+    switch (type) {
+        case H2_DATA:
+            h2_on_data(h2, flags, id, payload, len);
+            break;
+        case H2_HEADERS:
+            h2_on_headers(h2, flags, id, payload, len);
+            break;
+        case H2_PRIORITY:
+            if (id == 0) h2_goaway(h2, H2_PROTOCOL_ERROR);
+            else if (len != 5) h2_rst_stream(h2, id, H2_FRAME_SIZE_ERROR);
+            break;
+        case H2_RST_STREAM:
+            if (id == 0 || id > h2->last_stream_id) {
+                h2_goaway(h2, H2_PROTOCOL_ERROR);
+            } else if (len != 4) {
+                h2_goaway(h2, H2_FRAME_SIZE_ERROR);
+            } else {
+                h2_stream_t *s = stream_find(h2, id);
+                if (s) stream_remove(h2, s);
+            }
+            break;
+        case H2_SETTINGS:
+            h2_on_settings(h2, flags, id, payload, len);
+            break;
+        case H2_PING:
+            if (id != 0) h2_goaway(h2, H2_PROTOCOL_ERROR);
+            else if (len != 8) h2_goaway(h2, H2_FRAME_SIZE_ERROR);
+            else if (!(flags & H2_FLAG_ACK)) h2_send_frame(h2, H2_PING, H2_FLAG_ACK, 0, payload, len);
+            break;
+        case H2_GOAWAY:
+            if (id != 0) h2_goaway(h2, H2_PROTOCOL_ERROR);
+            else h2->goaway_received = 1;
+            break;
+        case H2_WINDOW_UPDATE:
+            h2_on_window_update(h2, id, payload, len);
+            break;
+        case H2_CONTINUATION:
+            if (!h2->continuation_id) h2_goaway(h2, H2_PROTOCOL_ERROR);
+            else h2_on_continuation(h2, flags, payload, len);
+            break;
+        case H2_PUSH_PROMISE:
+            h2_goaway(h2, H2_PROTOCOL_ERROR);
+            break;
+        default:
+            /* unknown frame types are ignored */
+            break;
+    }
+}
+
+/*
+*   Handles every complete frame in the input buffer and keeps the
+*   partial one at its start.
+*/
+static void h2_process(h2_conn_t *h2) {
+    size_t pos = 0;
+
+    if (h2->preface_pos < H2_PREFACE_LEN) {
+        size_t n = H2_PREFACE_LEN - h2->preface_pos;
+        if (n > h2->in_len) n = h2->in_len;
+        if (memcmp(h2->in, H2_PREFACE + h2->preface_pos, n) != 0) {
+            h2_goaway(h2, H2_PROTOCOL_ERROR);
+            return;
+        }
+        h2->preface_pos += n;
+        pos = n;
+    }
+
+    while (!h2->finished && h2->in_len - pos >= H2_FRAME_HEADER) {
+        const unsigned char *f = h2->in + pos;
+        size_t len = (size_t)f[0] << 16 | f[1] << 8 | f[2];
+        if (len > H2_MAX_FRAME) {
+            h2_goaway(h2, H2_FRAME_SIZE_ERROR);
+            break;
+        }
+        if (h2->in_len - pos < H2_FRAME_HEADER + len) break;
+
+        h2_frame(h2, f[3], f[4], read_u32(f + 5) & H2_MAX_WINDOW, f + H2_FRAME_HEADER, len);
+        pos += H2_FRAME_HEADER + len;
+    }
+
+    h2->in_len -= pos;
+    memmove(h2->in, h2->in + pos, h2->in_len);
+}
+
+static void h2_release(h2_conn_t *h2) {
+    h2->conn->h2 = NULL;
+
+    while (h2->streams) {
+        h2_stream_t *next = h2->streams->next;
+        stream_free(h2->streams);
+        h2->streams = next;
+    }
+    hpack_table_free(&h2->decoder.table);
+    hpack_table_free(&h2->encoder.table);
+    free(h2->header_block);
+    free(h2);
+}
+
+static void h2_closed(stream_t *stream, void *ctx) {
+    (void)stream;
+    h2_release(ctx);
+}
+
+/*
+*   Ends the session: the connection stops reading and closes once its
+*   queue is written.
+*/
+static void h2_finish(h2_conn_t *h2) {
+    client_con_t *conn = h2->conn;
+    h2_release(h2);
+    conn->stream.active = 0;
+    conn_finish(conn);
+}
+
+/*
+*   Writes what the windows allow and ends the session after a
+*   connection error or once a client that sent GOAWAY has its answers.
+*/
+static void h2_settle(h2_conn_t *h2) {
+    h2_pump(h2);
+    if (h2->goaway_received && !h2->streams) h2->finished = 1;
+    if (h2->finished) h2_finish(h2);
+}
+
+static void h2_drained(stream_t *stream, void *ctx) {
+    (void)stream;
+    h2_settle(ctx);
+}
+
+static h2_conn_t *h2_create(client_con_t *conn) {
+    h2_conn_t *h2 = malloc(sizeof(h2_conn_t));
+    if (!h2) return NULL;
+
+    memset(h2, 0, offsetof(h2_conn_t, in));
+    h2->conn = conn;
+    h2->send_window = H2_DEFAULT_WINDOW;
+    h2->peer_initial_window = H2_DEFAULT_WINDOW;
+    h2->peer_max_frame = H2_MAX_FRAME;
+    hpack_decoder_init(&h2->decoder);
+    hpack_encoder_init(&h2->encoder);
+    return h2;
+}
+
+static void h2_attach(h2_conn_t *h2) {
+    client_con_t *conn = h2->conn;
+    conn->h2 = h2;
+
+    stream_t *stream = &conn->stream;
+    stream->active = 1;
+    stream->paused = 0;
+    stream->on_drain = h2_drained;
+    stream->on_close = h2_closed;
+    stream->ctx = h2;
+
+    /* many small frames are interleaved, none of them should wait for an ACK */
+    int on = 1;
+    setsockopt(conn->fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+
+    h2_send_settings(h2);
+}
+
+int h2_is_preface(const char *data, size_t len) {
+    size_t n = len < H2_PREFACE_LEN ? len : H2_PREFACE_LEN;
+    return len >= 4 && memcmp(data, H2_PREFACE, n) == 0;
+}
+
+/*
+*   Switches a connection whose first bytes are the client preface
+*   ("prior knowledge") to HTTP/2. data is everything read so far.
+*/
+int h2_start(client_con_t *conn, const char *data, size_t len) {
+    h2_conn_t *h2 = h2_create(conn);
+    if (!h2) {
+        conn_close(conn);
+        return -1;
+    }
+    h2_attach(h2);
+
+    while (len > 0 && !h2->finished) {
+        size_t n = sizeof(h2->in) - h2->in_len;
+        if (n > len) n = len;
+        memcpy(h2->in + h2->in_len, data, n);
+        h2->in_len += n;
+        data += n;
+        len -= n;
+        h2_process(h2);
+    }
+
+    h2_settle(h2);
+    return 0;
+}
+
+void h2_readable(client_con_t *conn) {
+    h2_conn_t *h2 = conn->h2;
+
+    ssize_t n = recv(conn->fd, h2->in + h2->in_len, sizeof(h2->in) - h2->in_len, 0);
+    if (n < 0) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) return;
+        conn_close(conn);
+        return;
+    }
+    if (n == 0) {
+        conn_close(conn);
+        return;
+    }
+    h2->in_len += n;
+    conn->last_activity = clock_now();
+
+    h2_process(h2);
+    h2_settle(h2);
+}
+
+static ssize_t base64url_decode(const char *src, unsigned char *dst, size_t cap) {
+    uint32_t acc = 0;
+    int bits = 0;
+    size_t n = 0;
+
+    for (; *src && *src != '='; src++) {
+        char c = *src;
+        int v;
+        if (c >= 'A' && c <= 'Z') v = c - 'A';
+        else if (c >= 'a' && c <= 'z') v = c - 'a' + 26;
+        else if (c >= '0' && c <= '9') v = c - '0' + 52;
+        else if (c == '-' || c == '+') v = 62;
+        else if (c == '_' || c == '/') v = 63;
+        else return -1;
+
+        acc = (acc << 6 | v) & 0xFFFFFF;
+        bits += 6;
+        if (bits >= 8) {
+            bits -= 8;
+            if (n == cap) return -1;
+            dst[n++] = acc >> bits;
+        }
+    }
+    return n;
+}
+
+/*
+*   Answers an HTTP/1.1 request carrying "Upgrade: h2c" with 101 and
+*   serves it as stream 1 of the new HTTP/2 connection; the client then
+*   sends its preface. Returns -1 without sending anything if req is not
+*   an h2c upgrade, so it is served as HTTP/1.1.
+*/
+int h2_upgrade(client_con_t *conn, http_req_t *req) {
+    const char *upgrade = get_header(req, "Upgrade");
+    const char *connection = get_header(req, "Connection");
+    const char *settings = get_header(req, "HTTP2-Settings");
+
+    if (conn->stream.active || !upgrade || !header_has_token(upgrade, "h2c") ||
+        !connection || !header_has_token(connection, "upgrade") ||
+        !header_has_token(connection, "http2-settings") || !settings) {
+        return -1;
+    }
+
+    unsigned char payload[256];
+    ssize_t payload_len = base64url_decode(settings, payload, sizeof(payload));
+    if (payload_len < 0 || payload_len % 6 != 0) return -1;
+
+    h2_conn_t *h2 = h2_create(conn);
+    if (!h2) return -1;
+
+    h2_stream_t *s = NULL;
+    if (h2_apply_settings(h2, payload, payload_len) != H2_NO_ERROR || !(s = stream_create(h2, 1))) {
+        h2_release(h2);
+        return -1;
+    }
+
+    response_t resp;
+    resp_init(&resp, INFO_SWITCHING);
+    resp_header(&resp, "Connection", "Upgrade");
+    resp_header(&resp, "Upgrade", "h2c");
+    if (resp_send_head(conn->fd, &resp) != SERVER_OK) {
+        h2_release(h2);
+        return 0;
+    }
+
+    h2_attach(h2);
+    h2->last_stream_id = 1;
+    s->remote_closed = 1;
+    h2_run(h2, s, req);
+
+    h2_settle(h2);
+    return 0;
+}
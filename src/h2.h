@@ -0,0 +1,87 @@
+#ifndef H2_H
+#define H2_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "hpack.h"
+#include "server.h"
+
+#define H2_PREFACE "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n"
+#define H2_PREFACE_LEN 24
+#define H2_FRAME_HEADER 9
+#define H2_MAX_FRAME 16384
+#define H2_INPUT_BUFFER (2 * (H2_MAX_FRAME + H2_FRAME_HEADER))
+#define H2_MAX_STREAMS 100
+#define H2_MAX_HEADER_BLOCK (64 * 1024)
+#define H2_DEFAULT_WINDOW 65535
+
+/*
+*   Handlers of an HTTP/2 request write to this pseudo fd. Their output is
+*   captured and converted into HEADERS and DATA frames, so the same
+*   handlers serve both protocols. Chunked responses, SSE and WebSockets
+*   need a connection of their own and stay HTTP/1.1 only.
+*/
+#define H2_STREAM_FD -2
+
+/*
+*   A stream from its HEADERS frame until the last byte of its response
+*   body is framed. The response is the captured HTTP/1.1 output: bytes
+*   from resp_pos up to resp_len, with file ranges spliced in at their
+*   positions.
+*/
+typedef struct h2_stream {
+    uint32_t id;
+    int64_t send_window;
+    int remote_closed;
+    int bad_request;
+    http_req_t req;
+    char *body;
+    size_t body_len;
+    char *resp;
+    size_t resp_pos;
+    size_t resp_len;
+    captured_file_t *files;
+    int files_len;
+    int file_index;
+    size_t file_sent;
+    struct h2_stream *next;
+} h2_stream_t;
+
+/*
+*   Per-connection state, allocated when the connection switches to
+*   HTTP/2. Frames are parsed from in, which always has room for one
+*   frame of the largest size we accept. Header blocks split over
+*   CONTINUATION frames are assembled in header_block.
+*/
+typedef struct h2_conn {
+    client_con_t *conn;
+    size_t preface_pos;
+    uint32_t last_stream_id;
+    int64_t send_window;
+    uint32_t peer_initial_window;
+    uint32_t peer_max_frame;
+    uint32_t continuation_id;
+    uint32_t block_id;
+    int block_new;
+    int block_end_stream;
+    unsigned char *header_block;
+    size_t header_block_len;
+    size_t header_block_cap;
+    hpack_decoder_t decoder;
+    hpack_encoder_t encoder;
+    h2_stream_t *streams;
+    h2_stream_t *streams_tail;
+    int streams_len;
+    int finished;
+    int goaway_received;
+    size_t in_len;
+    unsigned char in[H2_INPUT_BUFFER];
+} h2_conn_t;
+
+int h2_is_preface(const char *data, size_t len);
+int h2_start(client_con_t *conn, const char *data, size_t len);
+int h2_upgrade(client_con_t *conn, http_req_t *req);
+void h2_readable(client_con_t *conn);
+
+#endif
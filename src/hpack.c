@@ -0,0 +1,540 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "hpack.h"
+
+static const hpack_static_entry_t static_table[HPACK_STATIC_ENTRIES] = {
+    {":authority", 10, "", 0},
+    {":method", 7, "GET", 3},
+    {":method", 7, "POST", 4},
+    {":path", 5, "/", 1},
+    {":path", 5, "/index.html", 11},
+    {":scheme", 7, "http", 4},
+    {":scheme", 7, "https", 5},
+    {":status", 7, "200", 3},
+    {":status", 7, "204", 3},
+    {":status", 7, "206", 3},
+    {":status", 7, "304", 3},
+    {":status", 7, "400", 3},
+    {":status", 7, "404", 3},
+    {":status", 7, "500", 3},
+    {"accept-charset", 14, "", 0},
+    {"accept-encoding", 15, "gzip, deflate", 13},
+    {"accept-language", 15, "", 0},
+    {"accept-ranges", 13, "", 0},
+    {"accept", 6, "", 0},
+    {"access-control-allow-origin", 27, "", 0},
+    {"age", 3, "", 0},
+    {"allow", 5, "", 0},
+    {"authorization", 13, "", 0},
+    {"cache-control", 13, "", 0},
+    {"content-disposition", 19, "", 0},
+    {"content-encoding", 16, "", 0},
+    {"content-language", 16, "", 0},
+    {"content-length", 14, "", 0},
+    {"content-location", 16, "", 0},
+    {"content-range", 13, "", 0},
+    {"content-type", 12, "", 0},
+    {"cookie", 6, "", 0},
+    {"date", 4, "", 0},
+    {"etag", 4, "", 0},
+    {"expect", 6, "", 0},
+    {"expires", 7, "", 0},
+    {"from", 4, "", 0},
+    {"host", 4, "", 0},
+    {"if-match", 8, "", 0},
+    {"if-modified-since", 17, "", 0},
+    {"if-none-match", 13, "", 0},
+    {"if-range", 8, "", 0},
+    {"if-unmodified-since", 19, "", 0},
+    {"last-modified", 13, "", 0},
+    {"link", 4, "", 0},
+    {"location", 8, "", 0},
+    {"max-forwards", 12, "", 0},
+    {"proxy-authenticate", 18, "", 0},
+    {"proxy-authorization", 19, "", 0},
+    {"range", 5, "", 0},
+    {"referer", 7, "", 0},
+    {"refresh", 7, "", 0},
+    {"retry-after", 11, "", 0},
+    {"server", 6, "", 0},
+    {"set-cookie", 10, "", 0},
+    {"strict-transport-security", 25, "", 0},
+    {"transfer-encoding", 17, "", 0},
+    {"user-agent", 10, "", 0},
+    {"vary", 4, "", 0},
+    {"via", 3, "", 0},
+    {"www-authenticate", 16, "", 0},
+};
+
+/*
+*   RFC 7541 Appendix B, indexed by symbol: code and length in bits.
+*/
+static const uint32_t huffman_codes[256] = {
+    0x1ff8, 0x7fffd8, 0xfffffe2, 0xfffffe3, 0xfffffe4, 0xfffffe5, 0xfffffe6, 0xfffffe7,
+    0xfffffe8, 0xffffea, 0x3ffffffc, 0xfffffe9, 0xfffffea, 0x3ffffffd, 0xfffffeb, 0xfffffec,
+    0xfffffed, 0xfffffee, 0xfffffef, 0xffffff0, 0xffffff1, 0xffffff2, 0x3ffffffe, 0xffffff3,
+    0xffffff4, 0xffffff5, 0xffffff6, 0xffffff7, 0xffffff8, 0xffffff9, 0xffffffa, 0xffffffb,
+    0x14, 0x3f8, 0x3f9, 0xffa, 0x1ff9, 0x15, 0xf8, 0x7fa,
+    0x3fa, 0x3fb, 0xf9, 0x7fb, 0xfa, 0x16, 0x17, 0x18,
+    0x0, 0x1, 0x2, 0x19, 0x1a, 0x1b, 0x1c, 0x1d,
+    0x1e, 0x1f, 0x5c, 0xfb, 0x7ffc, 0x20, 0xffb, 0x3fc,
+    0x1ffa, 0x21, 0x5d, 0x5e, 0x5f, 0x60, 0x61, 0x62,
+    0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69, 0x6a,
+    0x6b, 0x6c, 0x6d, 0x6e, 0x6f, 0x70, 0x71, 0x72,
+    0xfc, 0x73, 0xfd, 0x1ffb, 0x7fff0, 0x1ffc, 0x3ffc, 0x22,
+    0x7ffd, 0x3, 0x23, 0x4, 0x24, 0x5, 0x25, 0x26,
+    0x27, 0x6, 0x74, 0x75, 0x28, 0x29, 0x2a, 0x7,
+    0x2b, 0x76, 0x2c, 0x8, 0x9, 0x2d, 0x77, 0x78,
+    0x79, 0x7a, 0x7b, 0x7ffe, 0x7fc, 0x3ffd, 0x1ffd, 0xffffffc,
+    0xfffe6, 0x3fffd2, 0xfffe7, 0xfffe8, 0x3fffd3, 0x3fffd4, 0x3fffd5, 0x7fffd9,
+    0x3fffd6, 0x7fffda, 0x7fffdb, 0x7fffdc, 0x7fffdd, 0x7fffde, 0xffffeb, 0x7fffdf,
+    0xffffec, 0xffffed, 0x3fffd7, 0x7fffe0, 0xffffee, 0x7fffe1, 0x7fffe2, 0x7fffe3,
+    0x7fffe4, 0x1fffdc, 0x3fffd8, 0x7fffe5, 0x3fffd9, 0x7fffe6, 0x7fffe7, 0xffffef,
+    0x3fffda, 0x1fffdd, 0xfffe9, 0x3fffdb, 0x3fffdc, 0x7fffe8, 0x7fffe9, 0x1fffde,
+    0x7fffea, 0x3fffdd, 0x3fffde, 0xfffff0, 0x1fffdf, 0x3fffdf, 0x7fffeb, 0x7fffec,
+    0x1fffe0, 0x1fffe1, 0x3fffe0, 0x1fffe2, 0x7fffed, 0x3fffe1, 0x7fffee, 0x7fffef,
+    0xfffea, 0x3fffe2, 0x3fffe3, 0x3fffe4, 0x7ffff0, 0x3fffe5, 0x3fffe6, 0x7ffff1,
+    0x3ffffe0, 0x3ffffe1, 0xfffeb, 0x7fff1, 0x3fffe7, 0x7ffff2, 0x3fffe8, 0x1ffffec,
+    0x3ffffe2, 0x3ffffe3, 0x3ffffe4, 0x7ffffde, 0x7ffffdf, 0x3ffffe5, 0xfffff1, 0x1ffffed,
+    0x7fff2, 0x1fffe3, 0x3ffffe6, 0x7ffffe0, 0x7ffffe1, 0x3ffffe7, 0x7ffffe2, 0xfffff2,
+    0x1fffe4, 0x1fffe5, 0x3ffffe8, 0x3ffffe9, 0xffffffd, 0x7ffffe3, 0x7ffffe4, 0x7ffffe5,
+    0xfffec, 0xfffff3, 0xfffed, 0x1fffe6, 0x3fffe9, 0x1fffe7, 0x1fffe8, 0x7ffff3,
+    0x3fffea, 0x3fffeb, 0x1ffffee, 0x1ffffef, 0xfffff4, 0xfffff5, 0x3ffffea, 0x7ffff4,
+    0x3ffffeb, 0x7ffffe6, 0x3ffffec, 0x3ffffed, 0x7ffffe7, 0x7ffffe8, 0x7ffffe9, 0x7ffffea,
+    0x7ffffeb, 0xffffffe, 0x7ffffec, 0x7ffffed, 0x7ffffee, 0x7ffffef, 0x7fffff0, 0x3ffffee,
+};
+
+static const uint8_t huffman_lengths[256] = {
+    13, 23, 28, 28, 28, 28, 28, 28, 28, 24, 30, 28, 28, 30, 28, 28,
+    28, 28, 28, 28, 28, 28, 30, 28, 28, 28, 28, 28, 28, 28, 28, 28,
+    6, 10, 10, 12, 13, 6, 8, 11, 10, 10, 8, 11, 8, 6, 6, 6,
+    5, 5, 5, 6, 6, 6, 6, 6, 6, 6, 7, 8, 15, 6, 12, 10,
+    13, 6, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
+    7, 7, 7, 7, 7, 7, 7, 7, 8, 7, 8, 13, 19, 13, 14, 6,
+    15, 5, 6, 5, 6, 5, 6, 6, 6, 5, 7, 7, 6, 6, 6, 5,
+    6, 7, 6, 5, 5, 6, 7, 7, 7, 7, 7, 15, 11, 14, 13, 28,
+    20, 22, 20, 20, 22, 22, 22, 23, 22, 23, 23, 23, 23, 23, 24, 23,
+    24, 24, 22, 23, 24, 23, 23, 23, 23, 21, 22, 23, 22, 23, 23, 24,
+    22, 21, 20, 22, 22, 23, 23, 21, 23, 22, 22, 24, 21, 22, 23, 23,
+    21, 21, 22, 21, 23, 22, 23, 23, 20, 22, 22, 22, 23, 22, 22, 23,
+    26, 26, 20, 19, 22, 23, 22, 25, 26, 26, 26, 27, 27, 26, 24, 25,
+    19, 21, 26, 27, 27, 26, 27, 24, 21, 21, 26, 26, 28, 27, 27, 27,
+    20, 24, 20, 21, 22, 21, 21, 23, 22, 22, 25, 25, 24, 24, 26, 23,
+    26, 27, 26, 26, 27, 27, 27, 27, 27, 28, 27, 27, 27, 27, 27, 26,
+};
+
+/*
+*   Huffman decoding tree, built on first use. Children >= 0 are node
+*   indexes, negative values are leaves holding -(symbol + 1), 0 marks a
+*   missing child (only the EOS path, which is an error to decode).
+*/
+#define HUFFMAN_NODES 512
+
+static int16_t huffman_tree[HUFFMAN_NODES][2];
+static int huffman_tree_len = 0;
+
+static void huffman_build(void) {
+    huffman_tree_len = 1;
+    for (int sym = 0; sym < 256; sym++) {
+        int node = 0;
+        for (int bit = huffman_lengths[sym] - 1; bit >= 0; bit--) {
+            int b = (huffman_codes[sym] >> bit) & 1;
+            if (bit == 0) {
+                huffman_tree[node][b] = -(sym + 1);
+            } else {
+                if (huffman_tree[node][b] == 0) huffman_tree[node][b] = huffman_tree_len++;
+                node = huffman_tree[node][b];
+            }
+        }
+    }
+}
+
+static char *huffman_decode(const unsigned char *src, size_t len, size_t *out_len) {
+    if (!huffman_tree_len) huffman_build();
+
+    /* the shortest code is 5 bits */
+    char *out = malloc(len * 8 / 5 + 1);
+    if (!out) return NULL;
+
+    size_t n = 0;
+    int node = 0;
+    int pad_bits = 0;
+    int pad_ones = 1;
+    for (size_t i = 0; i < len; i++) {
+        for (int bit = 7; bit >= 0; bit--) {
+            int b = (src[i] >> bit) & 1;
+            int next = huffman_tree[node][b];
+            pad_bits++;
+            pad_ones &= b;
+            if (next < 0) {
+                out[n++] = (char)(-next - 1);
+                node = 0;
+                pad_bits = 0;
+                pad_ones = 1;
+            } else if (next == 0) {
+                free(out);
+                return NULL;
+            } else {
+                node = next;
+            }
+        }
+    }
+
+    /* padding must be a prefix of EOS (all ones) and shorter than a byte */
+    if (pad_bits > 7 || !pad_ones) {
+        free(out);
+        return NULL;
+    }
+
+    out[n] = '\0';
+    *out_len = n;
+    return out;
+}
+
+static size_t huffman_length(const char *src, size_t len) {
+    size_t bits = 0;
+    for (size_t i = 0; i < len; i++) bits += huffman_lengths[(unsigned char)src[i]];
+    return (bits + 7) / 8;
+}
+
+static void huffman_encode(const char *src, size_t len, unsigned char *dst) {
+    uint64_t acc = 0;
+    int acc_bits = 0;
+    for (size_t i = 0; i < len; i++) {
+        unsigned char c = src[i];
+        acc = acc << huffman_lengths[c] | huffman_codes[c];
+        acc_bits += huffman_lengths[c];
+        while (acc_bits >= 8) {
+            acc_bits -= 8;
+            *dst++ = acc >> acc_bits;
+        }
+    }
+    if (acc_bits > 0) {
+        *dst = (acc << (8 - acc_bits)) | (0xFF >> acc_bits);
+    }
+}
+
+static void table_init(hpack_table_t *t, size_t max_size) {
+    memset(t, 0, sizeof(*t));
+    t->max_size = max_size;
+}
+
+static hpack_entry_t *table_get(hpack_table_t *t, size_t index) {
+    if (index == 0 || index > t->count) return NULL;
+    return &t->entries[(t->head + t->cap - (index - 1)) & (t->cap - 1)];
+}
+
+static void table_evict(hpack_table_t *t) {
+    hpack_entry_t *oldest = table_get(t, t->count);
+    t->size -= oldest->name_len + oldest->value_len + HPACK_ENTRY_OVERHEAD;
+    free(oldest->name);
+    t->count--;
+}
+
+static void table_set_max(hpack_table_t *t, size_t max_size) {
+    t->max_size = max_size;
+    while (t->size > t->max_size) table_evict(t);
+}
+
+/*
+*   An entry larger than the table empties it and is not added. Name and
+*   value share one allocation.
+*/
+static int table_add(hpack_table_t *t, const char *name, size_t name_len, const char *value, size_t value_len) {
+    size_t size = name_len + value_len + HPACK_ENTRY_OVERHEAD;
+    while (t->count > 0 && t->size + size > t->max_size) table_evict(t);
+    if (size > t->max_size) return 0;
+
+    if (t->count == t->cap) {
+        size_t cap = t->cap ? t->cap * 2 : 16;
+        hpack_entry_t *entries = malloc(cap * sizeof(*entries));
+        if (!entries) return -1;
+        for (size_t i = 0; i < t->count; i++) {
+            entries[t->count - 1 - i] = *table_get(t, i + 1);
+        }
+        free(t->entries);
+        t->entries = entries;
+        t->cap = cap;
+        t->head = t->count ? t->count - 1 : cap - 1;
+    }
+
+    char *copy = malloc(name_len + value_len + 2);
+    if (!copy) return -1;
+    memcpy(copy, name, name_len);
+    copy[name_len] = '\0';
+    memcpy(copy + name_len + 1, value, value_len);
+    copy[name_len + 1 + value_len] = '\0';
+
+    t->head = (t->head + 1) & (t->cap - 1);
+    t->entries[t->head] = (hpack_entry_t){copy, name_len, copy + name_len + 1, value_len};
+    t->count++;
+    t->size += size;
+    return 0;
+}
+
+void hpack_table_free(hpack_table_t *t) {
+    while (t->count > 0) table_evict(t);
+    free(t->entries);
+    t->entries = NULL;
+    t->cap = 0;
+}
+
+void hpack_decoder_init(hpack_decoder_t *d) {
+    table_init(&d->table, HPACK_DEFAULT_TABLE_SIZE);
+    d->settings_max = HPACK_DEFAULT_TABLE_SIZE;
+}
+
+void hpack_encoder_init(hpack_encoder_t *e) {
+    table_init(&e->table, HPACK_DEFAULT_TABLE_SIZE);
+    e->pending_update = 0;
+}
+
+/*
+*   Applies the peer's SETTINGS_HEADER_TABLE_SIZE. The change is announced
+*   at the start of the next header block.
+*/
+void hpack_encoder_set_max(hpack_encoder_t *e, size_t peer_max) {
+    size_t max = peer_max < HPACK_DEFAULT_TABLE_SIZE ? peer_max : HPACK_DEFAULT_TABLE_SIZE;
+    table_set_max(&e->table, max);
+    e->pending_update = 1;
+}
+
+static int decode_int(const unsigned char **p, const unsigned char *end, int prefix, uint64_t *out) {
+    if (*p >= end) return -1;
+
+    uint64_t max = (1u << prefix) - 1;
+    uint64_t value = **p & max;
+    (*p)++;
+    if (value < max) {
+        *out = value;
+        return 0;
+    }
+
+    for (int shift = 0; *p < end && shift <= 28; shift += 7) {
+        unsigned char b = *(*p)++;
+        value += (uint64_t)(b & 0x7F) << shift;
+        if (!(b & 0x80)) {
+            *out = value;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+static char *decode_string(const unsigned char **p, const unsigned char *end, size_t *out_len) {
+    if (*p >= end) return NULL;
+
+    int huffman = **p & 0x80;
+    uint64_t len;
+    if (decode_int(p, end, 7, &len) != 0 || len > (uint64_t)(end - *p)) return NULL;
+
+    const unsigned char *src = *p;
+    *p += len;
+
+    if (huffman) return huffman_decode(src, len, out_len);
+
+    char *out = malloc(len + 1);
+    if (!out) return NULL;
+    memcpy(out, src, len);
+    out[len] = '\0';
+    *out_len = len;
+    return out;
+}
+
+static int lookup(hpack_decoder_t *d, uint64_t index, const char **name, size_t *name_len,
+                  const char **value, size_t *value_len) {
+    if (index >= 1 && index <= HPACK_STATIC_ENTRIES) {
+        const hpack_static_entry_t *s = &static_table[index - 1];
+        *name = s->name;
+        *name_len = s->name_len;
+        *value = s->value;
+        *value_len = s->value_len;
+        return 0;
+    }
+
+    hpack_entry_t *e = table_get(&d->table, index - HPACK_STATIC_ENTRIES);
+    if (index <= HPACK_STATIC_ENTRIES || !e) return -1;
+    *name = e->name;
+    *name_len = e->name_len;
+    *value = e->value;
+    *value_len = e->value_len;
+    return 0;
+}
+
+static char *copy_string(const char *src, size_t len) {
+    char *out = malloc(len + 1);
+    if (!out) return NULL;
+    memcpy(out, src, len);
+    out[len] = '\0';
+    return out;
+}
+
+/*
+*   Decodes a complete header block. emit takes ownership of name and
+*   value. Returns -1 on a compression error, the connection must then be
+*   closed because the dynamic tables are out of sync.
+*/
+int hpack_decode(hpack_decoder_t *d, const unsigned char *src, size_t len, hpack_emit_t emit, void *ctx) {
+    const unsigned char *p = src;
+    const unsigned char *end = src + len;
+    int fields = 0;
+
+    while (p < end) {
+        unsigned char b = *p;
+        uint64_t index;
+        const char *sname, *svalue;
+        size_t sname_len, svalue_len;
+        char *name = NULL, *value = NULL;
+        size_t name_len = 0, value_len = 0;
+
+        if (b & 0x80) {
+            if (decode_int(&p, end, 7, &index) != 0 || index == 0) return -1;
+            if (lookup(d, index, &sname, &sname_len, &svalue, &svalue_len) != 0) return -1;
+            name = copy_string(sname, sname_len);
+            value = copy_string(svalue, svalue_len);
+            name_len = sname_len;
+            value_len = svalue_len;
+        } else if ((b & 0xE0) == 0x20) {
+            /* size updates are only allowed before the first field */
+            if (fields > 0 || decode_int(&p, end, 5, &index) != 0 || index > d->settings_max) return -1;
+            table_set_max(&d->table, index);
+            continue;
+        } else {
+            int incremental = (b & 0xC0) == 0x40;
+            if (decode_int(&p, end, incremental ? 6 : 4, &index) != 0) return -1;
+
+            if (index) {
+                if (lookup(d, index, &sname, &sname_len, &svalue, &svalue_len) != 0) return -1;
+                name = copy_string(sname, sname_len);
+                name_len = sname_len;
+            } else {
+                name = decode_string(&p, end, &name_len);
+            }
+            if (name) value = decode_string(&p, end, &value_len);
+
+            if (name && value && incremental &&
+                table_add(&d->table, name, name_len, value, value_len) != 0) {
+                free(name);
+                free(value);
+                return -1;
+            }
+        }
+
+        if (!name || !value) {
+            free(name);
+            free(value);
+            return -1;
+        }
+
+        fields++;
+        if (emit(ctx, name, name_len, value, value_len) != 0) return -1;
+    }
+
+    return 0;
+}
+
+static ssize_t encode_int(unsigned char *dst, size_t cap, unsigned char first, int prefix, uint64_t value) {
+    uint64_t max = (1u << prefix) - 1;
+    size_t n = 0;
+    if (cap == 0) return -1;
+
+    if (value < max) {
+        dst[n++] = first | value;
+        return n;
+    }
+
+    dst[n++] = first | max;
+    value -= max;
+    while (value >= 0x80) {
+        if (n >= cap) return -1;
+        dst[n++] = (value & 0x7F) | 0x80;
+        value >>= 7;
+    }
+    if (n >= cap) return -1;
+    dst[n++] = value;
+    return n;
+}
+
+static ssize_t encode_string(unsigned char *dst, size_t cap, const char *src, size_t len) {
+    size_t huffman_len = huffman_length(src, len);
+    int huffman = huffman_len < len;
+    size_t out_len = huffman ? huffman_len : len;
+
+    ssize_t n = encode_int(dst, cap, huffman ? 0x80 : 0, 7, out_len);
+    if (n < 0 || (size_t)n + out_len > cap) return -1;
+
+    if (huffman) huffman_encode(src, len, dst + n);
+    else memcpy(dst + n, src, len);
+    return n + out_len;
+}
+
+/*
+*   Emits the dynamic table size update owed after a settings change.
+*/
+ssize_t hpack_encode_begin(hpack_encoder_t *e, unsigned char *dst, size_t cap) {
+    if (!e->pending_update) return 0;
+    e->pending_update = 0;
+    return encode_int(dst, cap, 0x20, 5, e->table.max_size);
+}
+
+/*
+*   Values that differ on every response are never indexed, they would only
+*   push useful entries out of the table.
+*/
+static int worth_indexing(const char *name, size_t name_len) {
+    static const char *volatile_headers[] = {
+        "content-length", "date", "etag", "last-modified", "set-cookie", "location", "age", "expires", NULL
+    };
+    for (int i = 0; volatile_headers[i]; i++) {
+        if (strlen(volatile_headers[i]) == name_len && memcmp(volatile_headers[i], name, name_len) == 0) return 0;
+    }
+    return 1;
+}
+
+/*
+*   Encodes one field, name must be lowercase. Returns the bytes written or
+*   -1 if dst is too small.
+*/
+ssize_t hpack_encode(hpack_encoder_t *e, unsigned char *dst, size_t cap,
+                     const char *name, size_t name_len, const char *value, size_t value_len) {
+    size_t name_index = 0;
+
+    for (size_t i = 0; i < HPACK_STATIC_ENTRIES; i++) {
+        const hpack_static_entry_t *s = &static_table[i];
+        if (s->name_len != name_len || memcmp(s->name, name, name_len) != 0) continue;
+        if (s->value_len == value_len && memcmp(s->value, value, value_len) == 0) {
+            return encode_int(dst, cap, 0x80, 7, i + 1);
+        }
+        if (!name_index) name_index = i + 1;
+    }
+
+    for (size_t i = 1; i <= e->table.count; i++) {
+        hpack_entry_t *d = table_get(&e->table, i);
+        if (d->name_len != name_len || memcmp(d->name, name, name_len) != 0) continue;
+        if (d->value_len == value_len && memcmp(d->value, value, value_len) == 0) {
+            return encode_int(dst, cap, 0x80, 7, HPACK_STATIC_ENTRIES + i);
+        }
+        if (!name_index) name_index = HPACK_STATIC_ENTRIES + i;
+    }
+
+    int incremental = worth_indexing(name, name_len) &&
+                      name_len + value_len + HPACK_ENTRY_OVERHEAD <= e->table.max_size;
+
+    ssize_t n = incremental ? encode_int(dst, cap, 0x40, 6, name_index)
+                            : encode_int(dst, cap, 0x00, 4, name_index);
+    if (n < 0) return -1;
+
+    if (!name_index) {
+        ssize_t m = encode_string(dst + n, cap - n, name, name_len);
+        if (m < 0) return -1;
+        n += m;
+    }
+
+    ssize_t m = encode_string(dst + n, cap - n, value, value_len);
+    if (m < 0) return -1;
+    n += m;
+
+    if (incremental && table_add(&e->table, name, name_len, value, value_len) != 0) return -1;
+    return n;
+}
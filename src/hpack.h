@@ -0,0 +1,67 @@
+#ifndef HPACK_H
+#define HPACK_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#define HPACK_STATIC_ENTRIES 61
+#define HPACK_DEFAULT_TABLE_SIZE 4096
+#define HPACK_ENTRY_OVERHEAD 32
+
+/*
+*   HPACK (RFC 7541) header compression for HTTP/2. Both directions keep a
+*   dynamic table; the decoder's is bounded by the SETTINGS_HEADER_TABLE_SIZE
+*   we advertise (the default), the encoder's by the peer's setting capped
+*   at the same default.
+*/
+
+typedef struct {
+    const char *name;
+    size_t name_len;
+    const char *value;
+    size_t value_len;
+} hpack_static_entry_t;
+
+typedef struct {
+    char *name;
+    size_t name_len;
+    char *value;
+    size_t value_len;
+} hpack_entry_t;
+
+/*
+*   Ring buffer, newest entry at head. Dynamic index 1 is the newest.
+*/
+typedef struct {
+    hpack_entry_t *entries;
+    size_t cap;
+    size_t head;
+    size_t count;
+    size_t size;
+    size_t max_size;
+} hpack_table_t;
+
+typedef struct {
+    hpack_table_t table;
+    size_t settings_max;
+} hpack_decoder_t;
+
+typedef struct {
+    hpack_table_t table;
+    int pending_update;
+} hpack_encoder_t;
+
+typedef int (*hpack_emit_t)(void *ctx, char *name, size_t name_len, char *value, size_t value_len);
+
+void hpack_decoder_init(hpack_decoder_t *d);
+void hpack_encoder_init(hpack_encoder_t *e);
+void hpack_table_free(hpack_table_t *t);
+void hpack_encoder_set_max(hpack_encoder_t *e, size_t peer_max);
+
+int hpack_decode(hpack_decoder_t *d, const unsigned char *src, size_t len, hpack_emit_t emit, void *ctx);
+ssize_t hpack_encode_begin(hpack_encoder_t *e, unsigned char *dst, size_t cap);
+ssize_t hpack_encode(hpack_encoder_t *e, unsigned char *dst, size_t cap,
+                     const char *name, size_t name_len, const char *value, size_t value_len);
+
+#endif
@@ -22,118 +22,171 @@ int json_is_string(json_t *json){
     return 1;
 }
 
-json_t *json_create_null(){
-    json_t *json = calloc(1, sizeof(json_t));
-    if(!json) {
-        LOG("Malloc failed.");
-        return NULL;
-    };
-
-    json->type = JSON_NULL;
-
-    return json;
+void json_arena_init(json_arena_t *arena, void *buffer, size_t size){
+    arena->data = buffer;
+    arena->size = buffer ? size : 0;
+    arena->used = 0;
+    arena->blocks = NULL;
 }
 
-json_t *json_create_false(){
-    json_t *json = calloc(1, sizeof(json_t));
-    if(!json) {
-        LOG("Malloc failed.");
-        return NULL;
-    };
+void *json_arena_alloc(json_arena_t *arena, size_t size){
+    size = (size + 7) & ~(size_t)7;
 
-    json->type = JSON_FALSE;
+    if(arena->used + size > arena->size){
+        size_t cap = size > JSON_ARENA_BLOCK ? size : JSON_ARENA_BLOCK;
+        json_arena_block_t *block = malloc(sizeof(json_arena_block_t) + cap);
+        if(!block){
+            LOG("Malloc failed.");
+            return NULL;
+        }
+        block->next = arena->blocks;
+        arena->blocks = block;
+        arena->data = block->data;
+        arena->size = cap;
+        arena->used = 0;
+    }
 
-    return json;
+    void *ptr = arena->data + arena->used;
+    arena->used += size;
+    return ptr;
 }
 
-json_t *json_create_true(){
-    json_t *json = calloc(1, sizeof(json_t));
-    if(!json) {
-        LOG("Malloc failed.");
-        return NULL;
-    };
+void json_arena_free(json_arena_t *arena){
+    while(arena->blocks){
+        json_arena_block_t *next = arena->blocks->next;
+        free(arena->blocks);
+        arena->blocks = next;
+    }
+    arena->data = NULL;
+    arena->size = 0;
+    arena->used = 0;
+}
+
+/* from arena when there is one, from the heap otherwise */
+void *json_alloc(json_arena_t *arena, size_t size){
+    if(arena) return json_arena_alloc(arena, size);
 
+    void *ptr = malloc(size);
+    if(!ptr) LOG("Malloc failed.");
+    return ptr;
+}
 
-    json->type = JSON_TRUE;
+json_t *json_new(json_arena_t *arena, enum json_type_e type){
+    json_t *json = json_alloc(arena, sizeof(json_t));
+    if(!json) return NULL;
 
+    memset(json, 0, sizeof(json_t));
+    json->type = type;
+    json->flags = arena ? JSON_FLAG_ARENA : 0;
     return json;
 }
 
-json_t *json_create_string(const char *string){
-    json_t *json = calloc(1, sizeof(json_t));
-    if(!json) {
-        LOG("Malloc failed.");
-        return NULL;
-    };
-
+json_t *json_create_string_len_arena(json_arena_t *arena, const char *string, size_t len){
+    json_t *json = json_new(arena, JSON_STRING);
+    if(!json) return NULL;
 
-    json->type = JSON_STRING;
-    json->value.string = strdup(string);
+    if(len <= JSON_SHORT_STRING){
+        json->flags |= JSON_FLAG_SHORT;
+        memcpy(json->value.short_string, string, len);
+        json->value.short_string[len] = '\0';
+        return json;
+    }
 
+    json->value.string = json_alloc(arena, len + 1);
     if(!json->value.string){
-        free(json);
+        if(!arena) free(json);
         return NULL;
     }
+    memcpy(json->value.string, string, len);
+    json->value.string[len] = '\0';
 
     return json;
 }
 
-json_t *json_create_number(double number){
-    json_t *json = calloc(1, sizeof(json_t));
-    if(!json) {
-        LOG("Malloc failed.");
-        return NULL;
-    };
+json_t *json_create_null_arena(json_arena_t *arena){
+    return json_new(arena, JSON_NULL);
+}
 
+json_t *json_create_false_arena(json_arena_t *arena){
+    return json_new(arena, JSON_FALSE);
+}
+
+json_t *json_create_true_arena(json_arena_t *arena){
+    return json_new(arena, JSON_TRUE);
+}
+
+json_t *json_create_string_arena(json_arena_t *arena, const char *string){
+    return json_create_string_len_arena(arena, string, strlen(string));
+}
+
+json_t *json_create_number_arena(json_arena_t *arena, double number){
+    json_t *json = json_new(arena, JSON_NUMBER);
+    if(!json) return NULL;
 
-    json->type = JSON_NUMBER;
     json->value.number = number;
 
     return json;
 }
 
-json_t *json_create_object(){
-    json_t *json = calloc(1, sizeof(json_t));
-    if(!json) {
-        LOG("Malloc failed.");
-        return NULL;
-    };
-
+json_t *json_create_object_arena(json_arena_t *arena){
+    json_t *json = json_new(arena, JSON_OBJECT);
+    if(!json) return NULL;
 
-    json->type = JSON_OBJECT;
-    json->value.object.key = NULL;
-    json->value.object.value = NULL;
-    json->value.object.next = NULL;
+    json->value.object.arena = arena;
 
     return json;
 }
 
-json_t *json_create_array(size_t initial_capacity){
-    json_t *array = calloc(1, sizeof(json_t));
-    if(!array) {
-        LOG("Malloc failed.");
-        return NULL;
-    };
-
+json_t *json_create_array_arena(json_arena_t *arena, size_t initial_capacity){
+    json_t *array = json_new(arena, JSON_ARRAY);
+    if(!array) return NULL;
 
-    array->type = JSON_ARRAY;
     array->value.array.size = 0;
     array->value.array.capacity = initial_capacity > 0 ? initial_capacity : 16;
-    array->value.array.elements = calloc(array->value.array.capacity, sizeof(json_t*));
+    array->value.array.arena = arena;
+    array->value.array.elements = json_alloc(arena, array->value.array.capacity * sizeof(json_t*));
     if(!array->value.array.elements){
-        free(array);
+        if(!arena) free(array);
         return NULL;
     }
 
     return array;
 }
 
+json_t *json_create_null(){
+    return json_create_null_arena(NULL);
+}
+
+json_t *json_create_false(){
+    return json_create_false_arena(NULL);
+}
+
+json_t *json_create_true(){
+    return json_create_true_arena(NULL);
+}
+
+json_t *json_create_string(const char *string){
+    return json_create_string_arena(NULL, string);
+}
+
+json_t *json_create_number(double number){
+    return json_create_number_arena(NULL, number);
+}
+
+json_t *json_create_object(){
+    return json_create_object_arena(NULL);
+}
+
+json_t *json_create_array(size_t initial_capacity){
+    return json_create_array_arena(NULL, initial_capacity);
+}
+
 void json_free(json_t *json){
-    if(!json) return;
+    if(!json || (json->flags & JSON_FLAG_ARENA)) return;
 
     switch(json->type){
         case JSON_STRING: {
-            free(json->value.string);
+            if(!(json->flags & JSON_FLAG_SHORT)) free(json->value.string);
             break;
         }
 
@@ -146,14 +199,11 @@ void json_free(json_t *json){
         }
 
         case JSON_OBJECT: {
-            json_t *current = json->value.object.next;
-            while(current){
-                json_t *next = current->value.object.next;
-                free(current->value.object.key);
-                json_free(current->value.object.value);
-                free(current);
-                current = next;
+            for(uint32_t i = 0; i < json->value.object.size; ++i){
+                free(json->value.object.members[i].key);
+                json_free(json->value.object.members[i].value);
             }
+            free(json->value.object.members);
             break;
         }
         default:
@@ -167,8 +217,22 @@ int json_array_add(json_t *array, json_t *value){
     if(!json_is_array(array)) return -1;
 
     if(array->value.array.size >= array->value.array.capacity){
-        array->value.array.capacity *= 2;
-        array->value.array.elements = realloc(array->value.array.elements, array->value.array.capacity * sizeof(json_t*));
+        json_arena_t *arena = array->value.array.arena;
+        size_t capacity = array->value.array.capacity * 2;
+        json_t **elements;
+        if(arena){
+            elements = json_arena_alloc(arena, capacity * sizeof(json_t*));
+            if(elements) memcpy(elements, array->value.array.elements, array->value.array.size * sizeof(json_t*));
+        }
+        else {
+            elements = realloc(array->value.array.elements, capacity * sizeof(json_t*));
+        }
+        if(!elements){
+            LOG("json_array_add failed to grow.");
+            return -2;
+        }
+        array->value.array.elements = elements;
+        array->value.array.capacity = capacity;
     }
 
     array->value.array.elements[array->value.array.size++] = value;
@@ -176,33 +240,147 @@ int json_array_add(json_t *array, json_t *value){
     return 0;
 }
 
+static uint32_t key_hash(const char *key){
+    uint32_t hash = 2166136261u;
+    while(*key){
+        hash ^= (unsigned char)*key++;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static size_t members_size(uint32_t capacity){
+    size_t size = capacity * sizeof(json_member_t);
+    if(capacity >= JSON_INDEX_MIN) size += 2 * capacity * sizeof(uint32_t);
+    return size;
+}
+
+static uint32_t *object_index(json_t *object){
+    return (uint32_t *)(object->value.object.members + object->value.object.capacity);
+}
+
+/* slots hold the member's position + 1, 0 marks an empty slot */
+static void index_insert(json_t *object, uint32_t position){
+    uint32_t mask = 2 * object->value.object.capacity - 1;
+    uint32_t *index = object_index(object);
+    uint32_t slot = key_hash(object->value.object.members[position].key) & mask;
+    while(index[slot]){
+        slot = (slot + 1) & mask;
+    }
+    index[slot] = position + 1;
+}
+
+static void index_build(json_t *object){
+    memset(object_index(object), 0, 2 * object->value.object.capacity * sizeof(uint32_t));
+    for(uint32_t i = 0; i < object->value.object.size; ++i){
+        index_insert(object, i);
+    }
+    object->flags |= JSON_FLAG_INDEXED;
+}
+
+static json_member_t *object_find(json_t *object, const char *key){
+    json_member_t *members = object->value.object.members;
+
+    if(object->value.object.size < JSON_INDEX_MIN){
+        for(uint32_t i = 0; i < object->value.object.size; ++i){
+            if(strcmp(members[i].key, key) == 0) return &members[i];
+        }
+        return NULL;
+    }
+
+    if(!(object->flags & JSON_FLAG_INDEXED)) index_build(object);
+
+    uint32_t mask = 2 * object->value.object.capacity - 1;
+    uint32_t *index = object_index(object);
+    uint32_t slot = key_hash(key) & mask;
+    while(index[slot]){
+        json_member_t *member = &members[index[slot] - 1];
+        if(strcmp(member->key, key) == 0) return member;
+        slot = (slot + 1) & mask;
+    }
+
+    return NULL;
+}
+
+/* capacity stays a power of two so the index can mask */
+static int object_append(json_t *object, char *key, json_t *value){
+    if(object->value.object.size == object->value.object.capacity){
+        json_arena_t *arena = object->value.object.arena;
+        uint32_t capacity = object->value.object.capacity ? object->value.object.capacity * 2 : 4;
+        json_member_t *members;
+        if(arena){
+            members = json_arena_alloc(arena, members_size(capacity));
+            if(members && object->value.object.size) memcpy(members, object->value.object.members, object->value.object.size * sizeof(json_member_t));
+        }
+        else {
+            members = realloc(object->value.object.members, members_size(capacity));
+        }
+        if(!members){
+            LOG("json_t member allocation failed");
+            return -2;
+        }
+        object->value.object.members = members;
+        object->value.object.capacity = capacity;
+        object->flags &= ~JSON_FLAG_INDEXED;
+    }
+
+    uint32_t position = object->value.object.size++;
+    object->value.object.members[position].key = key;
+    object->value.object.members[position].value = value;
+    if(object->flags & JSON_FLAG_INDEXED) index_insert(object, position);
+
+    return 0;
+}
+
+static void member_replace(json_member_t *member, json_t *value){
+    if(member->value != value) json_free(member->value);
+    member->value = value;
+}
+
+/*
+*   Adds a member whose key is already allocated the way the object's
+*   keys are (arena or heap); the parser uses it to skip a copy. On a
+*   duplicate the key is released and the value replaced.
+*/
+int json_object_add_owned(json_t *object, char *key, json_t *value){
+    json_member_t *member = object_find(object, key);
+    if(member){
+        if(!object->value.object.arena) free(key);
+        member_replace(member, value);
+        return 0;
+    }
+
+    return object_append(object, key, value);
+}
+
 int json_object_add(json_t *object, const char *key, json_t *value){
-    if(object->type != JSON_OBJECT) return -1;
+    if(!json_is_object(object)) return -1;
 
-    json_t *new_pair = json_create_object();
-    if(!new_pair){
-        LOG("json_t json_create_object failed");
-        return -2;
+    json_member_t *member = object_find(object, key);
+    if(member){
+        member_replace(member, value);
+        return 0;
     }
 
-    new_pair->value.object.key = strdup(key);
-    if(!new_pair->value.object.key) {
-        LOG("json_t strdup failed");
-        free(new_pair);
+    size_t len = strlen(key);
+    char *copy = json_alloc(object->value.object.arena, len + 1);
+    if(!copy) {
+        LOG("json_t key allocation failed");
         return -3;
     }
-    new_pair->value.object.value = value;
-
-    new_pair->value.object.next = object->value.object.next;
-    object->value.object.next = new_pair;
+    memcpy(copy, key, len + 1);
 
+    if(object_append(object, copy, value) != 0){
+        if(!object->value.object.arena) free(copy);
+        return -2;
+    }
 
     return 0;
 }
 
 int json_object_add_string(json_t *json, const char *key, const char *value){
     if(!json_is_object(json)) return -1;
-    json_t *str = json_create_string(value);
+    json_t *str = json_create_string_arena(json->value.object.arena, value);
     if(!str){
         LOG("json_t json_create_string failed");
         return -1;
@@ -211,6 +389,7 @@ int json_object_add_string(json_t *json, const char *key, const char *value){
     int result = json_object_add(json, key, str);
     if(result != 0){
         LOG("json_t json_object_add failed.");
+        json_free(str);
         return -2;
     }
 
@@ -235,7 +414,17 @@ char *json_print(json_t *json){
 
 json_t *json_parse(const char *json_str){
     const char *str = json_str;
-    json_t *json = parse_value(&str);
+    json_t *json = parse_value(&str, NULL);
+    return json;
+}
+
+/*
+*   Parses into arena: one bump allocation per node, key and long string
+*   instead of several mallocs each. Release it all with json_arena_free.
+*/
+json_t *json_parse_arena(json_arena_t *arena, const char *json_str){
+    const char *str = json_str;
+    json_t *json = parse_value(&str, arena);
     return json;
 }
 
@@ -246,35 +435,30 @@ json_t *json_array_get(json_t *array, size_t index){
 }
 
 json_t *json_object_get(json_t *object, const char *key){
-    if(!object || object->type != JSON_OBJECT || !object->value.object.next) return NULL;
+    if(!json_is_object(object)) return NULL;
 
-    json_t *current = object->value.object.next;
-    while(current){
-        if(strcmp(current->value.object.key, key) == 0){
-            return current;
-        }
-        current = current->value.object.next;
-    }
+    json_member_t *member = object_find(object, key);
+    return member ? member->value : NULL;
+}
 
-    return NULL;
+char *json_get_string(json_t *json){
+    if(!json_is_string(json)) return NULL;
+    if(json->flags & JSON_FLAG_SHORT) return json->value.short_string;
+    return json->value.string;
 }
 
 char *json_object_get_string(json_t *object, const char *key){
-    json_t *json = json_object_get(object, key);
-    if(!json) return NULL;
-    if(json->value.object.value->type != JSON_STRING) return NULL;
-    return json->value.object.value->value.string;
+    return json_get_string(json_object_get(object, key));
 }
 
 double *json_object_get_number(json_t *object, const char *key){
     json_t *json = json_object_get(object, key);
-    if(!json) return NULL;
-    return &json->value.object.value->value.number;
+    if(!json || json->type != JSON_NUMBER) return NULL;
+    return &json->value.number;
 }
 
 json_t *json_object_get_array(json_t *object, const char *key){
     json_t *json = json_object_get(object, key);
-    if(!json) return NULL;
-    if(json->value.object.value->type != JSON_ARRAY) return NULL;
-    return json->value.object.value;
+    if(!json_is_array(json)) return NULL;
+    return json;
 }
@@ -2,6 +2,7 @@
 #define JSON_H
 
 #include <stddef.h>
+#include <stdint.h>
 
 /*
 *   TODO:
@@ -19,27 +20,79 @@ enum json_type_e {
     JSON_OBJECT
 };
 
+/* json_t.flags */
+#define JSON_FLAG_ARENA 0x01     /* node, and all it points to, lives in an arena */
+#define JSON_FLAG_SHORT 0x02     /* string is stored in value.short_string */
+#define JSON_FLAG_INDEXED 0x04   /* object's hash index is valid */
+
+/* strings up to this length are stored inside the node */
+#define JSON_SHORT_STRING 23
+
+#define JSON_ARENA_BLOCK 16384
+
+typedef struct json_arena_block {
+    struct json_arena_block *next;
+    char data[];
+} json_arena_block_t;
+
+/*
+*   Bump allocator for whole documents. It starts in the buffer the caller
+*   passes to json_arena_init (may be NULL) and chains malloc'd blocks
+*   once that is used up. json_arena_free releases everything at once.
+*/
+typedef struct {
+    char *data;
+    size_t size;
+    size_t used;
+    json_arena_block_t *blocks;
+} json_arena_t;
+
+typedef struct json_member {
+    char *key;
+    struct json *value;
+} json_member_t;
+
+/*
+*   Objects keep their members in a vector in insertion order, which is
+*   also the order json_print writes them in. Once an object holds
+*   JSON_INDEX_MIN members, the first lookup builds an open addressing
+*   index of 2 * capacity slots, stored right after the members in the
+*   same allocation and kept up to date until the vector grows.
+*
+*   Keys are unique: adding an existing key replaces its value in place,
+*   so when parsing, the last duplicate wins at the first one's position.
+*/
+#define JSON_INDEX_MIN 8
+
 typedef struct json {
-    enum json_type_e type;
+    uint8_t type;
+    uint8_t flags;
     union {
         double number;
         char *string;
+        char short_string[JSON_SHORT_STRING + 1];
 
         struct {
             struct json **elements;
-            size_t size;
-            size_t capacity;
+            uint32_t size;
+            uint32_t capacity;
+            json_arena_t *arena;
         } array;
 
         struct {
-            char *key;
-            struct json *value;
-            struct json *next;
+            json_member_t *members;
+            uint32_t size;
+            uint32_t capacity;
+            json_arena_t *arena;
         } object;
 
     } value;
 } json_t;
 
+void json_arena_init(json_arena_t *arena, void *buffer, size_t size);
+void *json_arena_alloc(json_arena_t *arena, size_t size);
+void json_arena_free(json_arena_t *arena);
+
 json_t *json_create_object();
 json_t *json_create_array(size_t initial_capacity);
 json_t *json_create_string(const char *string);
@@ -48,7 +101,21 @@ json_t *json_create_null();
 json_t *json_create_true();
 json_t *json_create_false();
 
+/*
+*   Same as above, but the node comes from arena. Containers created here
+*   also take their members and growth from arena. Arena nodes are never
+*   passed to json_free; json_free skips them inside heap trees.
+*/
+json_t *json_create_object_arena(json_arena_t *arena);
+json_t *json_create_array_arena(json_arena_t *arena, size_t initial_capacity);
+json_t *json_create_string_arena(json_arena_t *arena, const char *string);
+json_t *json_create_number_arena(json_arena_t *arena, double number);
+json_t *json_create_null_arena(json_arena_t *arena);
+json_t *json_create_true_arena(json_arena_t *arena);
+json_t *json_create_false_arena(json_arena_t *arena);
+
 json_t *json_parse(const char *json_str);
+json_t *json_parse_arena(json_arena_t *arena, const char *json_str);
 char *json_print(json_t *json);
 
 int json_array_add(json_t *array, json_t *value);
@@ -58,11 +125,13 @@ json_t *json_array_get(json_t *array, size_t index);
 int json_object_add(json_t *object, const char *key, json_t *value);
 int json_object_add_string(json_t *json, const char *key, const char *value);
 // int json_object_remove(Json *object, const char *key); // TODO
+/* returns the value stored under key, not the member */
 json_t *json_object_get(json_t *object, const char *key);
 char *json_object_get_string(json_t *object, const char *key);
 double *json_object_get_number(json_t *object, const char *key);
 json_t *json_object_get_array(json_t *object, const char *key);
 
+char *json_get_string(json_t *json);
 
 int json_is_string(json_t *json);
 int json_is_array(json_t *json);
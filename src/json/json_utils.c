@@ -82,7 +82,7 @@ void json_to_string(const json_t *json, char **buffer, size_t *pos, size_t *max_
         }
 
         case JSON_STRING: {
-            escape_and_append_string(buffer, pos, max_size, json->value.string);
+            escape_and_append_string(buffer, pos, max_size, json_get_string((json_t *)json));
             break;
         }
 
@@ -106,18 +106,16 @@ void json_to_string(const json_t *json, char **buffer, size_t *pos, size_t *max_
         case JSON_OBJECT: {
             ensure_buffer_size(buffer, max_size, *pos + 1);
             (*buffer)[(*pos)++] = '{';
-            json_t *current = json->value.object.next;
-            while(current){
-                escape_and_append_string(buffer, pos, max_size, current->value.object.key);
+            for(uint32_t i = 0; i < json->value.object.size; ++i){
+                const json_member_t *member = &json->value.object.members[i];
+                escape_and_append_string(buffer, pos, max_size, member->key);
                 append_literal(buffer, pos, max_size, ": ");
-                json_to_string(current->value.object.value, buffer, pos, max_size);
+                json_to_string(member->value, buffer, pos, max_size);
 
-                current = current->value.object.next;
-                if(current){
+                if(i < json->value.object.size - 1){
                     ensure_buffer_size(buffer, max_size, *pos + 1);
                     (*buffer)[(*pos)++] = ',';
                 }
-
             }
             ensure_buffer_size(buffer, max_size, *pos + 1);
             (*buffer)[(*pos)++] = '}';
@@ -134,52 +132,46 @@ double parse_number(const char **str){
     return num;
 }
 
-json_t *parse_value(const char **str){
+json_t *parse_value(const char **str, json_arena_t *arena){
     *str = skip_whitespace(*str);
 
     if (!**str) return NULL;
 
     switch(**str){
-        case '{': return parse_object(str);
-        case '[': return parse_array(str);
-        case '\"': {
-            char *parsed_str = parse_string(str);
-            if(!parsed_str) return NULL;
-            json_t *json_string = json_create_string(parsed_str);
-            free(parsed_str);
-            return json_string;
-        }
+        case '{': return parse_object(str, arena);
+        case '[': return parse_array(str, arena);
+        case '\"': return parse_string_value(str, arena);
         case 't': {
             if(strncmp(*str, "true", 4) == 0){
                 *str += 4;
-                return json_create_true();
+                return json_create_true_arena(arena);
             }
             break;
         }
         case 'f': {
             if(strncmp(*str, "false", 5) == 0){
                 *str += 5;
-                return json_create_false();
+                return json_create_false_arena(arena);
             }
             break;
         }
         case 'n': {
             if(strncmp(*str, "null", 4) == 0){
                 *str += 4;
-                return json_create_null();
+                return json_create_null_arena(arena);
             }
             break;
         }
         default:
             if(isdigit(**str) || **str == '-'){
-                return json_create_number(parse_number(str));
+                return json_create_number_arena(arena, parse_number(str));
             }
             break;
     }
     return NULL;
 }
 
-static void utf8_encode(unsigned int codepoint, char *dest, int *len) {
+static void utf8_encode(unsigned int codepoint, char *dest, size_t *len) {
     if (codepoint <= 0x7F) {
         dest[(*len)++] = codepoint;
     } else if (codepoint <= 0x7FF) {
@@ -197,32 +189,30 @@ static void utf8_encode(unsigned int codepoint, char *dest, int *len) {
     }
 }
 
-char *parse_string(const char **str) {
-    if (**str != '\"') return NULL;
-    (*str)++;
+/*
+*   Bytes between the quotes as written. No escape decodes to more bytes
+*   than it takes, so this bounds the decoded length and strings are
+*   allocated once.
+*/
+static size_t raw_string_length(const char *str) {
+    const char *p = str + 1;
+    while (*p && *p != '\"') {
+        if (*p == '\\' && p[1]) p++;
+        p++;
+    }
+    return p - (str + 1);
+}
 
-    char *buffer = malloc(256);
-    if (!buffer) return NULL;
+static int decode_string(const char **str, char *buffer, size_t *out_len) {
+    if (**str != '\"') return -1;
+    (*str)++;
 
-    int buf_size = 256, len = 0;
+    size_t len = 0;
 
     while (**str && **str != '\"') {
-        if (len + 4 >= buf_size) {
-            char *new_buffer = realloc(buffer, buf_size *= 2);
-            if (!new_buffer) {
-                LOG("Realloc failed");
-                free(buffer);
-                return NULL;
-            }
-            buffer = new_buffer;
-        }
-
         if (**str == '\\') {
             (*str)++;
-            if (!**str) {
-                free(buffer);
-                return NULL;
-            }
+            if (!**str) return -1;
             switch (**str) {
                 case 'u': {
                     unsigned int codepoint = 0;
@@ -233,12 +223,8 @@ char *parse_string(const char **str) {
                             (isdigit(**str) ? **str - '0' : tolower(**str) - 'a' + 10);
                         valid_digits++;
                     }
-                    if (valid_digits == 4) {
-                        utf8_encode(codepoint, buffer, &len);
-                    } else {
-                        free(buffer);
-                        return NULL;
-                    }
+                    if (valid_digits != 4) return -1;
+                    utf8_encode(codepoint, buffer, &len);
                     break;
                 }
                 case 'n': buffer[len++] = '\n'; break;
@@ -249,9 +235,7 @@ char *parse_string(const char **str) {
                 case '\\': buffer[len++] = '\\'; break;
                 case '\"': buffer[len++] = '\"'; break;
                 case '/': buffer[len++] = '/'; break;
-                default:
-                    free(buffer);
-                    return NULL;
+                default: return -1;
             }
         } else {
             buffer[len++] = **str;
@@ -259,23 +243,64 @@ char *parse_string(const char **str) {
         (*str)++;
     }
 
-    if (**str != '\"') {
-        free(buffer);
-        return NULL;
-    }
+    if (**str != '\"') return -1;
     (*str)++;
     buffer[len] = '\0';
+    *out_len = len;
+
+    return 0;
+}
+
+char *parse_string(const char **str, json_arena_t *arena) {
+    if (**str != '\"') return NULL;
+
+    char *buffer = json_alloc(arena, raw_string_length(*str) + 1);
+    if (!buffer) return NULL;
+
+    size_t len;
+    if (decode_string(str, buffer, &len) != 0) {
+        if (!arena) free(buffer);
+        return NULL;
+    }
 
     return buffer;
 }
 
-json_t *parse_object(const char **str){
+/* short strings are decoded straight into the node */
+json_t *parse_string_value(const char **str, json_arena_t *arena) {
+    size_t raw_len = raw_string_length(*str);
+    size_t len;
+
+    if (raw_len <= JSON_SHORT_STRING) {
+        char buffer[JSON_SHORT_STRING + 1];
+        if (decode_string(str, buffer, &len) != 0) return NULL;
+        return json_create_string_len_arena(arena, buffer, len);
+    }
+
+    char *buffer = json_alloc(arena, raw_len + 1);
+    if (!buffer) return NULL;
+    if (decode_string(str, buffer, &len) != 0) {
+        if (!arena) free(buffer);
+        return NULL;
+    }
+
+    json_t *json = json_new(arena, JSON_STRING);
+    if (!json) {
+        if (!arena) free(buffer);
+        return NULL;
+    }
+    json->value.string = buffer;
+
+    return json;
+}
+
+json_t *parse_object(const char **str, json_arena_t *arena){
     *str = skip_whitespace(*str);
     if(**str != '{') {
         return NULL;
     }
 
-    json_t *object = json_create_object();
+    json_t *object = json_create_object_arena(arena);
     if(!object) return NULL;
 
     (*str)++;
@@ -294,7 +319,7 @@ json_t *parse_object(const char **str){
             return NULL;
         }
 
-        char *key = parse_string(str);
+        char *key = parse_string(str, arena);
         if(!key){
             json_free(object);
             return NULL;
@@ -302,27 +327,26 @@ json_t *parse_object(const char **str){
 
         *str = skip_whitespace(*str);
         if(**str != ':') {
-            free(key);
+            if(!arena) free(key);
             json_free(object);
             return NULL;
         }
         (*str)++;
 
         *str = skip_whitespace(*str);
-        json_t *value = parse_value(str);
+        json_t *value = parse_value(str, arena);
         if(!value) {
-            free(key);
+            if(!arena) free(key);
             json_free(object);
             return NULL;
         }
 
-        if(json_object_add(object, key, value) != 0) {
-            free(key);
+        if(json_object_add_owned(object, key, value) != 0) {
+            if(!arena) free(key);
             json_free(value);
             json_free(object);
             return NULL;
         }
-        free(key);
 
         *str = skip_whitespace(*str);
         if(**str == ',') {
@@ -347,13 +371,13 @@ json_t *parse_object(const char **str){
     return object;
 }
 
-json_t *parse_array(const char **str){
+json_t *parse_array(const char **str, json_arena_t *arena){
     *str = skip_whitespace(*str);
     if(**str != '[') {
         return NULL;
     }
 
-    json_t *array = json_create_array(0);
+    json_t *array = json_create_array_arena(arena, 0);
     if(!array) return NULL;
 
     (*str)++;
@@ -367,7 +391,7 @@ json_t *parse_array(const char **str){
     while(**str && **str != ']'){
         *str = skip_whitespace(*str);
 
-        json_t *element = parse_value(str);
+        json_t *element = parse_value(str, arena);
         if(!element) {
             json_free(array);
             return NULL;
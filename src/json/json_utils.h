@@ -8,9 +8,15 @@ void json_to_string(const json_t *json, char **buffer, size_t *pos, size_t *max_
 int ensure_buffer_size(char **buffer, size_t *max_size, size_t required_space);
 
 double parse_number(const char **str);
-json_t *parse_object(const char **str);
-char *parse_string(const char **str);
-json_t *parse_value(const char **str);
-json_t *parse_array(const char **str);
+json_t *parse_object(const char **str, json_arena_t *arena);
+char *parse_string(const char **str, json_arena_t *arena);
+json_t *parse_string_value(const char **str, json_arena_t *arena);
+json_t *parse_value(const char **str, json_arena_t *arena);
+json_t *parse_array(const char **str, json_arena_t *arena);
+
+void *json_alloc(json_arena_t *arena, size_t size);
+json_t *json_new(json_arena_t *arena, enum json_type_e type);
+json_t *json_create_string_len_arena(json_arena_t *arena, const char *string, size_t len);
+int json_object_add_owned(json_t *object, char *key, json_t *value);
 
 #endif
@@ -7,16 +7,6 @@
 #include "server.h"
 #include "utils.h"
 
-#include "cxc/index.h"
-
-void handle_root(int client_fd, http_req_t *req __attribute__((unused))) {
-    IndexProps props = {.title = "e45g"};
-    char *str = render_index(&props);
-
-    send_string(client_fd, str);
-    free(str);
-}
-
 void handle_robots(int client_fd, http_req_t *req __attribute__((unused))) {
     send_plain(client_fd, "User-agent: *\nAllow: /");
 }
@@ -25,11 +15,12 @@ void handle_log(int client_fd, http_req_t *req __attribute__((unused))) {
     serve_file(client_fd, "../log.txt");
 }
 
+/*
+*   The routes of this site are declared in routes.rt and compiled into the
+*   binary by rtc. Routes that are only known at runtime can still be
+*   registered here with add_route / add_route_ex.
+*/
 void load_routes() {
-    add_route("GET", "/robots.txt", NULL, handle_robots);
-
-    add_route("GET", "/", NULL, handle_root);
-    add_route("GET", "/log", NULL, handle_log);
 }
 
 int main(void) {
@@ -0,0 +1,335 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/uio.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "conn.h"
+#include "response.h"
+#include "server.h"
+#include "utils.h"
+
+void resp_init(response_t *resp, response_status_t status) {
+    resp->status = status;
+    resp->head_len = 0;
+    resp->segments_len = 0;
+    resp->body_len = 0;
+    resp->has_content_length = 0;
+    resp->has_connection = 0;
+    resp->has_date = 0;
+    resp->failed = 0;
+}
+
+static int head_append(response_t *resp, const char *data, size_t len) {
+    if (resp->head_len + len > sizeof(resp->head)) {
+        resp->failed = 1;
+        return -1;
+    }
+    memcpy(resp->head + resp->head_len, data, len);
+    resp->head_len += len;
+    return 0;
+}
+
+int resp_header(response_t *resp, const char *name, const char *value) {
+    if (strcasecmp(name, "Content-Length") == 0) resp->has_content_length = 1;
+    if (strcasecmp(name, "Connection") == 0) resp->has_connection = 1;
+    if (strcasecmp(name, "Date") == 0) resp->has_date = 1;
+
+    if (head_append(resp, name, strlen(name)) != 0 ||
+        head_append(resp, ": ", 2) != 0 ||
+        head_append(resp, value, strlen(value)) != 0 ||
+        head_append(resp, "\r\n", 2) != 0) {
+        LOG("Response headers exceed %d bytes", RESPONSE_HEADERS_SIZE);
+        return -1;
+    }
+    return 0;
+}
+
+static response_segment_t *add_segment(response_t *resp) {
+    if (resp->segments_len >= RESPONSE_MAX_SEGMENTS) {
+        LOG("Response has more than %d body segments", RESPONSE_MAX_SEGMENTS);
+        resp->failed = 1;
+        return NULL;
+    }
+    return &resp->segments[resp->segments_len++];
+}
+
+int resp_body(response_t *resp, const char *data, size_t len) {
+    response_segment_t *seg = add_segment(resp);
+    if (!seg) return -1;
+
+    *seg = (response_segment_t){RESP_SEG_BORROWED, data, len, -1, 0, NULL, 0};
+    resp->body_len += len;
+    return 0;
+}
+
+int resp_body_owned(response_t *resp, char *data, size_t len) {
+    response_segment_t *seg = add_segment(resp);
+    if (!seg) {
+        free(data);
+        return -1;
+    }
+
+    *seg = (response_segment_t){RESP_SEG_OWNED, data, len, -1, 0, NULL, 0};
+    resp->body_len += len;
+    return 0;
+}
+
+int resp_body_file(response_t *resp, int fd, off_t offset, size_t len) {
+    response_segment_t *seg = add_segment(resp);
+    if (!seg) {
+        close(fd);
+        return -1;
+    }
+
+    *seg = (response_segment_t){RESP_SEG_FILE, NULL, len, fd, offset, NULL, 0};
+    resp->body_len += len;
+    return 0;
+}
+
+/*
+*   Borrows a list of iovecs totalling len bytes, e.g. a rendered cx
+*   template. The list and the memory it points at must outlive resp_send.
+*/
+int resp_body_iov(response_t *resp, const struct iovec *iov, int iov_count, size_t len) {
+    response_segment_t *seg = add_segment(resp);
+    if (!seg) return -1;
+
+    *seg = (response_segment_t){RESP_SEG_IOV, NULL, len, -1, 0, iov, iov_count};
+    resp->body_len += len;
+    return 0;
+}
+
+void resp_discard(response_t *resp) {
+    for (int i = 0; i < resp->segments_len; i++) {
+        response_segment_t *seg = &resp->segments[i];
+        if (seg->kind == RESP_SEG_OWNED) free((char *)seg->data);
+        if (seg->kind == RESP_SEG_FILE) close(seg->fd);
+    }
+    resp->segments_len = 0;
+}
+
+#define CONTENT_LENGTH_PREFIX "Content-Length: "
+#define CHUNKED_HEADER "Transfer-Encoding: chunked\r\n"
+#define CONNECTION_CLOSE_HEADER "Connection: close\r\n"
+
+static size_t format_content_length(char *dst, size_t len) {
+    char digits[20];
+    int n = 0;
+    do {
+        digits[n++] = '0' + len % 10;
+        len /= 10;
+    } while (len > 0);
+
+    size_t pos = sizeof(CONTENT_LENGTH_PREFIX) - 1;
+    memcpy(dst, CONTENT_LENGTH_PREFIX, pos);
+    while (n > 0) dst[pos++] = digits[--n];
+    dst[pos++] = '\r';
+    dst[pos++] = '\n';
+    return pos;
+}
+
+/*
+*   Fills iov with the complete response head. Apart from Content-Length
+*   every piece is a precomputed string: the status line table, the cached
+*   Date header and the headers the handler already formatted.
+*/
+typedef enum {
+    BODY_LENGTH,
+    BODY_CHUNKED,
+    BODY_UNTIL_CLOSE
+} body_framing_t;
+
+static int head_iov(response_t *resp, struct iovec *iov, char *length_buf, body_framing_t framing) {
+    int count = 0;
+
+    slice_t status_line = get_status_line(resp->status);
+    iov[count++] = (struct iovec){(void *)status_line.data, status_line.len};
+
+    if (!resp->has_date) {
+        slice_t date = clock_date_header();
+        iov[count++] = (struct iovec){(void *)date.data, date.len};
+    }
+    if (framing == BODY_CHUNKED) {
+        iov[count++] = (struct iovec){CHUNKED_HEADER, sizeof(CHUNKED_HEADER) - 1};
+    } else if (framing == BODY_LENGTH && !resp->has_content_length) {
+        iov[count++] = (struct iovec){length_buf, format_content_length(length_buf, resp->body_len)};
+    }
+    if (!resp->has_connection) {
+        iov[count++] = (struct iovec){CONNECTION_CLOSE_HEADER, sizeof(CONNECTION_CLOSE_HEADER) - 1};
+    }
+
+    iov[count++] = (struct iovec){resp->head, resp->head_len};
+    iov[count++] = (struct iovec){"\r\n", 2};
+    return count;
+}
+
+server_status_t resp_send(int client_fd, response_t *resp) {
+    if (resp->failed) {
+        resp_discard(resp);
+        send_error_response(client_fd, ERR_INTERR);
+        return SERVER_ERR_RESOURCE;
+    }
+
+    char length_buf[RESPONSE_LENGTH_SIZE];
+    struct iovec iov[RESPONSE_IOV_BATCH];
+    int iov_count = head_iov(resp, iov, length_buf, BODY_LENGTH);
+
+    server_status_t result = SERVER_OK;
+    for (int i = 0; i < resp->segments_len && result == SERVER_OK; i++) {
+        response_segment_t *seg = &resp->segments[i];
+
+        if (seg->kind == RESP_SEG_IOV) {
+            for (int j = 0; j < seg->iov_count && result == SERVER_OK; j++) {
+                if (iov_count == RESPONSE_IOV_BATCH) {
+                    result = send_iov(client_fd, iov, iov_count);
+                    iov_count = 0;
+                }
+                iov[iov_count++] = seg->iov[j];
+            }
+            continue;
+        }
+
+        if (seg->kind != RESP_SEG_FILE) {
+            if (seg->len == 0) continue;
+            if (iov_count == RESPONSE_IOV_BATCH) {
+                result = send_iov(client_fd, iov, iov_count);
+                iov_count = 0;
+            }
+            iov[iov_count++] = (struct iovec){(void *)seg->data, seg->len};
+            continue;
+        }
+
+        result = send_iov(client_fd, iov, iov_count);
+        iov_count = 0;
+        if (result == SERVER_OK) {
+            result = send_file_range(client_fd, seg->fd, seg->offset, seg->len);
+        }
+    }
+
+    if (result == SERVER_OK && iov_count > 0) {
+        result = send_iov(client_fd, iov, iov_count);
+    }
+
+    resp_discard(resp);
+    return result;
+}
+
+/*
+*   Sends the head with Transfer-Encoding: chunked and returns the stream
+*   the body is written to. The builder must not carry body segments.
+*   Returns NULL when the response cannot be streamed, e.g. while a route
+*   cache regenerates it without a client.
+*/
+stream_t *resp_begin_chunked(int client_fd, response_t *resp) {
+    client_con_t *conn = conn_lookup(client_fd);
+    if (!conn || conn->stream.active || resp->segments_len > 0) {
+        resp_discard(resp);
+        return NULL;
+    }
+    if (resp->failed) {
+        resp_send(client_fd, resp);
+        return NULL;
+    }
+
+    /* a cached copy would hold whatever was streamed before the handler returned */
+    response_capture_invalidate(client_fd);
+
+    char length_buf[RESPONSE_LENGTH_SIZE];
+    struct iovec iov[RESPONSE_HEAD_IOV];
+    int iov_count = head_iov(resp, iov, length_buf, BODY_CHUNKED);
+    if (send_iov(client_fd, iov, iov_count) != SERVER_OK) return NULL;
+
+    stream_t *stream = &conn->stream;
+    stream->active = 1;
+    stream->paused = 0;
+    stream->on_drain = NULL;
+    stream->on_close = NULL;
+    stream->ctx = NULL;
+    return stream;
+}
+
+void resp_stream_callbacks(stream_t *stream,
+                           void (*on_drain)(stream_t *stream, void *ctx),
+                           void (*on_close)(stream_t *stream, void *ctx),
+                           void *ctx) {
+    stream->on_drain = on_drain;
+    stream->on_close = on_close;
+    stream->ctx = ctx;
+}
+
+/*
+*   Returns 0 when the chunk was written or queued, 1 when the queue is
+*   above STREAM_HIGH_WATERMARK and the producer should wait for on_drain,
+*   -1 when the stream is no longer writable.
+*/
+int resp_write_chunk(stream_t *stream, const char *data, size_t len) {
+    struct iovec iov = {(void *)data, len};
+    return resp_write_chunk_iov(stream, &iov, 1, len);
+}
+
+/*
+*   Writes one chunk made of iov_count pieces totalling len bytes. Long
+*   lists go out in batches of RESPONSE_IOV_BATCH.
+*/
+int resp_write_chunk_iov(stream_t *stream, const struct iovec *iov, int iov_count, size_t len) {
+    if (!stream || !stream->active) return -1;
+    if (len == 0) return stream->paused;
+
+    char size_line[32];
+    int size_len = snprintf(size_line, sizeof(size_line), "%zx\r\n", len);
+
+    client_con_t *conn = stream->conn;
+    struct iovec batch[RESPONSE_IOV_BATCH];
+    int batch_len = 0;
+    batch[batch_len++] = (struct iovec){size_line, size_len};
+
+    for (int i = 0; i <= iov_count; i++) {
+        if (batch_len == RESPONSE_IOV_BATCH) {
+            if (send_iov(conn->fd, batch, batch_len) != SERVER_OK) return -1;
+            batch_len = 0;
+        }
+        batch[batch_len++] = i < iov_count ? iov[i] : (struct iovec){"\r\n", 2};
+    }
+    if (send_iov(conn->fd, batch, batch_len) != SERVER_OK) return -1;
+
+    conn->last_activity = clock_now();
+    if (conn->out_bytes > STREAM_HIGH_WATERMARK) stream->paused = 1;
+    return stream->paused;
+}
+
+/*
+*   Writes the terminating chunk. The connection is closed once the
+*   queued output has been written.
+*/
+int resp_end(stream_t *stream) {
+    if (!stream || !stream->active) return -1;
+
+    client_con_t *conn = stream->conn;
+    server_status_t result = send_raw(conn->fd, "0\r\n\r\n", 5);
+
+    stream->active = 0;
+    stream->paused = 0;
+    conn_finish(conn);
+    return result == SERVER_OK ? 0 : -1;
+}
+
+/*
+*   Sends only the head of a response whose body runs until the connection
+*   is closed. Body segments in the builder are not allowed.
+*/
+server_status_t resp_send_head(int client_fd, response_t *resp) {
+    if (resp->failed || resp->segments_len > 0) {
+        resp_discard(resp);
+        return SERVER_ERR_RESOURCE;
+    }
+
+    response_capture_invalidate(client_fd);
+
+    char length_buf[RESPONSE_LENGTH_SIZE];
+    struct iovec iov[RESPONSE_HEAD_IOV];
+    int iov_count = head_iov(resp, iov, length_buf, BODY_UNTIL_CLOSE);
+    return send_iov(client_fd, iov, iov_count);
+}
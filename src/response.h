@@ -0,0 +1,78 @@
+#ifndef RESPONSE_H
+#define RESPONSE_H
+
+#include <sys/types.h>
+
+#include "server.h"
+
+#define RESPONSE_HEADERS_SIZE 2048
+#define RESPONSE_MAX_SEGMENTS 16
+#define RESPONSE_HEAD_IOV 6
+#define RESPONSE_IOV_BATCH 64
+#define RESPONSE_LENGTH_SIZE 48
+
+typedef enum {
+    RESP_SEG_BORROWED,
+    RESP_SEG_OWNED,
+    RESP_SEG_FILE,
+    RESP_SEG_IOV
+} response_segment_kind_t;
+
+typedef struct {
+    response_segment_kind_t kind;
+    const char *data;
+    size_t len;
+    int fd;
+    off_t offset;
+    const struct iovec *iov;
+    int iov_count;
+} response_segment_t;
+
+/*
+*   Response builder. The status line and headers are formatted into
+*   head, the body is a list of segments that are never copied: borrowed
+*   memory, owned memory (freed after sending), borrowed iovec lists and
+*   file ranges (sent with sendfile, the fd is closed after sending).
+*   resp_send emits everything with a single writev unless the body
+*   contains file ranges or more than RESPONSE_IOV_BATCH pieces. Date,
+*   Content-Length and Connection: close are added unless already set.
+*/
+typedef struct {
+    response_status_t status;
+    char head[RESPONSE_HEADERS_SIZE];
+    size_t head_len;
+    response_segment_t segments[RESPONSE_MAX_SEGMENTS];
+    int segments_len;
+    size_t body_len;
+    int has_content_length;
+    int has_connection;
+    int has_date;
+    int failed;
+} response_t;
+
+void resp_init(response_t *resp, response_status_t status);
+int resp_header(response_t *resp, const char *name, const char *value);
+int resp_body(response_t *resp, const char *data, size_t len);
+int resp_body_owned(response_t *resp, char *data, size_t len);
+int resp_body_file(response_t *resp, int fd, off_t offset, size_t len);
+int resp_body_iov(response_t *resp, const struct iovec *iov, int iov_count, size_t len);
+server_status_t resp_send(int client_fd, response_t *resp);
+void resp_discard(response_t *resp);
+
+/*
+*   Chunked streaming. The stream belongs to the connection and stays
+*   valid until resp_end or its on_close callback, so a handler may return
+*   and keep writing from on_drain.
+*/
+stream_t *resp_begin_chunked(int client_fd, response_t *resp);
+void resp_stream_callbacks(stream_t *stream,
+                           void (*on_drain)(stream_t *stream, void *ctx),
+                           void (*on_close)(stream_t *stream, void *ctx),
+                           void *ctx);
+int resp_write_chunk(stream_t *stream, const char *data, size_t len);
+int resp_write_chunk_iov(stream_t *stream, const struct iovec *iov, int iov_count, size_t len);
+int resp_end(stream_t *stream);
+
+server_status_t resp_send_head(int client_fd, response_t *resp);
+
+#endif
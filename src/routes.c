@@ -1,65 +1,402 @@
+#include <ctype.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 #include <unistd.h>
 
+#include "cache.h"
+#include "routes.h"
 #include "server.h"
 #include "utils.h"
 
+/*
+*   Routes are compiled into one radix tree per method. Static edges are
+*   compressed labels, '*' and ':name' segments are a parameter edge
+*   consuming [^/]*. Lookup prefers static edges and backtracks to the
+*   parameter edge, so a static route always beats a parameter route
+*   regardless of registration order. Parameters are recorded as
+*   (offset, length) slices of the path during that same single pass.
+*
+*   Every virtual host owns its own set of trees. Hosts are kept in an open
+*   addressing table keyed by either a full hostname (sub_dom containing a
+*   '.') or a subdomain label. Routes registered without sub_dom belong to
+*   the bare domain, routes registered with "*" form the default fallback
+*   that is consulted when the host specific tables have no match.
+*/
+typedef struct route_node {
+    char *prefix;
+    size_t prefix_len;
+    struct route_node **children;
+    int children_len;
+    struct route_node *wildcard;
+    route_t *route;
+} route_node_t;
+
+static const char *route_methods[] = {"GET", "POST", "PUT", "DELETE", "HEAD", "OPTIONS"};
+#define ROUTE_METHOD_COUNT (int)(sizeof(route_methods) / sizeof(route_methods[0]))
+
+typedef struct {
+    char *name;
+    size_t name_len;
+    int full;
+    route_node_t *trees[ROUTE_METHOD_COUNT];
+} route_host_t;
+
+typedef struct {
+    route_host_t *slots;
+    size_t capacity;
+    size_t count;
+} host_table_t;
+
+static host_table_t host_table = {0};
+static route_host_t bare_host = {0};
+static route_host_t default_host = {0};
+
 extern server_t server;
 
-int match_route(const char *route, const char *handle) {
-    const char *r = route;
-    const char *h = handle;
-    while (*r && *h) {
-        if (*h == '*') {
-            r = strchr(r, '/');
-            if (!r) {
-                return 1;
+static int method_index(const char *method) {
+    for (int i = 0; i < ROUTE_METHOD_COUNT; i++) {
+        if (strcmp(route_methods[i], method) == 0) return i;
+    }
+    return -1;
+}
+
+static route_node_t *node_create(const char *prefix, size_t prefix_len) {
+    route_node_t *node = calloc(1, sizeof(route_node_t));
+    if (!node) return NULL;
+
+    node->prefix = strndup(prefix, prefix_len);
+    if (!node->prefix) {
+        free(node);
+        return NULL;
+    }
+    node->prefix_len = prefix_len;
+    return node;
+}
+
+static void node_free(route_node_t *node) {
+    if (!node) return;
+
+    for (int i = 0; i < node->children_len; i++) {
+        node_free(node->children[i]);
+    }
+    node_free(node->wildcard);
+    free(node->children);
+    free(node->prefix);
+    free(node);
+}
+
+/*
+*   Children are kept sorted by their first byte and never share one.
+*/
+static int child_index(const route_node_t *node, char c) {
+    int lo = 0, hi = node->children_len - 1;
+    while (lo <= hi) {
+        int mid = (lo + hi) / 2;
+        char m = node->children[mid]->prefix[0];
+        if (m == c) return mid;
+        if ((unsigned char)m < (unsigned char)c) lo = mid + 1;
+        else hi = mid - 1;
+    }
+    return -(lo + 1);
+}
+
+static int node_add_child(route_node_t *node, route_node_t *child) {
+    int idx = child_index(node, child->prefix[0]);
+    if (idx >= 0) return -1;
+    idx = -idx - 1;
+
+    route_node_t **children = realloc(node->children, sizeof(route_node_t *) * (node->children_len + 1));
+    if (!children) return -1;
+
+    memmove(children + idx + 1, children + idx, sizeof(route_node_t *) * (node->children_len - idx));
+    children[idx] = child;
+    node->children = children;
+    node->children_len++;
+    return 0;
+}
+
+static route_node_t *insert_static(route_node_t *node, const char *s, size_t len) {
+    while (len > 0) {
+        int idx = child_index(node, s[0]);
+        if (idx < 0) {
+            route_node_t *child = node_create(s, len);
+            if (!child || node_add_child(node, child) != 0) {
+                node_free(child);
+                return NULL;
             }
-            h++;
-            continue;
+            return child;
+        }
+
+        route_node_t *child = node->children[idx];
+        size_t common = 0;
+        while (common < len && common < child->prefix_len && child->prefix[common] == s[common]) {
+            common++;
         }
-        else if (*h != *r) {
-            return 0;
+
+        if (common < child->prefix_len) {
+            route_node_t *mid = node_create(child->prefix, common);
+            if (!mid) return NULL;
+
+            char *rest = strdup(child->prefix + common);
+            mid->children = malloc(sizeof(route_node_t *));
+            if (!rest || !mid->children) {
+                free(rest);
+                node_free(mid);
+                return NULL;
+            }
+
+            free(child->prefix);
+            child->prefix = rest;
+            child->prefix_len -= common;
+            mid->children[0] = child;
+            mid->children_len = 1;
+            node->children[idx] = mid;
+            child = mid;
         }
-        h++;
-        r++;
+
+        node = child;
+        s += common;
+        len -= common;
     }
 
-    return (*r == '\0' && (*h == '\0' || *h == '*'));
+    return node;
+}
+
+static int is_param_start(const char *path, const char *p) {
+    return *p == '*' || (*p == ':' && (p == path || *(p - 1) == '/'));
 }
 
-void get_wildcards(http_req_t *req, const route_t *r){
-    const char *req_path = req->path;
-    const char *route_path = r->path;
+static route_node_t *insert_path(route_node_t *node, route_t *r) {
+    const char *path = r->path;
+    const char *p = path;
+    r->param_count = 0;
 
-    int req_len = strlen(req_path);
-    int route_len = strlen(route_path);
+    while (node && *p) {
+        if (is_param_start(path, p)) {
+            if (r->param_count >= MAX_ROUTE_PARAMS) {
+                LOG("Route %s has more than %d parameters", path, MAX_ROUTE_PARAMS);
+                return NULL;
+            }
 
-    int i = 0;
-    int j = 0;
+            const char *name = NULL;
+            if (*p == ':') {
+                name = ++p;
+                while (*p && *p != '/') p++;
+                r->param_names[r->param_count] = strndup(name, p - name);
+                if (!r->param_names[r->param_count]) return NULL;
+            } else {
+                r->param_names[r->param_count] = NULL;
+                p++;
+            }
+            r->param_count++;
 
-    req->wildcard_num = 0;
+            if (!node->wildcard) {
+                node->wildcard = node_create("*", 1);
+                if (!node->wildcard) return NULL;
+            }
+            node = node->wildcard;
+            continue;
+        }
+
+        const char *end = p;
+        while (*end && !is_param_start(path, end)) end++;
+        node = insert_static(node, p, end - p);
+        p = end;
+    }
+
+    return node;
+}
+
+static void node_set_route(route_node_t *node, route_t *r) {
+    if (node->route) {
+        LOG("Route %s %s registered twice, last registration wins", r->method, r->path);
+    }
+    node->route = r;
+}
 
-    while(i < req_len && j < route_len){
-        if(route_path[j] == '*'){
-            j++;
-            if(req->wildcard_num < 16){
-                int k = 0;
-                while(i < req_len && req_path[i] != '/' && k < 63){
-                    req->wildcards[req->wildcard_num][k++] = req_path[i++];
-                }
-                req->wildcards[req->wildcard_num][k] = '\0';
-                req->wildcard_num++;
+static route_t *node_match(const route_node_t *node, const char *path, http_req_t *req) {
+    if (*path == '\0') {
+        if (node->route) return node->route;
+    } else {
+        int idx = child_index(node, *path);
+        if (idx >= 0) {
+            const route_node_t *child = node->children[idx];
+            if (strncmp(path, child->prefix, child->prefix_len) == 0) {
+                route_t *r = node_match(child, path + child->prefix_len, req);
+                if (r) return r;
             }
         }
-        i++;
-        j++;
     }
+
+    if (node->wildcard && req->param_count < MAX_ROUTE_PARAMS) {
+        const char *end = path;
+        while (*end && *end != '/') end++;
+
+        route_param_t *param = &req->params[req->param_count++];
+        param->offset = path - req->path;
+        param->len = end - path;
+
+        route_t *r = node_match(node->wildcard, end, req);
+        if (r) return r;
+        req->param_count--;
+    }
+
+    return NULL;
+}
+
+static unsigned long host_hash(const char *name, size_t len, int full) {
+    unsigned long h = 2166136261u ^ (unsigned long)full;
+    for (size_t i = 0; i < len; i++) {
+        h ^= (unsigned char)tolower((unsigned char)name[i]);
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static route_host_t *host_find(const char *name, size_t len, int full) {
+    if (host_table.count == 0) return NULL;
+
+    size_t mask = host_table.capacity - 1;
+    for (size_t i = host_hash(name, len, full) & mask;; i = (i + 1) & mask) {
+        route_host_t *h = &host_table.slots[i];
+        if (!h->name) return NULL;
+        if (h->full == full && h->name_len == len && strncasecmp(h->name, name, len) == 0) {
+            return h;
+        }
+    }
+}
+
+static int host_table_grow(void) {
+    size_t capacity = host_table.capacity ? host_table.capacity * 2 : 16;
+    route_host_t *slots = calloc(capacity, sizeof(route_host_t));
+    if (!slots) return -1;
+
+    for (size_t i = 0; i < host_table.capacity; i++) {
+        route_host_t *h = &host_table.slots[i];
+        if (!h->name) continue;
+
+        size_t j = host_hash(h->name, h->name_len, h->full) & (capacity - 1);
+        while (slots[j].name) j = (j + 1) & (capacity - 1);
+        slots[j] = *h;
+    }
+
+    free(host_table.slots);
+    host_table.slots = slots;
+    host_table.capacity = capacity;
+    return 0;
+}
+
+static route_host_t *host_get(const char *sub_dom) {
+    if (sub_dom == NULL) return &bare_host;
+    if (strcmp(sub_dom, "*") == 0) return &default_host;
+
+    size_t len = strlen(sub_dom);
+    int full = strchr(sub_dom, '.') != NULL;
+
+    route_host_t *h = host_find(sub_dom, len, full);
+    if (h) return h;
+
+    if ((host_table.count + 1) * 2 > host_table.capacity && host_table_grow() != 0) {
+        return NULL;
+    }
+
+    size_t mask = host_table.capacity - 1;
+    size_t i = host_hash(sub_dom, len, full) & mask;
+    while (host_table.slots[i].name) i = (i + 1) & mask;
+
+    h = &host_table.slots[i];
+    h->name = strdup(sub_dom);
+    if (!h->name) return NULL;
+    h->name_len = len;
+    h->full = full;
+    host_table.count++;
+    return h;
+}
+
+static void host_free(route_host_t *h) {
+    for (int i = 0; i < ROUTE_METHOD_COUNT; i++) {
+        node_free(h->trees[i]);
+        h->trees[i] = NULL;
+    }
+    free(h->name);
+    h->name = NULL;
+}
+
+static route_t *host_match(const route_host_t *h, int m, http_req_t *req) {
+    if (!h || !h->trees[m]) return NULL;
+    req->param_count = 0;
+    return node_match(h->trees[m], req->path, req);
+}
+
+static route_t *resolve_route(http_req_t *req) {
+    int m = method_index(req->method);
+    if (m < 0) return NULL;
+
+    route_t *r = NULL;
+    if (req->host_len > 0) {
+        r = host_match(host_find(req->host, req->host_len, 1), m, req);
+        if (r) return r;
+    }
+
+    if (req->sub_domain_len > 0) {
+        r = host_match(host_find(req->sub_domain, req->sub_domain_len, 0), m, req);
+    } else {
+        r = host_match(&bare_host, m, req);
+    }
+    if (r) return r;
+
+    return host_match(&default_host, m, req);
+}
+
+/*
+*   Routes compiled from routes.rt by rtc are tried before the routes
+*   registered at runtime with add_route.
+*/
+route_t *find_route(http_req_t *req) {
+    route_t *r = route_table_find(req);
+    if (!r) r = resolve_route(req);
+    req->route = r;
+    if (!r) req->param_count = 0;
+    return r;
+}
+
+slice_t req_param_at(const http_req_t *req, int index) {
+    if (index < 0 || index >= req->param_count) return (slice_t){NULL, 0};
+
+    const route_param_t *param = &req->params[index];
+    return (slice_t){req->path + param->offset, param->len};
+}
+
+slice_t req_param(const http_req_t *req, const char *name) {
+    if (!req->route) return (slice_t){NULL, 0};
+
+    for (int i = 0; i < req->param_count && i < req->route->param_count; i++) {
+        const char *param_name = req->route->param_names[i];
+        if (param_name && strcmp(param_name, name) == 0) {
+            return req_param_at(req, i);
+        }
+    }
+
+    return (slice_t){NULL, 0};
+}
+
+static void route_free(route_t *r) {
+    for (int i = 0; i < r->param_count; i++) {
+        free(r->param_names[i]);
+    }
+    route_cache_free(r->cache);
+    free(r->sse_channel);
+    free(r->sub_domain);
+    free(r);
 }
 
 void add_route(const char *method, const char *path, const char* sub_dom, void (*callback)(int client_fd, http_req_t *req)) {
-    route_t *r = malloc(sizeof(route_t));
+    add_route_ex(method, path, sub_dom, callback, NULL);
+}
+
+void add_route_ex(const char *method, const char *path, const char* sub_dom, void (*callback)(int client_fd, http_req_t *req), const route_opts_t *opts) {
+    route_t *r = calloc(1, sizeof(route_t));
     if (r == NULL) {
         LOG("Failed to allocate memory");
         return;
@@ -71,14 +408,52 @@ void add_route(const char *method, const char *path, const char* sub_dom, void (
     strncpy(r->method, method, sizeof(r->method) - 1);
     strncpy(r->path, path, sizeof(r->path) - 1);
     r->callback = callback;
+
+    if (opts && opts->cache.ttl > 0) {
+        r->cache = route_cache_create(&opts->cache);
+    }
+    if (opts && opts->sse_channel) {
+        r->sse_channel = strdup(opts->sse_channel);
+    }
+    if (opts) {
+        r->ws = opts->ws;
+    }
+
+    int m = method_index(r->method);
+    if (m < 0) {
+        LOG("Unsupported route method %s", r->method);
+        route_free(r);
+        return;
+    }
+
+    route_host_t *host = host_get(r->sub_domain);
+    if (host && !host->trees[m]) {
+        host->trees[m] = node_create("", 0);
+    }
+
+    route_node_t *node = (host && host->trees[m]) ? insert_path(host->trees[m], r) : NULL;
+    if (!node) {
+        LOG("Failed to compile route %s %s", r->method, r->path);
+        route_free(r);
+        return;
+    }
+    node_set_route(node, r);
+
     r->next = server.route;
     server.route = r;
 }
 
 void print_routes(void) {
+    size_t count = 0;
+    const route_t *table = route_table_routes(&count);
+    for (size_t i = 0; i < count; i++) {
+        const route_t *r = &table[i];
+        LOG("Route - %s: %s%s%s (compiled)", r->method, r->sub_domain ? r->sub_domain : "", r->sub_domain ? " " : "", r->path);
+    }
+
     for (route_t *r = server.route; r; r = r->next)
     {
-        LOG("Route - %s: %s", r->method, r->path);
+        LOG("Route - %s: %s%s%s", r->method, r->sub_domain ? r->sub_domain : "", r->sub_domain ? " " : "", r->path);
     }
 }
 
@@ -87,8 +462,17 @@ void free_routes(void) {
     while (current)
     {
         route_t *tmp = current->next;
-        free(current->sub_domain);
-        free(current);
+        route_free(current);
         current = tmp;
     }
+    server.route = NULL;
+
+    for (size_t i = 0; i < host_table.capacity; i++) {
+        host_free(&host_table.slots[i]);
+    }
+    free(host_table.slots);
+    host_table = (host_table_t){0};
+
+    host_free(&bare_host);
+    host_free(&default_host);
 }
@@ -1,11 +1,30 @@
 #ifndef ROUTES_H
 #define ROUTES_H
 
+#include "cache.h"
 #include "server.h"
+#include "ws.h"
 
-int match_route(char *route, char *handle);
-void get_wildcards(const http_req_t *req, const route_t *r);
-void add_route(const char* sub_dom, const char *method, const char *path, void (*callback)(int client_fd, http_req_t *req));
+/*
+*   cache:        response cache settings, see cache.h
+*   sse_channel:  subscribe clients to this Server-Sent Events channel,
+*                 the callback (may be NULL) runs after subscribing
+*   ws:           accept WebSocket upgrades, the callback is not used
+*/
+typedef struct {
+    route_cache_opts_t cache;
+    const char *sse_channel;
+    const ws_handler_t *ws;
+} route_opts_t;
+
+route_t *find_route(http_req_t *req);
+route_t *route_table_find(http_req_t *req);
+const route_t *route_table_routes(size_t *count);
+void route_table_prerender(void);
+slice_t req_param(const http_req_t *req, const char *name);
+slice_t req_param_at(const http_req_t *req, int index);
+void add_route(const char *method, const char *path, const char *sub_dom, void (*callback)(int client_fd, http_req_t *req));
+void add_route_ex(const char *method, const char *path, const char *sub_dom, void (*callback)(int client_fd, http_req_t *req), const route_opts_t *opts);
 void free_routes(void);
 void print_routes(void);
 
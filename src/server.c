@@ -12,16 +12,24 @@
 #include <sys/socket.h>
 #include <sys/sendfile.h>
 #include <sys/stat.h>
+#include <sys/uio.h>
 #include <netinet/in.h>
 #include <fcntl.h>
 
 #include "server.h"
+#include "assets.h"
+#include "cache.h"
+#include "conn.h"
+#include "cx.h"
+#include "h2.h"
+#include "response.h"
 #include "postgre.h"
 #include "routes.h"
+#include "sse.h"
+#include "ws.h"
 #include "utils.h"
 
 static buffer_pool_t buffer_pool = {0};
-static connection_pool_t conn_pool = {0};
 server_t server;
 
 mime_entry_t mime_types[] = {
@@ -45,25 +53,50 @@ void handle_critical_error(char *msg, int sckt) {
     exit(EXIT_FAILURE);
 }
 
-response_info_t get_response_info(response_status_t status) {
-    switch (status) {
-        case OK_OK:
-            return (response_info_t){200, "OK"};
-        case OK_CREATED:
-            return (response_info_t){201, "Created"};
-        case OK_NOCONTENT:
-            return (response_info_t){204, "No Content"};
-        case ERR_NOTFOUND:
-            return (response_info_t){404, "Not Found"};
-        case ERR_BADREQ:
-            return (response_info_t){400, "Bad Request"};
-        case ERR_UNPROC:
-            return (response_info_t){422, "Unprocessable Content"};
-        case ERR_INTERR:
-            return (response_info_t){500, "Internal Server Error"};
-        default:
-            return (response_info_t){500, "Unknown Error"};
+/*
+*   Status lines are built at compile time so emitting one is a pointer
+*   into rodata. Indexed by status code.
+*/
+typedef struct {
+    response_info_t info;
+    const char *line;
+    size_t line_len;
+} status_entry_t;
+
+#define STATUS_LINE(code, message) "HTTP/1.1 " #code " " message "\r\n"
+#define STATUS_ENTRY(code, message) \
+    [code] = {{code, message}, STATUS_LINE(code, message), sizeof(STATUS_LINE(code, message)) - 1}
+
+static const status_entry_t status_table[] = {
+    STATUS_ENTRY(101, "Switching Protocols"),
+    STATUS_ENTRY(200, "OK"),
+    STATUS_ENTRY(201, "Created"),
+    STATUS_ENTRY(204, "No Content"),
+    STATUS_ENTRY(400, "Bad Request"),
+    STATUS_ENTRY(401, "Unauthorized"),
+    STATUS_ENTRY(404, "Not Found"),
+    STATUS_ENTRY(422, "Unprocessable Content"),
+    STATUS_ENTRY(500, "Internal Server Error"),
+};
+
+static const status_entry_t unknown_status = {
+    {500, "Unknown Error"}, STATUS_LINE(500, "Unknown Error"), sizeof(STATUS_LINE(500, "Unknown Error")) - 1
+};
+
+static const status_entry_t *status_entry(response_status_t status) {
+    if ((unsigned)status >= sizeof(status_table) / sizeof(status_table[0]) || !status_table[status].line) {
+        return &unknown_status;
     }
+    return &status_table[status];
+}
+
+response_info_t get_response_info(response_status_t status) {
+    return status_entry(status)->info;
+}
+
+slice_t get_status_line(response_status_t status) {
+    const status_entry_t *entry = status_entry(status);
+    return (slice_t){entry->line, entry->line_len};
 }
 
 int set_non_blocking(int sock) {
@@ -73,215 +106,253 @@ int set_non_blocking(int sock) {
 }
 
 
-void send_error_response(int client_fd, response_status_t status) {
-    response_info_t info = get_response_info(status);
-
-    char body[512];
-    snprintf(body, sizeof(body), "<html><body><h1>%d %s</h1></body></html>", info.status, info.message);
-
-    char response[1024];
-    snprintf(response, sizeof(response),
-             "HTTP/1.1 %d %s\r\n"
-             "Content-Type: text/html\r\n"
-             "Content-Length: %zu\r\n"
-             "Connection: close\r\n\r\n%s",
-             info.status, info.message, strlen(body), body);
-
-    ssize_t sent = 0;
-    ssize_t total = strlen(response);
-    while (sent < total) {
-        ssize_t s = send(client_fd, response + sent, total - sent, MSG_NOSIGNAL);
-        if (s < 0) {
-            if (errno == EAGAIN || errno == EWOULDBLOCK) continue;
-            break;
+/*
+*   While a capture is active every byte written to its fd is also copied
+*   into the capture buffer. The response cache uses this to record the
+*   exact wire bytes a handler produced. A capture on fd -1 records without
+*   sending anything. Captures nest; every capture on the fd sees the
+*   bytes. File ranges make a capture fail unless it keeps files, in which
+*   case they are recorded by position instead of copied.
+*/
+typedef struct response_capture {
+    int fd;
+    char *data;
+    size_t len;
+    size_t cap;
+    int failed;
+    int keep_files;
+    captured_file_t *files;
+    int files_len;
+    int files_cap;
+    struct response_capture *prev;
+} response_capture_t;
+
+static response_capture_t *capture = NULL;
+
+static void capture_append(response_capture_t *c, const struct iovec *iov, int iov_count) {
+    for (int i = 0; i < iov_count && !c->failed; i++) {
+        if (c->len + iov[i].iov_len > c->cap) {
+            size_t cap = c->cap ? c->cap : 4096;
+            while (cap < c->len + iov[i].iov_len) cap *= 2;
+
+            char *data = realloc(c->data, cap);
+            if (!data) {
+                c->failed = 1;
+                return;
+            }
+            c->data = data;
+            c->cap = cap;
         }
-        sent += s;
+
+        memcpy(c->data + c->len, iov[i].iov_base, iov[i].iov_len);
+        c->len += iov[i].iov_len;
     }
 }
 
-
-
-void send_string(int client_fd, char *str) {
-    if (!str) {
-        send_error_response(client_fd, ERR_INTERR);
+static void capture_file(response_capture_t *c, int file_fd, off_t offset, size_t len) {
+    if (c->failed) return;
+    if (!c->keep_files) {
+        c->failed = 1;
         return;
     }
 
-    size_t str_len = strlen(str);
-    size_t response_size = str_len + 512;
-    char *response = malloc(response_size);
-    if (!response) {
-        send_error_response(client_fd, ERR_INTERR);
-        return;
+    if (c->files_len == c->files_cap) {
+        int cap = c->files_cap ? c->files_cap * 2 : 4;
+        captured_file_t *files = realloc(c->files, cap * sizeof(captured_file_t));
+        if (!files) {
+            c->failed = 1;
+            return;
+        }
+        c->files = files;
+        c->files_cap = cap;
     }
 
-    int response_len = snprintf(response, response_size,
-             "HTTP/1.1 200 OK\r\n"
-             "Content-Type: text/html; charset=utf-8\r\n"
-             "Content-Length: %zu\r\n"
-             "Connection: close\r\n\r\n%s",
-             str_len, str);
-
-    ssize_t total_sent = 0;
-    while (total_sent < response_len) {
-        ssize_t sent = send(client_fd, response + total_sent, response_len - total_sent, MSG_NOSIGNAL);
+    int fd = dup(file_fd);
+    if (fd < 0) {
+        c->failed = 1;
+        return;
+    }
+    c->files[c->files_len++] = (captured_file_t){c->len, fd, offset, len};
+}
 
-        if (sent < 0) {
-            if (errno == EAGAIN || errno == EWOULDBLOCK) {
-                break;
-            }
-            break;
-        }
+void response_capture_begin(int client_fd) {
+    response_capture_t *c = calloc(1, sizeof(response_capture_t));
+    if (!c) return;
+    c->fd = client_fd;
+    c->prev = capture;
+    capture = c;
+}
 
-        if (sent == 0) {
-            break;
-        }
+/*
+*   File ranges sent while the innermost capture is active are kept as
+*   duplicated descriptors, see response_capture_end_files.
+*/
+void response_capture_keep_files(void) {
+    if (capture) capture->keep_files = 1;
+}
 
-        total_sent += sent;
+/*
+*   Ends the innermost capture. On success the caller owns the returned
+*   bytes and the file ranges, whose pos is an offset into those bytes.
+*/
+char *response_capture_end_files(size_t *len, captured_file_t **files, int *files_len) {
+    *len = 0;
+    *files = NULL;
+    *files_len = 0;
+    if (!capture) return NULL;
+
+    response_capture_t *c = capture;
+    capture = c->prev;
+
+    char *data = c->failed ? NULL : c->data;
+    if (data) {
+        *len = c->len;
+        *files = c->files;
+        *files_len = c->files_len;
+    } else {
+        free(c->data);
+        for (int i = 0; i < c->files_len; i++) close(c->files[i].fd);
+        free(c->files);
     }
 
-    free(response);
+    free(c);
+    return data;
 }
 
+char *response_capture_end(size_t *len) {
+    captured_file_t *files;
+    int files_len;
+    char *data = response_capture_end_files(len, &files, &files_len);
+    for (int i = 0; i < files_len; i++) close(files[i].fd);
+    free(files);
+    return data;
+}
 
-
-void send_plain(int client_fd, char *str) {
-    if (!str) {
-        send_error_response(client_fd, ERR_INTERR);
-        return;
+/*
+*   Marks the response being captured for client_fd as uncacheable.
+*/
+void response_capture_invalidate(int client_fd) {
+    for (response_capture_t *c = capture; c; c = c->prev) {
+        if (c->fd == client_fd) c->failed = 1;
     }
+}
 
-    size_t str_len = strlen(str);
-    size_t response_size = str_len + 512;
-    char *response = malloc(response_size);
-    if (!response) {
-        send_error_response(client_fd, ERR_INTERR);
-        return;
+int response_capture_active(int client_fd) {
+    for (response_capture_t *c = capture; c; c = c->prev) {
+        if (c->fd == client_fd) return 1;
     }
+    return 0;
+}
 
-    int response_len = snprintf(response, response_size,
-             "HTTP/1.1 200 OK\r\n"
-             "Content-Type: text/plain\r\n"
-             "Content-Length: %zu\r\n"
-             "Connection: close\r\n\r\n%s",
-             str_len, str);
+server_status_t send_iov(int client_fd, struct iovec *iov, int iov_count) {
+    int captured = 0;
+    for (response_capture_t *c = capture; c; c = c->prev) {
+        if (c->fd != client_fd) continue;
+        capture_append(c, iov, iov_count);
+        captured = 1;
+    }
+    if (captured && client_fd < 0) return SERVER_OK;
 
-    ssize_t total_sent = 0;
-    while (total_sent < response_len) {
-        ssize_t sent = send(client_fd, response + total_sent, response_len - total_sent, MSG_NOSIGNAL);
+    /* queued output goes first, anything written now would overtake it */
+    client_con_t *conn = conn_lookup(client_fd);
+    if (conn && conn->out_head) return conn_queue(conn, iov, iov_count);
 
+    while (iov_count > 0) {
+        ssize_t sent = writev(client_fd, iov, iov_count);
         if (sent < 0) {
+            if (errno == EINTR) continue;
             if (errno == EAGAIN || errno == EWOULDBLOCK) {
-                break;
+                if (conn) return conn_queue(conn, iov, iov_count);
+                continue;
             }
-            break;
+            return SERVER_ERR_NETWORK;
         }
 
-        if (sent == 0) {
-            break;
+        while (iov_count > 0 && (size_t)sent >= iov->iov_len) {
+            sent -= iov->iov_len;
+            iov++;
+            iov_count--;
+        }
+        if (iov_count > 0) {
+            iov->iov_base = (char *)iov->iov_base + sent;
+            iov->iov_len -= sent;
         }
-
-        total_sent += sent;
     }
 
-    free(response);
+    return SERVER_OK;
+}
+
+server_status_t send_raw(int client_fd, const void *data, size_t len) {
+    struct iovec iov = {(void *)data, len};
+    return send_iov(client_fd, &iov, 1);
 }
 
-void send_json_response(int client_fd, response_status_t status, const char *json) {
-    response_info_t info = get_response_info(status);
-    ssize_t json_len = strlen(json);
-
-    char headers[1024] = {0};
-    int headers_len = snprintf(headers, sizeof(headers),
-             "HTTP/1.1 %d %s\r\n"
-             "Content-Type: application/json\r\n"
-             "Content-Length: %zu\r\n"
-             "Connection: keep-alive\r\n",
-             info.status, info.message, json_len);
-
-    headers_len += snprintf(headers+headers_len, sizeof(headers), "\r\n");
-
-    ssize_t total_sent = 0;
-    while (total_sent < headers_len) {
-        ssize_t sent = send(client_fd, headers + total_sent, headers_len - total_sent, 0);
-        if (sent == -1) {
-            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+server_status_t send_file_range(int client_fd, int file_fd, off_t offset, size_t len) {
+    /* sendfile bypasses the capture buffer */
+    for (response_capture_t *c = capture; c; c = c->prev) {
+        if (c->fd == client_fd) capture_file(c, file_fd, offset, len);
+    }
+    if (client_fd < 0) return SERVER_OK;
+
+    client_con_t *conn = conn_lookup(client_fd);
+    if (conn && conn->out_head) return conn_queue_file(conn, file_fd, offset, len);
+
+    off_t end = offset + len;
+    while (offset < end) {
+        size_t chunk_size = (end - offset > SENDFILE_CHUNK_SIZE) ?
+                           SENDFILE_CHUNK_SIZE : (size_t)(end - offset);
+
+        ssize_t sent_bytes = sendfile(client_fd, file_fd, &offset, chunk_size);
+        if (sent_bytes <= 0) {
+            if (sent_bytes < 0 && errno == EINTR) continue;
+            if (sent_bytes < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                if (conn) return conn_queue_file(conn, file_fd, offset, end - offset);
                 continue;
-            } else {
-                LOG("send_json_response headers sent = -1");
-                send_error_response(client_fd, ERR_INTERR);
-                return;
             }
+            return SERVER_ERR_NETWORK;
         }
-        total_sent += sent;
-    }
-
-    ssize_t offset = 0;
-    const ssize_t CHUNK_SIZE = 16384;
-    while (offset < json_len) {
-        ssize_t remaining = json_len  - offset;
-        ssize_t chunk_size = (remaining > CHUNK_SIZE) ? CHUNK_SIZE : remaining;
-        ssize_t sent_chunk = 0;
-        while (sent_chunk < chunk_size) {
-            ssize_t sent = send(client_fd, json + offset + sent_chunk, chunk_size - sent_chunk, 0);
-            if (sent == -1) {
-                if (errno == EAGAIN || errno == EWOULDBLOCK) {
-                    continue;
-                } else {
-                    LOG("send_json_response JSON sent = -1");
-                    send_error_response(client_fd, ERR_INTERR);
-                    return;
-                }
-            }
-            sent_chunk += sent;
-        }
-        offset += sent_chunk;
     }
 
-    if (offset != json_len) {
-        send_error_response(client_fd, ERR_INTERR);
-        return;
-    }
+    return SERVER_OK;
 }
 
-client_con_t* get_connection(int fd) {
-    client_con_t* conn;
-
-    if (conn_pool.free_connections) {
-        conn = conn_pool.free_connections;
-        conn_pool.free_connections = conn->next;
-    } else if (conn_pool.total_count < CONNECTION_POOL_SIZE) {
-        conn = malloc(sizeof(client_con_t));
-        if (!conn) return NULL;
-        conn_pool.total_count++;
-    } else {
-        return NULL;
-    }
+void send_error_response(int client_fd, response_status_t status) {
+    response_info_t info = get_response_info(status);
 
-    conn->fd = fd;
-    conn->last_activity = time(NULL);
-    conn->keepalive_requests = 0;
-    conn->next = conn_pool.active_connections;
-    conn_pool.active_connections = conn;
-    conn_pool.active_count++;
+    char body[512];
+    int body_len = snprintf(body, sizeof(body), "<html><body><h1>%d %s</h1></body></html>", info.status, info.message);
 
-    return conn;
+    response_t resp;
+    resp_init(&resp, status);
+    resp_header(&resp, "Content-Type", "text/html");
+    resp_body(&resp, body, body_len);
+    resp_send(client_fd, &resp);
 }
 
-void release_connection(client_con_t* conn) {
-    client_con_t** current = &conn_pool.active_connections;
-    while (*current && *current != conn) {
-        current = &(*current)->next;
-    }
-    if (*current) {
-        *current = conn->next;
-        conn_pool.active_count--;
+void send_text(int client_fd, response_status_t status, const char *content_type, const char *str) {
+    if (!str) {
+        send_error_response(client_fd, ERR_INTERR);
+        return;
     }
 
-    conn->next = conn_pool.free_connections;
-    conn_pool.free_connections = conn;
+    response_t resp;
+    resp_init(&resp, status);
+    resp_header(&resp, "Content-Type", content_type);
+    resp_body(&resp, str, strlen(str));
+    resp_send(client_fd, &resp);
+}
+
+void send_string(int client_fd, char *str) {
+    send_text(client_fd, OK_OK, "text/html; charset=utf-8", str);
 }
 
+void send_plain(int client_fd, char *str) {
+    send_text(client_fd, OK_OK, "text/plain", str);
+}
+
+void send_json_response(int client_fd, response_status_t status, const char *json) {
+    send_text(client_fd, status, "application/json", json);
+}
 
 buffer_t* get_buffer(size_t min_size) {
     buffer_t* buf;
@@ -333,6 +404,16 @@ const char *get_mime_type(const char *path) {
 }
 
 
+/*
+*   Frees what a failed parse allocated and leaves the request empty, so
+*   the caller can still pass it to http_req_free.
+*/
+static server_status_t parse_failed(http_req_t *http_req, server_status_t status) {
+    http_req_free(http_req);
+    memset(http_req, 0, sizeof(http_req_t));
+    return status;
+}
+
 server_status_t parse_http_request(const char* buffer, size_t buffer_len, http_req_t* http_req) {
     if (!buffer || !http_req || buffer_len > MAX_REQUEST_SIZE) {
         return SERVER_ERR_PROTOCOL;
@@ -361,40 +442,29 @@ server_status_t parse_http_request(const char* buffer, size_t buffer_len, http_r
 
     char* path_start = method_end + 1;
     char* path_end = strchr(path_start, ' ');
-    if (!path_end) {
-        free(http_req->method);
-        return SERVER_ERR_PROTOCOL;
-    }
+    if (!path_end) return parse_failed(http_req, SERVER_ERR_PROTOCOL);
 
     *path_end = '\0';
+    char* query_start = strchr(path_start, '?');
+    if (query_start) *query_start++ = '\0';
+
     char* sanitized_path = sanitize_path(path_start);
-    if (!sanitized_path) {
-        free(http_req->method);
-        return SERVER_ERR_SECURITY;
-    }
+    if (!sanitized_path) return parse_failed(http_req, SERVER_ERR_SECURITY);
     http_req->path = sanitized_path;
 
     char* version_start = path_end + 1;
-    if (strncmp(version_start, "HTTP/1.", 7) != 0) {
-        free(http_req->method);
-        free(http_req->path);
-        return SERVER_ERR_PROTOCOL;
-    }
+    if (strncmp(version_start, "HTTP/1.", 7) != 0) return parse_failed(http_req, SERVER_ERR_PROTOCOL);
 
     http_req->version = strndup(version_start, 16);
-    if (!http_req->version) {
-        free(http_req->method);
-        free(http_req->path);
-        return SERVER_ERR_MEMORY;
+    if (!http_req->version) return parse_failed(http_req, SERVER_ERR_MEMORY);
+
+    if (query_start) {
+        http_req->query = strdup(query_start);
+        if (!http_req->query) return parse_failed(http_req, SERVER_ERR_MEMORY);
     }
 
     http_req->headers = calloc(MAX_HEADER_COUNT, sizeof(header_t));
-    if (!http_req->headers) {
-        free(http_req->method);
-        free(http_req->path);
-        free(http_req->version);
-        return SERVER_ERR_MEMORY;
-    }
+    if (!http_req->headers) return parse_failed(http_req, SERVER_ERR_MEMORY);
 
     const char* header_line = line_end + 2;
     http_req->headers_len = 0;
@@ -451,9 +521,9 @@ server_status_t parse_http_request(const char* buffer, size_t buffer_len, http_r
 }
 
 void http_req_free(http_req_t *req) {
-    if(req->sub_domain != NULL) free(req->sub_domain);
     free(req->method);
     free(req->path);
+    free(req->query);
     free(req->version);
 
     for (int i = 0; i < req->headers_len; i++) {
@@ -468,7 +538,6 @@ server_status_t serve_file(int client_fd, const char* path) {
     char full_path[PATH_MAX];
     struct stat st;
     int file_fd = -1;
-    server_status_t result = SERVER_OK;
 
     snprintf(full_path, sizeof(full_path), "%s/%s", get_routes_dir(), path);
     file_fd = open(full_path, O_RDONLY);
@@ -494,104 +563,99 @@ server_status_t serve_file(int client_fd, const char* path) {
 
     const char* mime_type = get_mime_type(path);
 
-    buffer_t* header_buf = get_buffer(1024);
-    if (!header_buf) {
-        close(file_fd);
-        return SERVER_ERR_MEMORY;
-    }
+    response_t resp;
+    resp_init(&resp, OK_OK);
+    resp_header(&resp, "Content-Type", mime_type);
+    resp_header(&resp, "Server", "hehe/1.0");
+    resp_body_file(&resp, file_fd, 0, st.st_size);
 
-    int header_len = snprintf(header_buf->data, header_buf->size,
-        "HTTP/1.1 200 OK\r\n"
-        "Content-Type: %s\r\n"
-        "Content-Length: %ld\r\n"
-        "Connection: keep-alive\r\n"
-        "Server: hehe/1.0\r\n"
-        "\r\n",
-        mime_type, st.st_size);
+    return resp_send(client_fd, &resp);
+}
 
-    ssize_t sent = send(client_fd, header_buf->data, header_len, MSG_NOSIGNAL);
-    release_buffer(header_buf);
+server_status_t serve_asset(int client_fd, http_req_t *req, const char *path) {
+    if (!get_embed_assets()) return SERVER_ERR_FILE;
 
-    if (sent != header_len) {
-        close(file_fd);
-        return SERVER_ERR_NETWORK;
-    }
+    const asset_t *asset = asset_lookup(path, strlen(path));
+    if (!asset) return SERVER_ERR_FILE;
 
-    off_t offset = 0;
-    while (offset < st.st_size) {
-        size_t chunk_size = (st.st_size - offset > SENDFILE_CHUNK_SIZE) ?
-                           SENDFILE_CHUNK_SIZE : (st.st_size - offset);
+    /* the prebuilt heads end in an empty line, Date is slotted in before it */
+    slice_t date = clock_date_header();
+    struct iovec iov[4];
+    iov[1] = (struct iovec){(void *)date.data, date.len};
+    iov[2] = (struct iovec){"\r\n", 2};
 
-        ssize_t sent_bytes = sendfile(client_fd, file_fd, &offset, chunk_size);
-        if (sent_bytes <= 0) {
-            if (errno == EAGAIN || errno == EWOULDBLOCK) {
-                continue;
-            }
-            result = SERVER_ERR_NETWORK;
-            break;
-        }
+    char *if_none_match = get_header(req, "If-None-Match");
+    if (if_none_match && strstr(if_none_match, asset->etag)) {
+        iov[0] = (struct iovec){(void *)asset->not_modified, asset->not_modified_len - 2};
+        return send_iov(client_fd, iov, 3);
+    }
+
+    const asset_variant_t *variant = &asset->identity;
+    if (asset->br.data && accepts_brotli(req)) {
+        variant = &asset->br;
+    } else if (asset->gzip.data && accepts_gzip(req)) {
+        variant = &asset->gzip;
     }
 
-    close(file_fd);
-    return result;
+    iov[0] = (struct iovec){(void *)variant->headers, variant->headers_len - 2};
+    iov[3] = (struct iovec){(void *)variant->data, variant->len};
+    return send_iov(client_fd, iov, 4);
 }
 
+/*
+*   Points req->host and req->sub_domain into the Host header value without
+*   copying. Neither slice is NUL terminated.
+*/
 static void extract_subdomain(http_req_t *req) {
-    char *host = get_header(req, "Host");
-    if (!host) {
-        req->sub_domain = NULL;
-        return;
-    }
+    req->host = NULL;
+    req->host_len = 0;
+    req->sub_domain = NULL;
+    req->sub_domain_len = 0;
 
-    char *sub = strdup(host);
-    if (!sub) {
-        req->sub_domain = NULL;
-        return;
-    }
+    const char *host = get_header(req, "Host");
+    if (!host) return;
 
-    char *port = strchr(sub, ':');
-    if (port) *port = '\0';
+    const char *end = host;
+    while (*end && *end != ':') end++;
 
-    char *dot1 = strrchr(sub, '.');
-    if (!dot1) {
-        free(sub);
-        req->sub_domain = NULL;
-        return;
-    }
+    req->host = host;
+    req->host_len = end - host;
 
-    *dot1 = '\0';
-    char *dot2 = strchr(sub, '.');
-    if (dot2) {
-        *dot2 = '\0';
-        req->sub_domain = strdup(sub);
-    } else {
-        req->sub_domain = NULL;
-    }
+    const char *tld = end;
+    while (tld > host && *(tld - 1) != '.') tld--;
+    if (tld == host) return;
 
-    free(sub);
+    const char *dot = memchr(host, '.', (tld - 1) - host);
+    if (dot) {
+        req->sub_domain = host;
+        req->sub_domain_len = dot - host;
+    }
 }
 
 static int process_routes(int client_fd, http_req_t *req) {
-    for (route_t* r = server.route; r; r = r->next) {
-        if (strcmp(req->method, r->method) != 0) continue;
-        if (!match_route(req->path, r->path)) continue;
-
-        int subdomain_match = 0;
-        if (r->sub_domain == NULL && req->sub_domain == NULL) {
-            subdomain_match = 1;
-        } else if (r->sub_domain != NULL && req->sub_domain != NULL &&
-                   strcmp(r->sub_domain, req->sub_domain) == 0) {
-            subdomain_match = 1;
-        }
+    route_t *r = find_route(req);
+    if (!r) return 0;
 
-        if (!subdomain_match) continue;
+    if (r->ws) {
+        if (ws_upgrade(client_fd, req, r->ws) != 0) {
+            send_error_response(client_fd, ERR_BADREQ);
+        }
+        return 1;
+    }
 
-        get_wildcards(req, r);
-        r->callback(client_fd, req);
+    if (r->sse_channel) {
+        if (sse_subscribe(client_fd, r->sse_channel) != 0) {
+            send_error_response(client_fd, ERR_INTERR);
+            return 1;
+        }
+        if (r->callback) r->callback(client_fd, req);
         return 1;
     }
 
-    return 0;
+    if (r->cache && route_cache_handle(r, client_fd, req) == 0) return 1;
+
+    if (r->callback) r->callback(client_fd, req);
+    return 1;
 }
 
 static void handle_static_file(int client_fd, http_req_t *req) {
@@ -600,12 +664,29 @@ static void handle_static_file(int client_fd, http_req_t *req) {
         return;
     }
 
-    server_status_t file_result = serve_file(client_fd, req->path);
+    server_status_t file_result = serve_asset(client_fd, req, req->path);
+    if (file_result == SERVER_ERR_FILE) {
+        file_result = serve_file(client_fd, req->path);
+    }
     if (file_result != SERVER_OK) {
         send_error_response(client_fd, ERR_NOTFOUND);
     }
 }
 
+/*
+*   Routes a parsed request: handlers, then bundled assets and files. Also
+*   used by HTTP/2, which passes H2_STREAM_FD and captures the response.
+*/
+void dispatch_request(int client_fd, http_req_t *req) {
+    extract_subdomain(req);
+
+    int route_handled = process_routes(client_fd, req);
+
+    if (!route_handled) {
+        handle_static_file(client_fd, req);
+    }
+}
+
 static server_status_t read_full_body(int client_fd, http_req_t *req, buffer_t *buf) {
     char *content_len_header = get_header(req, "Content-Length");
     if (!content_len_header) {
@@ -649,28 +730,46 @@ static server_status_t read_full_body(int client_fd, http_req_t *req, buffer_t *
     return SERVER_OK;
 }
 
-static void cleanup_request(http_req_t *req, buffer_t *buf, client_con_t *conn, int client_fd, int should_close) {
+static void cleanup_request(http_req_t *req, buffer_t *buf, client_con_t *conn) {
     if (req) http_req_free(req);
     if (buf) release_buffer(buf);
-    if (conn) release_connection(conn);
-    if (should_close && client_fd >= 0) close(client_fd);
+    if (conn) conn_close(conn);
 }
 
 void handle_client(int client_fd) {
-    client_con_t* conn = NULL;
     buffer_t* request_buf = NULL;
     http_req_t req = {0};
     server_status_t status = SERVER_OK;
 
-    conn = get_connection(client_fd);
+    client_con_t *conn = conn_lookup(client_fd);
     if (!conn) {
         close(client_fd);
         return;
     }
 
+    if (conn->ws) {
+        ws_readable(conn);
+        return;
+    }
+
+    if (conn->h2) {
+        h2_readable(conn);
+        return;
+    }
+
+    if (conn->closing || conn->stream.active) {
+        /* the response is still being written, further input is discarded */
+        char discard[4096];
+        ssize_t n = recv(client_fd, discard, sizeof(discard), 0);
+        if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+            conn_close(conn);
+        }
+        return;
+    }
+
     request_buf = get_buffer(MAX_REQUEST_SIZE);
     if (!request_buf) {
-        cleanup_request(&req, NULL, conn, client_fd, 1);
+        cleanup_request(&req, NULL, conn);
         return;
     }
 
@@ -679,57 +778,50 @@ void handle_client(int client_fd) {
     if (bytes_received < 0) {
         if (errno == EAGAIN || errno == EWOULDBLOCK) {
             release_buffer(request_buf);
-            release_connection(conn);
             return;
         }
-        release_buffer(request_buf);
-        release_connection(conn);
-        close(client_fd);
+        cleanup_request(NULL, request_buf, conn);
         return;
     }
 
     if (bytes_received == 0) {
-        release_buffer(request_buf);
-        release_connection(conn);
-        close(client_fd);
+        cleanup_request(NULL, request_buf, conn);
         return;
     }
 
     request_buf->data[bytes_received] = '\0';
 
-    status = parse_http_request(request_buf->data, bytes_received, &req);
-    if (status != SERVER_OK) {
-        send_error_response(client_fd, ERR_BADREQ);
-        cleanup_request(&req, request_buf, conn, client_fd, 1);
+    if (h2_is_preface(request_buf->data, bytes_received)) {
+        h2_start(conn, request_buf->data, bytes_received);
+        release_buffer(request_buf);
         return;
     }
 
-    LOG("request: %s %s", req.method, req.path);
+    conn->dispatching = 1;
 
-    status = read_full_body(client_fd, &req, request_buf);
+    status = parse_http_request(request_buf->data, bytes_received, &req);
     if (status != SERVER_OK) {
         send_error_response(client_fd, ERR_BADREQ);
-        cleanup_request(&req, request_buf, conn, client_fd, 1);
-        return;
+    } else {
+        LOG("request: %s %s", req.method, req.path);
+        status = read_full_body(client_fd, &req, request_buf);
+        if (status != SERVER_OK) {
+            send_error_response(client_fd, ERR_BADREQ);
+        }
     }
 
     release_buffer(request_buf);
     request_buf = NULL;
 
-    extract_subdomain(&req);
-
-    int route_handled = process_routes(client_fd, &req);
-
-    if (!route_handled) {
-        handle_static_file(client_fd, &req);
+    if (status == SERVER_OK && h2_upgrade(conn, &req) != 0) {
+        dispatch_request(client_fd, &req);
     }
 
+    conn->dispatching = 0;
     conn->keepalive_requests++;
-    conn->last_activity = time(NULL);
 
     http_req_free(&req);
-    release_connection(conn);
-    close(client_fd);
+    conn_finish(conn);
 }
 
 void shutdown_pools(void) {
@@ -741,20 +833,7 @@ void shutdown_pools(void) {
         curr_buf = next;
     }
 
-    client_con_t *curr_conn = conn_pool.free_connections;
-    while (curr_conn) {
-        client_con_t *next = curr_conn->next;
-        free(curr_conn);
-        curr_conn = next;
-    }
-
-    curr_conn = conn_pool.active_connections;
-    while (curr_conn) {
-        client_con_t *next = curr_conn->next;
-        close(curr_conn->fd);
-        free(curr_conn);
-        curr_conn = next;
-    }
+    shutdown_connections();
 }
 
 void handle_sigint(int sig) {
@@ -765,27 +844,12 @@ void handle_sigint(int sig) {
     db_close();
     free_routes();
     shutdown_pools();
+    sse_free_channels();
+    cx_include_clear();
+    cx_fragment_clear();
     exit(0);
 }
 
-void cleanup_expired_connections() {
-    time_t now = time(NULL);
-    client_con_t** current = &conn_pool.active_connections;
-
-    while (*current) {
-        client_con_t* conn = *current;
-        if (now - conn->last_activity > KEEPALIVE_TIMEOUT) {
-            *current = conn->next;
-            close(conn->fd);
-            conn->next = conn_pool.free_connections;
-            conn_pool.free_connections = conn;
-            conn_pool.active_count--;
-        } else {
-            current = &conn->next;
-        }
-    }
-}
-
 void server_run(void (*load_routes)()) {
     signal(SIGINT, handle_sigint);
     signal(SIGPIPE, SIG_IGN);
@@ -805,7 +869,7 @@ void server_run(void (*load_routes)()) {
     // db_exec("CREATE TABLE IF NOT EXISTS games (id TEXT PRIMARY KEY NOT NULL, created_at DATE NOT NULL, updated_at DATE, name TEXT NOT NULL, difficulty TEXT NOT NULL, game_state TEXT NOT NULL, board TEXT NOT NULL);", NULL, 0, NULL);
     // db_execute("DELETE FROM games;", NULL, 0);
 
-    time_t last_cleanup = time(NULL);
+    time_t last_cleanup = clock_now();
 
     const int PORT = get_port();
     struct epoll_event ev, events[MAX_EVENTS];
@@ -838,6 +902,7 @@ void server_run(void (*load_routes)()) {
         close(sckt);
         handle_critical_error("epoll_create1 failed.", epoll_fd);
     }
+    server.epoll_fd = epoll_fd;
 
     ev.events = EPOLLIN;
     ev.data.fd = sckt;
@@ -846,16 +911,18 @@ void server_run(void (*load_routes)()) {
 
     LOG("Server running on http://0.0.0.0:%d", PORT);
     (*load_routes)();
+    route_table_prerender();
     print_routes();
 
     while (1) {
-        time_t now = time(NULL);
+        time_t now = clock_now();
         if (now - last_cleanup > 60) {
             cleanup_expired_connections();
             last_cleanup = now;
         }
 
         int num_fds = epoll_wait(epoll_fd, events, MAX_EVENTS, 1000);
+        clock_update();
         if(num_fds < 0) {
             if (errno == EINTR) continue;
             handle_critical_error("epoll wait failed", sckt);
@@ -875,17 +942,39 @@ void server_run(void (*load_routes)()) {
                     continue;
                 }
 
+                client_con_t *conn = get_connection(client_fd);
+                if (!conn) {
+                    close(client_fd);
+                    continue;
+                }
+
                 ev.events = EPOLLIN; //| EPOLLET;
                 ev.data.fd = client_fd;
                 result = epoll_ctl(epoll_fd, EPOLL_CTL_ADD, client_fd, &ev);
                 if(result < 0) {
                     LOG("epoll_ctl failed.");
-                    close(client_fd);
+                    conn_close(conn);
                 }
             }
             else{
                 int client_fd = events[i].data.fd;
-                handle_client(client_fd);
+                client_con_t *conn = conn_lookup(client_fd);
+                if (!conn) {
+                    close(client_fd);
+                    continue;
+                }
+
+                if (events[i].events & (EPOLLERR | EPOLLHUP)) {
+                    conn_close(conn);
+                    continue;
+                }
+                if (events[i].events & EPOLLOUT) {
+                    conn_writable(conn);
+                    if (conn_lookup(client_fd) != conn) continue;
+                }
+                if (events[i].events & EPOLLIN) {
+                    handle_client(client_fd);
+                }
             }
         }
     }
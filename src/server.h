@@ -1,6 +1,8 @@
 #ifndef SERVER_H
 #define SERVER_H
 
+#include <sys/types.h>
+#include <sys/uio.h>
 #include <time.h>
 
 #define BUFFER_SIZE (1024 * 1024)
@@ -14,14 +16,18 @@
 #define MAX_HEADER_COUNT 32
 #define MAX_HEADER_LENGTH 2048
 
-#define CONNECTION_POOL_SIZE 1000
+#define CONNECTION_POOL_SIZE 65536
 #define BUFFER_POOL_SIZE 100
 #define SENDFILE_CHUNK_SIZE (64 * 1024)
 #define KEEPALIVE_TIMEOUT 30
 #define MAX_KEEPALIVE_REQUESTS 100
+#define MAX_ROUTE_PARAMS 16
+#define STREAM_HIGH_WATERMARK (256 * 1024)
+#define STREAM_LOW_WATERMARK (64 * 1024)
 
 typedef enum
 {
+    INFO_SWITCHING = 101,
     OK_OK = 200,
     OK_CREATED = 201,
     OK_NOCONTENT = 204,
@@ -59,10 +65,77 @@ typedef struct {
     size_t count;
 } buffer_pool_t;
 
+/*
+*   Immutable bytes queued on many connections at once (SSE events). The
+*   last queue to release it frees it.
+*/
+typedef struct shared_buf {
+    size_t refs;
+    size_t len;
+    char data[];
+} shared_buf_t;
+
+/*
+*   Bytes a client socket would not take yet. Memory segments own their
+*   data unless shared is set; a segment with file_fd >= 0 is a file range
+*   sent with sendfile.
+*/
+typedef struct out_seg {
+    shared_buf_t *shared;
+    char *data;
+    size_t len;
+    size_t off;
+    int file_fd;
+    off_t file_off;
+    struct out_seg *next;
+} out_seg_t;
+
+/*
+*   A file range sent while a capture kept files. pos is the offset into
+*   the captured bytes where the range belongs, fd is a duplicate owned by
+*   whoever ends the capture.
+*/
+typedef struct {
+    size_t pos;
+    int fd;
+    off_t offset;
+    size_t len;
+} captured_file_t;
+
+struct client_con;
+struct ws_conn;
+struct h2_conn;
+struct ws_handler;
+
+/*
+*   A chunked response that outlives its handler. on_drain is called once
+*   the output queue falls below STREAM_LOW_WATERMARK after a write
+*   reported backpressure, on_close when the connection goes away.
+*/
+typedef struct stream {
+    struct client_con *conn;
+    int active;
+    int paused;
+    void (*on_drain)(struct stream *stream, void *ctx);
+    void (*on_close)(struct stream *stream, void *ctx);
+    void *ctx;
+    size_t slot;
+} stream_t;
+
 typedef struct client_con {
     int fd;
     time_t last_activity;
     int keepalive_requests;
+    int dispatching;
+    int closing;
+    int want_write;
+    out_seg_t *out_head;
+    out_seg_t *out_tail;
+    size_t out_bytes;
+    stream_t stream;
+    struct ws_conn *ws;
+    struct h2_conn *h2;
+    struct client_con* prev;
     struct client_con* next;
 } client_con_t;
 
@@ -81,15 +154,35 @@ typedef struct
 
 typedef struct
 {
-    char *sub_domain;
+    const char *data;
+    size_t len;
+} slice_t;
+
+typedef struct
+{
+    unsigned short offset;
+    unsigned short len;
+} route_param_t;
+
+struct route;
+struct route_cache;
+
+typedef struct
+{
+    const char *host;
+    size_t host_len;
+    const char *sub_domain;
+    size_t sub_domain_len;
     char *method;
     char *path;
+    char *query;
     char *version;
     header_t *headers;
     int headers_len;
     char *body;
-    char wildcards[16][64];
-    int wildcard_num;
+    const struct route *route;
+    route_param_t params[MAX_ROUTE_PARAMS];
+    int param_count;
 } http_req_t;
 
 typedef struct route
@@ -97,6 +190,11 @@ typedef struct route
     char *sub_domain;
     char method[16];
     char path[265];
+    char *param_names[MAX_ROUTE_PARAMS];
+    int param_count;
+    struct route_cache *cache;
+    char *sse_channel;
+    const struct ws_handler *ws;
     void (*callback)(int client_fd, http_req_t *req);
     struct route *next;
 } route_t;
@@ -110,15 +208,32 @@ typedef struct
 typedef struct
 {
     int sckt;
+    int epoll_fd;
     route_t *route;
 } server_t;
 
-void free_http_req(http_req_t *req);
+void http_req_free(http_req_t *req);
 server_status_t parse_http_request(const char *buffer, size_t bytes, http_req_t *http_req);
 server_status_t serve_file(int client_fd, const char *path);
+server_status_t serve_asset(int client_fd, http_req_t *req, const char *path);
 void handle_client(int client_fd);
+void dispatch_request(int client_fd, http_req_t *req);
 void handle_sigint(int sig);
 
+server_status_t send_raw(int client_fd, const void *data, size_t len);
+server_status_t send_iov(int client_fd, struct iovec *iov, int iov_count);
+server_status_t send_file_range(int client_fd, int file_fd, off_t offset, size_t len);
+void response_capture_begin(int client_fd);
+char *response_capture_end(size_t *len);
+void response_capture_keep_files(void);
+char *response_capture_end_files(size_t *len, captured_file_t **files, int *files_len);
+void response_capture_invalidate(int client_fd);
+int response_capture_active(int client_fd);
+
+response_info_t get_response_info(response_status_t status);
+slice_t get_status_line(response_status_t status);
+void send_error_response(int client_fd, response_status_t status);
+void send_text(int client_fd, response_status_t status, const char *content_type, const char *str);
 void send_json_response(int client_fd, response_status_t status, const char *json);
 void send_string(int client_fd, char *str);
 void send_plain(int client_fd, char *str);
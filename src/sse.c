@@ -0,0 +1,245 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "conn.h"
+#include "response.h"
+#include "server.h"
+#include "sse.h"
+#include "utils.h"
+
+#define SSE_TABLE_MIN 16
+
+typedef struct {
+    char *name;
+    unsigned long hash;
+    client_con_t **subscribers;
+    size_t count;
+    size_t cap;
+} sse_channel_t;
+
+static sse_channel_t **channels = NULL;
+static size_t channels_cap = 0;
+static size_t channels_len = 0;
+
+static unsigned long hash_name(const char *name) {
+    unsigned long hash = 14695981039346656037UL;
+    for (; *name; name++) {
+        hash ^= (unsigned char)*name;
+        hash *= 1099511628211UL;
+    }
+    return hash;
+}
+
+static sse_channel_t **channel_slot(sse_channel_t **table, size_t cap, const char *name, unsigned long hash) {
+    size_t i = hash & (cap - 1);
+    while (table[i] && (table[i]->hash != hash || strcmp(table[i]->name, name) != 0)) {
+        i = (i + 1) & (cap - 1);
+    }
+    return &table[i];
+}
+
+static int channels_grow(void) {
+    size_t cap = channels_cap ? channels_cap * 2 : SSE_TABLE_MIN;
+    sse_channel_t **table = calloc(cap, sizeof(*table));
+    if (!table) return -1;
+
+    for (size_t i = 0; i < channels_cap; i++) {
+        if (channels[i]) *channel_slot(table, cap, channels[i]->name, channels[i]->hash) = channels[i];
+    }
+    free(channels);
+    channels = table;
+    channels_cap = cap;
+    return 0;
+}
+
+static sse_channel_t *channel_find(const char *name) {
+    if (!channels) return NULL;
+    return *channel_slot(channels, channels_cap, name, hash_name(name));
+}
+
+static sse_channel_t *channel_get(const char *name) {
+    sse_channel_t *ch = channel_find(name);
+    if (ch) return ch;
+
+    if ((channels_len + 1) * 4 > channels_cap * 3 && channels_grow() != 0) return NULL;
+
+    ch = calloc(1, sizeof(sse_channel_t));
+    if (!ch) return NULL;
+    ch->name = strdup(name);
+    if (!ch->name) {
+        free(ch);
+        return NULL;
+    }
+    ch->hash = hash_name(name);
+
+    *channel_slot(channels, channels_cap, name, ch->hash) = ch;
+    channels_len++;
+    return ch;
+}
+
+static void sse_on_close(stream_t *stream, void *ctx) {
+    sse_channel_t *ch = ctx;
+    client_con_t *last = ch->subscribers[--ch->count];
+    ch->subscribers[stream->slot] = last;
+    last->stream.slot = stream->slot;
+}
+
+/*
+*   Answers the request with an event stream and parks the connection on
+*   channel. The body is delimited by closing the connection.
+*/
+int sse_subscribe(int client_fd, const char *channel) {
+    client_con_t *conn = conn_lookup(client_fd);
+    if (!conn || conn->stream.active) return -1;
+
+    sse_channel_t *ch = channel_get(channel);
+    if (!ch) return -1;
+
+    if (ch->count == ch->cap) {
+        size_t cap = ch->cap ? ch->cap * 2 : SSE_TABLE_MIN;
+        client_con_t **subscribers = realloc(ch->subscribers, cap * sizeof(*subscribers));
+        if (!subscribers) return -1;
+        ch->subscribers = subscribers;
+        ch->cap = cap;
+    }
+
+    response_t resp;
+    resp_init(&resp, OK_OK);
+    resp_header(&resp, "Content-Type", "text/event-stream");
+    resp_header(&resp, "Cache-Control", "no-cache");
+    if (resp_send_head(client_fd, &resp) != SERVER_OK) return -1;
+
+    stream_t *stream = &conn->stream;
+    stream->active = 1;
+    stream->paused = 0;
+    stream->on_drain = NULL;
+    stream->on_close = sse_on_close;
+    stream->ctx = ch;
+    stream->slot = ch->count;
+    ch->subscribers[ch->count++] = conn;
+    return 0;
+}
+
+/*
+*   Returns the length of the line break at p: 2 for "\r\n", 1 for a bare
+*   "\r" or "\n", which also end a line in an event stream.
+*/
+static size_t line_break_len(const char *p) {
+    return p[0] == '\r' && p[1] == '\n' ? 2 : 1;
+}
+
+/*
+*   Serializes an event. Every line of data becomes its own "data:" field.
+*   Returns NULL for event names containing a line break, which would let
+*   the caller forge fields.
+*/
+static shared_buf_t *format_event(const char *event, const char *data) {
+    size_t len = 1;
+    if (event) {
+        if (event[strcspn(event, "\r\n")]) return NULL;
+        len += sizeof("event: \n") - 1 + strlen(event);
+    }
+
+    size_t lines = 1;
+    for (const char *p = data + strcspn(data, "\r\n"); *p; p += strcspn(p, "\r\n")) {
+        p += line_break_len(p);
+        lines++;
+    }
+    len += lines * (sizeof("data: \n") - 1) + strlen(data);
+
+    shared_buf_t *buf = shared_buf_create(len);
+    if (!buf) return NULL;
+
+    char *dst = buf->data;
+    if (event) {
+        memcpy(dst, "event: ", 7);
+        dst += 7;
+        size_t event_len = strlen(event);
+        memcpy(dst, event, event_len);
+        dst += event_len;
+        *dst++ = '\n';
+    }
+
+    const char *line = data;
+    while (1) {
+        size_t line_len = strcspn(line, "\r\n");
+        memcpy(dst, "data: ", 6);
+        dst += 6;
+        memcpy(dst, line, line_len);
+        dst += line_len;
+        *dst++ = '\n';
+        if (!line[line_len]) break;
+        line += line_len + line_break_len(line + line_len);
+    }
+    *dst++ = '\n';
+
+    buf->len = dst - buf->data;
+    return buf;
+}
+
+/*
+*   Sends an event to one subscriber, e.g. the current state right after
+*   sse_subscribe.
+*/
+int sse_send(int client_fd, const char *event, const char *data) {
+    client_con_t *conn = conn_lookup(client_fd);
+    if (!conn || !conn->stream.active || conn->stream.on_close != sse_on_close) return -1;
+
+    shared_buf_t *buf = format_event(event, data);
+    if (!buf) return -1;
+
+    server_status_t result = conn_send_shared(conn, buf);
+    shared_buf_release(buf);
+    return result == SERVER_OK ? 0 : -1;
+}
+
+int sse_broadcast(const char *channel, const char *data) {
+    return sse_broadcast_event(channel, NULL, data);
+}
+
+/*
+*   Returns the number of subscribers the event was written or queued for,
+*   -1 if it could not be serialized. Subscribers are walked from the end
+*   because closing one moves the last subscriber into its slot.
+*/
+int sse_broadcast_event(const char *channel, const char *event, const char *data) {
+    sse_channel_t *ch = channel_find(channel);
+    if (!ch || ch->count == 0) return 0;
+
+    shared_buf_t *buf = format_event(event, data);
+    if (!buf) return -1;
+
+    int delivered = 0;
+    for (size_t i = ch->count; i-- > 0;) {
+        client_con_t *conn = ch->subscribers[i];
+        if (conn_send_shared(conn, buf) != SERVER_OK || conn->out_bytes > STREAM_HIGH_WATERMARK) {
+            conn_close(conn);
+            continue;
+        }
+        delivered++;
+    }
+
+    shared_buf_release(buf);
+    return delivered;
+}
+
+size_t sse_subscribers(const char *channel) {
+    sse_channel_t *ch = channel_find(channel);
+    return ch ? ch->count : 0;
+}
+
+/*
+*   Connections must be closed first, closing one unsubscribes it.
+*/
+void sse_free_channels(void) {
+    for (size_t i = 0; i < channels_cap; i++) {
+        if (!channels[i]) continue;
+        free(channels[i]->subscribers);
+        free(channels[i]->name);
+        free(channels[i]);
+    }
+    free(channels);
+    channels = NULL;
+    channels_cap = 0;
+    channels_len = 0;
+}
@@ -0,0 +1,21 @@
+#ifndef SSE_H
+#define SSE_H
+
+#include <stddef.h>
+
+/*
+*   Server-Sent Events. A subscribed connection is parked in epoll with
+*   no buffers until something is published on its channel. A broadcast
+*   is serialized once into a shared buffer that every subscriber's output
+*   queue references; subscribers that fall STREAM_HIGH_WATERMARK bytes
+*   behind are disconnected and left to reconnect.
+*/
+
+int sse_subscribe(int client_fd, const char *channel);
+int sse_send(int client_fd, const char *event, const char *data);
+int sse_broadcast(const char *channel, const char *data);
+int sse_broadcast_event(const char *channel, const char *event, const char *data);
+size_t sse_subscribers(const char *channel);
+void sse_free_channels(void);
+
+#endif
@@ -3,6 +3,7 @@
 #include <time.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 #include <stdarg.h>
 #include <stdio.h>
 #include <sys/time.h>
@@ -13,14 +14,55 @@
 #include "server.h"
 
 
-void logg(long line, const char *file, const char *func, const char *format, ...) {
-    time_t raw_time;
-    struct tm *time_info;
-    char time_buffer[20];
+/*
+*   Wall clock cached at one second resolution. The Date header and the log
+*   timestamp are only reformatted when the second changes. The event loop
+*   calls clock_update after every epoll_wait; everything else, logg
+*   included, only reads the cached values.
+*/
+typedef struct {
+    time_t now;
+    char date_header[48];
+    size_t date_header_len;
+    char log_time[20];
+} cached_clock_t;
+
+static cached_clock_t cached_clock = {0};
 
-    time(&raw_time);
-    time_info = localtime(&raw_time);
-    strftime(time_buffer, sizeof(time_buffer), "%Y-%m-%d %H:%M:%S", time_info);
+void clock_update(void) {
+    time_t now = time(NULL);
+    if (now == cached_clock.now) return;
+    cached_clock.now = now;
+
+    struct tm tm_info;
+    gmtime_r(&now, &tm_info);
+    cached_clock.date_header_len = strftime(cached_clock.date_header, sizeof(cached_clock.date_header),
+                                            "Date: %a, %d %b %Y %H:%M:%S GMT\r\n", &tm_info);
+
+    localtime_r(&now, &tm_info);
+    strftime(cached_clock.log_time, sizeof(cached_clock.log_time), "%Y-%m-%d %H:%M:%S", &tm_info);
+}
+
+time_t clock_now(void) {
+    if (!cached_clock.now) clock_update();
+    return cached_clock.now;
+}
+
+/*
+*   "Date: <IMF-fixdate>\r\n", ready to be written as is.
+*/
+slice_t clock_date_header(void) {
+    if (!cached_clock.now) clock_update();
+    return (slice_t){cached_clock.date_header, cached_clock.date_header_len};
+}
+
+const char *clock_log_time(void) {
+    if (!cached_clock.now) clock_update();
+    return cached_clock.log_time;
+}
+
+void logg(long line, const char *file, const char *func, const char *format, ...) {
+    const char *time_buffer = clock_log_time();
 
     FILE *log_file = fopen("log.txt", "a");
     if (!log_file) {
@@ -96,6 +138,11 @@ const char *get_public_dir(void){
     return dir ? dir : "./public";
 }
 
+int get_embed_assets(void){
+    const char *embed = getenv("EMBED_ASSETS");
+    return embed ? strtol(embed, NULL, 10) != 0 : 1;
+}
+
 /*
 *   Pseudo random number generator by Terry A. Davis
 */
@@ -134,7 +181,7 @@ void generate_id(char *uuid) {
 
 
 void get_current_time(char *buffer, size_t size, long offset) {
-    time_t now = time(NULL) + offset;
+    time_t now = clock_now() + offset;
     struct tm tm_info;
     void *result = gmtime_r(&now, &tm_info);
     if(!result) LOG("gmtime_r failed");
@@ -144,19 +191,93 @@ void get_current_time(char *buffer, size_t size, long offset) {
 
 char *get_header(http_req_t *request, const char *name) {
     for (int i = 0; i < request->headers_len; i++) {
-        if (strcmp(request->headers[i].name, name) == 0) {
+        if (strcasecmp(request->headers[i].name, name) == 0) {
             return request->headers[i].value;
         }
     }
     return NULL;
 }
 
+/*
+*   Case-insensitive search for token in a comma separated header value.
+*/
+int header_has_token(const char *value, const char *token) {
+    size_t token_len = strlen(token);
+    while (*value) {
+        while (*value == ' ' || *value == '\t' || *value == ',') value++;
+        const char *end = value;
+        while (*end && *end != ',') end++;
+        const char *trim = end;
+        while (trim > value && (trim[-1] == ' ' || trim[-1] == '\t')) trim--;
+        if ((size_t)(trim - value) == token_len && strncasecmp(value, token, token_len) == 0) return 1;
+        value = end;
+    }
+    return 0;
+}
+
+/*
+*   Returns the raw (not percent decoded) value of a query parameter as a
+*   slice of request->query.
+*/
+slice_t get_query_param(const http_req_t *request, const char *name) {
+    size_t name_len = strlen(name);
+    const char *p = request->query;
+
+    while (p && *p) {
+        const char *end = strchr(p, '&');
+        if (!end) end = p + strlen(p);
+
+        if (strncmp(p, name, name_len) == 0 && (p[name_len] == '=' || p + name_len == end)) {
+            const char *value = p + name_len;
+            if (*value == '=') value++;
+            return (slice_t){value, end - value};
+        }
+
+        p = *end ? end + 1 : end;
+    }
+
+    return (slice_t){NULL, 0};
+}
+
+/*
+*   Returns the q-value of coding in an Accept-Encoding value, falling back
+*   to the one of "*", or -1 when neither is listed. "br;q=0" means the
+*   client refuses br.
+*/
+static double encoding_q(const char *value, const char *coding) {
+    size_t coding_len = strlen(coding);
+    double q = -1, any = -1;
+
+    while (*value) {
+        while (*value == ' ' || *value == '\t' || *value == ',') value++;
+        const char *end = value + strcspn(value, ",");
+        const char *name_end = value + strcspn(value, ",; \t");
+
+        double entry = 1;
+        for (const char *p = name_end + strcspn(name_end, ",;"); *p == ';';) {
+            p++;
+            while (*p == ' ' || *p == '\t') p++;
+            if ((*p == 'q' || *p == 'Q') && p[1] == '=') entry = strtod(p + 2, NULL);
+            p += strcspn(p, ",;");
+        }
+
+        size_t name_len = name_end - value;
+        if (name_len == coding_len && strncasecmp(value, coding, coding_len) == 0) q = entry;
+        else if (name_len == 1 && *value == '*') any = entry;
+        value = end;
+    }
+
+    return q >= 0 ? q : any;
+}
+
 int accepts_gzip(http_req_t *req){
     char *val = get_header(req, "Accept-Encoding");
-    if(!val) return 0;
-    char *s = strstr(val, "gzip");
-    if(!s) return 0;
-    return 1;
+    return val && encoding_q(val, "gzip") > 0;
+}
+
+int accepts_brotli(http_req_t *req){
+    char *val = get_header(req, "Accept-Encoding");
+    return val && encoding_q(val, "br") > 0;
 }
 
 char* sanitize_path(const char* path) {
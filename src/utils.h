@@ -1,6 +1,8 @@
 #ifndef UTILS_H
 #define UTILS_H
 
+#include <time.h>
+
 #include "server.h"
 #include "json/json.h"
 
@@ -14,13 +16,23 @@ int get_port(void);
 const char *get_db_password(void);
 const char *get_routes_dir(void);
 const char *get_public_dir(void);
+int get_embed_assets(void);
 
 
 char *get_header(http_req_t *request, const char *name);
+int header_has_token(const char *value, const char *token);
+slice_t get_query_param(const http_req_t *request, const char *name);
+int accepts_gzip(http_req_t *req);
+int accepts_brotli(http_req_t *req);
 
 void generate_id(char *buffer);
 void get_current_time(char *buffer, size_t size, long offset);
 
+void clock_update(void);
+time_t clock_now(void);
+slice_t clock_date_header(void);
+const char *clock_log_time(void);
+
 char *compress_data(const char *json, size_t json_len, size_t *compressed_len);
 
 int validate_http_method(const char* method);
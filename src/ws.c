@@ -0,0 +1,555 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#include "conn.h"
+#include "response.h"
+#include "server.h"
+#include "utils.h"
+#include "ws.h"
+
+#define WS_GUID "258EAFA5-E914-47DA-95CA-C5AB0DC85B11"
+#define WS_KEEP_MSG_BUFFER (64 * 1024)
+
+/*
+*   SHA-1 (FIPS 180-4), only used for Sec-WebSocket-Accept.
+*/
+typedef struct {
+    uint32_t h[5];
+    uint64_t len;
+    unsigned char block[64];
+    size_t block_len;
+} sha1_t;
+
+#define ROL32(x, n) (((x) << (n)) | ((x) >> (32 - (n))))
+
+static void sha1_block(sha1_t *ctx, const unsigned char *block) {
+    uint32_t w[80];
+    for (int i = 0; i < 16; i++) {
+        w[i] = (uint32_t)block[i * 4] << 24 | (uint32_t)block[i * 4 + 1] << 16 |
+               (uint32_t)block[i * 4 + 2] << 8 | block[i * 4 + 3];
+    }
+    for (int i = 16; i < 80; i++) {
+        w[i] = ROL32(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+    }
+
+    uint32_t a = ctx->h[0], b = ctx->h[1], c = ctx->h[2], d = ctx->h[3], e = ctx->h[4];
+    for (int i = 0; i < 80; i++) {
+        uint32_t f, k;
+        if (i < 20) {
+            f = (b & c) | (~b & d);
+            k = 0x5A827999;
+        } else if (i < 40) {
+            f = b ^ c ^ d;
+            k = 0x6ED9EBA1;
+        } else if (i < 60) {
+            f = (b & c) | (b & d) | (c & d);
+            k = 0x8F1BBCDC;
+        } else {
+            f = b ^ c ^ d;
+            k = 0xCA62C1D6;
+        }
+        uint32_t t = ROL32(a, 5) + f + e + k + w[i];
+        e = d;
+        d = c;
+        c = ROL32(b, 30);
+        b = a;
+        a = t;
+    }
+
+    ctx->h[0] += a;
+    ctx->h[1] += b;
+    ctx->h[2] += c;
+    ctx->h[3] += d;
+    ctx->h[4] += e;
+}
+
+static void sha1_init(sha1_t *ctx) {
+    ctx->h[0] = 0x67452301;
+    ctx->h[1] = 0xEFCDAB89;
+    ctx->h[2] = 0x98BADCFE;
+    ctx->h[3] = 0x10325476;
+    ctx->h[4] = 0xC3D2E1F0;
+    ctx->len = 0;
+    ctx->block_len = 0;
+}
+
+static void sha1_update(sha1_t *ctx, const void *data, size_t len) {
+    const unsigned char *p = data;
+    ctx->len += len;
+    while (len > 0) {
+        size_t take = 64 - ctx->block_len;
+        if (take > len) take = len;
+        memcpy(ctx->block + ctx->block_len, p, take);
+        ctx->block_len += take;
+        p += take;
+        len -= take;
+        if (ctx->block_len == 64) {
+            sha1_block(ctx, ctx->block);
+            ctx->block_len = 0;
+        }
+    }
+}
+
+static void sha1_final(sha1_t *ctx, unsigned char digest[20]) {
+    uint64_t bits = ctx->len * 8;
+    unsigned char pad = 0x80;
+    sha1_update(ctx, &pad, 1);
+    pad = 0;
+    while (ctx->block_len != 56) sha1_update(ctx, &pad, 1);
+
+    unsigned char length[8];
+    for (int i = 0; i < 8; i++) length[i] = bits >> (56 - i * 8);
+    sha1_update(ctx, length, 8);
+
+    for (int i = 0; i < 5; i++) {
+        digest[i * 4] = ctx->h[i] >> 24;
+        digest[i * 4 + 1] = ctx->h[i] >> 16;
+        digest[i * 4 + 2] = ctx->h[i] >> 8;
+        digest[i * 4 + 3] = ctx->h[i];
+    }
+}
+
+static size_t base64_encode(const unsigned char *src, size_t len, char *dst) {
+    static const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    size_t out = 0;
+    for (size_t i = 0; i < len; i += 3) {
+        uint32_t v = (uint32_t)src[i] << 16;
+        if (i + 1 < len) v |= (uint32_t)src[i + 1] << 8;
+        if (i + 2 < len) v |= src[i + 2];
+        dst[out++] = alphabet[(v >> 18) & 63];
+        dst[out++] = alphabet[(v >> 12) & 63];
+        dst[out++] = i + 1 < len ? alphabet[(v >> 6) & 63] : '=';
+        dst[out++] = i + 2 < len ? alphabet[v & 63] : '=';
+    }
+    dst[out] = '\0';
+    return out;
+}
+
+/*
+*   XORs the payload with the masking key 16 bytes per step. Every step
+*   starts at a multiple of 4, so the repeated key stays in phase.
+*/
+static void ws_unmask(unsigned char *data, size_t len, const unsigned char key[4]) {
+    uint32_t key32;
+    memcpy(&key32, key, 4);
+    uint64_t key64 = (uint64_t)key32 << 32 | key32;
+
+    size_t i = 0;
+    for (; i + 16 <= len; i += 16) {
+        uint64_t a, b;
+        memcpy(&a, data + i, 8);
+        memcpy(&b, data + i + 8, 8);
+        a ^= key64;
+        b ^= key64;
+        memcpy(data + i, &a, 8);
+        memcpy(data + i + 8, &b, 8);
+    }
+    if (i + 8 <= len) {
+        uint64_t a;
+        memcpy(&a, data + i, 8);
+        a ^= key64;
+        memcpy(data + i, &a, 8);
+        i += 8;
+    }
+    for (; i < len; i++) data[i] ^= key[i & 3];
+}
+
+static int utf8_valid(const unsigned char *s, size_t len) {
+    size_t i = 0;
+    while (i < len) {
+        if (i + 8 <= len) {
+            uint64_t chunk;
+            memcpy(&chunk, s + i, 8);
+            if ((chunk & 0x8080808080808080ULL) == 0) {
+                i += 8;
+                continue;
+            }
+        }
+
+        unsigned char c = s[i];
+        if (c < 0x80) {
+            i++;
+            continue;
+        }
+
+        int extra;
+        unsigned char lo = 0x80, hi = 0xBF;
+        if (c >= 0xC2 && c <= 0xDF) {
+            extra = 1;
+        } else if (c >= 0xE0 && c <= 0xEF) {
+            extra = 2;
+            if (c == 0xE0) lo = 0xA0;
+            if (c == 0xED) hi = 0x9F;
+        } else if (c >= 0xF0 && c <= 0xF4) {
+            extra = 3;
+            if (c == 0xF0) lo = 0x90;
+            if (c == 0xF4) hi = 0x8F;
+        } else {
+            return 0;
+        }
+
+        if (i + extra >= len) return 0;
+        if (s[i + 1] < lo || s[i + 1] > hi) return 0;
+        for (int k = 2; k <= extra; k++) {
+            if ((s[i + k] & 0xC0) != 0x80) return 0;
+        }
+        i += extra + 1;
+    }
+    return 1;
+}
+
+static void ws_release(ws_t *ws) {
+    client_con_t *conn = ws->conn;
+    conn->ws = NULL;
+
+    if (ws->handler->on_close) {
+        ws->handler->on_close(ws, ws->close_code ? ws->close_code : 1006);
+    }
+    if (ws->buf != ws->inline_buf) free(ws->buf);
+    free(ws->msg);
+    free(ws);
+}
+
+static void ws_stream_closed(stream_t *stream, void *ctx) {
+    (void)stream;
+    ws_release(ctx);
+}
+
+/*
+*   Ends the session after a close frame went out: the connection stops
+*   reading and closes once its queue is written.
+*/
+static void ws_finish(ws_t *ws) {
+    client_con_t *conn = ws->conn;
+    ws_release(ws);
+    conn->stream.active = 0;
+    conn_finish(conn);
+}
+
+int ws_send(ws_t *ws, ws_opcode_t opcode, const char *data, size_t len) {
+    if (!ws || ws->close_sent) return -1;
+
+    unsigned char head[10];
+    size_t head_len;
+    head[0] = 0x80 | opcode;
+    if (len < 126) {
+        head[1] = len;
+        head_len = 2;
+    } else if (len <= 0xFFFF) {
+        head[1] = 126;
+        head[2] = len >> 8;
+        head[3] = len;
+        head_len = 4;
+    } else {
+        head[1] = 127;
+        for (int i = 0; i < 8; i++) head[2 + i] = (uint64_t)len >> (56 - i * 8);
+        head_len = 10;
+    }
+
+    struct iovec iov[2] = {
+        {head, head_len},
+        {(void *)data, len}
+    };
+    if (send_iov(ws->conn->fd, iov, len ? 2 : 1) != SERVER_OK) return -1;
+
+    return ws->conn->out_bytes > STREAM_HIGH_WATERMARK;
+}
+
+int ws_send_text(ws_t *ws, const char *text) {
+    return ws_send(ws, WS_TEXT, text, strlen(text));
+}
+
+/*
+*   Sends a close frame and ends the session. Inside a callback of the same
+*   connection the teardown waits until the current read is processed.
+*/
+void ws_close(ws_t *ws, int code, const char *reason) {
+    if (!ws || ws->close_sent) return;
+
+    char payload[125];
+    size_t len = 0;
+    if (code) {
+        payload[0] = code >> 8;
+        payload[1] = code;
+        len = 2;
+        if (reason) {
+            size_t reason_len = strlen(reason);
+            if (reason_len > sizeof(payload) - 2) reason_len = sizeof(payload) - 2;
+            memcpy(payload + 2, reason, reason_len);
+            len += reason_len;
+        }
+    }
+
+    ws_send(ws, WS_CLOSE, len ? payload : NULL, len);
+    ws->close_sent = 1;
+    ws->finished = 1;
+    if (!ws->close_code) ws->close_code = code ? code : 1005;
+    if (!ws->parsing) ws_finish(ws);
+}
+
+static int protocol_error(ws_t *ws, int code) {
+    ws_close(ws, code, NULL);
+    return -1;
+}
+
+/*
+*   Close codes a peer may send (RFC 6455 section 7.4 and the IANA
+*   registry). 1005, 1006 and 1015 are reserved for reporting and never go
+*   on the wire, 1004 and 1016-2999 are unassigned.
+*/
+static int close_code_valid(int code) {
+    if (code >= 1000 && code <= 1003) return 1;
+    if (code >= 1007 && code <= 1014) return 1;
+    return code >= 3000 && code <= 4999;
+}
+
+static int deliver(ws_t *ws, ws_opcode_t opcode, const char *data, size_t len) {
+    if (opcode == WS_TEXT && !utf8_valid((const unsigned char *)data, len)) {
+        return protocol_error(ws, 1007);
+    }
+    if (ws->handler->on_message) ws->handler->on_message(ws, opcode, data, len);
+    return 0;
+}
+
+static int msg_append(ws_t *ws, const char *data, size_t len) {
+    if (ws->msg_len + len > WS_MAX_MESSAGE) return -1;
+
+    if (ws->msg_len + len > ws->msg_cap) {
+        size_t cap = ws->msg_cap ? ws->msg_cap : WS_INLINE_BUFFER;
+        while (cap < ws->msg_len + len) cap *= 2;
+        char *msg = realloc(ws->msg, cap);
+        if (!msg) return -1;
+        ws->msg = msg;
+        ws->msg_cap = cap;
+    }
+
+    memcpy(ws->msg + ws->msg_len, data, len);
+    ws->msg_len += len;
+    return 0;
+}
+
+static int handle_frame(ws_t *ws, int fin, ws_opcode_t opcode, const char *data, size_t len) {
+    switch (opcode) {
+        case WS_PING:
+            ws_send(ws, WS_PONG, data, len);
+            return 0;
+        case WS_PONG:
+            return 0;
+        case WS_CLOSE: {
+            if (len == 1) return protocol_error(ws, 1002);
+            int code = len >= 2 ? ((unsigned char)data[0] << 8 | (unsigned char)data[1]) : 0;
+            if (len >= 2 && !close_code_valid(code)) return protocol_error(ws, 1002);
+            if (len > 2 && !utf8_valid((const unsigned char *)data + 2, len - 2)) {
+                return protocol_error(ws, 1007);
+            }
+            ws->close_code = code ? code : 1005;
+            ws_close(ws, code, NULL);
+            return 0;
+        }
+        case WS_TEXT:
+        case WS_BINARY:
+            if (ws->msg_opcode != WS_CONTINUATION) return protocol_error(ws, 1002);
+            if (fin) return deliver(ws, opcode, data, len);
+            ws->msg_opcode = opcode;
+            ws->msg_len = 0;
+            if (msg_append(ws, data, len) != 0) return protocol_error(ws, 1009);
+            return 0;
+        case WS_CONTINUATION:
+            if (ws->msg_opcode == WS_CONTINUATION) return protocol_error(ws, 1002);
+            if (msg_append(ws, data, len) != 0) return protocol_error(ws, 1009);
+            if (!fin) return 0;
+
+            opcode = ws->msg_opcode;
+            ws->msg_opcode = WS_CONTINUATION;
+            int result = deliver(ws, opcode, ws->msg, ws->msg_len);
+            if (ws->msg_cap > WS_KEEP_MSG_BUFFER) {
+                free(ws->msg);
+                ws->msg = NULL;
+                ws->msg_cap = 0;
+            }
+            return result;
+        default:
+            return protocol_error(ws, 1002);
+    }
+}
+
+/*
+*   Parses one frame at buf + pos. Returns the bytes consumed, 0 when the
+*   frame is incomplete (ws->need is set to its full size) or -1 after a
+*   protocol error.
+*/
+static ssize_t parse_frame(ws_t *ws, size_t pos) {
+    unsigned char *p = (unsigned char *)ws->buf + pos;
+    size_t avail = ws->len - pos;
+
+    if (avail < 2) {
+        ws->need = 2;
+        return 0;
+    }
+
+    int fin = p[0] & 0x80;
+    int rsv = p[0] & 0x70;
+    ws_opcode_t opcode = p[0] & 0x0F;
+    int masked = p[1] & 0x80;
+    uint64_t payload_len = p[1] & 0x7F;
+
+    /* clients must mask, extensions are not negotiated */
+    if (rsv || !masked) return protocol_error(ws, 1002);
+    if (opcode >= WS_CLOSE && (!fin || payload_len > 125)) return protocol_error(ws, 1002);
+
+    size_t head_len = 2;
+    if (payload_len == 126) head_len += 2;
+    else if (payload_len == 127) head_len += 8;
+    head_len += 4;
+
+    if (avail < head_len) {
+        ws->need = head_len;
+        return 0;
+    }
+
+    if (payload_len == 126) {
+        payload_len = (uint64_t)p[2] << 8 | p[3];
+    } else if (payload_len == 127) {
+        payload_len = 0;
+        for (int i = 0; i < 8; i++) payload_len = payload_len << 8 | p[2 + i];
+    }
+
+    if (payload_len > WS_MAX_MESSAGE) return protocol_error(ws, 1009);
+
+    if (avail < head_len + payload_len) {
+        ws->need = head_len + payload_len;
+        return 0;
+    }
+
+    unsigned char *payload = p + head_len;
+    ws_unmask(payload, payload_len, p + head_len - 4);
+    if (handle_frame(ws, fin, opcode, (char *)payload, payload_len) != 0) return -1;
+
+    return head_len + payload_len;
+}
+
+static int ensure_capacity(ws_t *ws, size_t need) {
+    if (need <= ws->cap) return 0;
+
+    char *buf = malloc(need);
+    if (!buf) return -1;
+    memcpy(buf, ws->buf, ws->len);
+    if (ws->buf != ws->inline_buf) free(ws->buf);
+    ws->buf = buf;
+    ws->cap = need;
+    return 0;
+}
+
+/*
+*   EPOLLIN handler of an upgraded connection.
+*/
+void ws_readable(client_con_t *conn) {
+    ws_t *ws = conn->ws;
+
+    ssize_t n = recv(conn->fd, ws->buf + ws->len, ws->cap - ws->len, 0);
+    if (n < 0) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) return;
+        conn_close(conn);
+        return;
+    }
+    if (n == 0) {
+        conn_close(conn);
+        return;
+    }
+    ws->len += n;
+    conn->last_activity = clock_now();
+
+    size_t pos = 0;
+    ws->need = 0;
+    ws->parsing = 1;
+    while (!ws->finished && pos < ws->len) {
+        ssize_t used = parse_frame(ws, pos);
+        if (used <= 0) break;
+        pos += used;
+    }
+    ws->parsing = 0;
+
+    if (ws->finished) {
+        ws_finish(ws);
+        return;
+    }
+
+    ws->len -= pos;
+    memmove(ws->buf, ws->buf + pos, ws->len);
+    if (ws->buf != ws->inline_buf && ws->len <= WS_INLINE_BUFFER && ws->need <= WS_INLINE_BUFFER) {
+        memcpy(ws->inline_buf, ws->buf, ws->len);
+        free(ws->buf);
+        ws->buf = ws->inline_buf;
+        ws->cap = WS_INLINE_BUFFER;
+    }
+
+    if (ensure_capacity(ws, ws->need) != 0) {
+        ws_close(ws, 1009, NULL);
+    }
+}
+
+/*
+*   Completes the RFC 6455 handshake and switches the connection to frame
+*   parsing. Returns -1 without sending anything if req is not a valid
+*   upgrade request.
+*/
+int ws_upgrade(int client_fd, http_req_t *req, const ws_handler_t *handler) {
+    client_con_t *conn = conn_lookup(client_fd);
+    const char *upgrade = get_header(req, "Upgrade");
+    const char *connection = get_header(req, "Connection");
+    const char *version = get_header(req, "Sec-WebSocket-Version");
+    const char *key = get_header(req, "Sec-WebSocket-Key");
+
+    if (!conn || conn->stream.active || strcmp(req->method, "GET") != 0 ||
+        !upgrade || !header_has_token(upgrade, "websocket") ||
+        !connection || !header_has_token(connection, "upgrade") ||
+        !version || strcmp(version, "13") != 0 || !key || strlen(key) != 24) {
+        return -1;
+    }
+
+    unsigned char digest[20];
+    sha1_t sha;
+    sha1_init(&sha);
+    sha1_update(&sha, key, strlen(key));
+    sha1_update(&sha, WS_GUID, sizeof(WS_GUID) - 1);
+    sha1_final(&sha, digest);
+
+    char accept[32];
+    base64_encode(digest, sizeof(digest), accept);
+
+    ws_t *ws = malloc(sizeof(ws_t));
+    if (!ws) return -1;
+    memset(ws, 0, offsetof(ws_t, inline_buf));
+    ws->conn = conn;
+    ws->handler = handler;
+    ws->buf = ws->inline_buf;
+    ws->cap = WS_INLINE_BUFFER;
+    ws->msg_opcode = WS_CONTINUATION;
+
+    response_t resp;
+    resp_init(&resp, INFO_SWITCHING);
+    resp_header(&resp, "Upgrade", "websocket");
+    resp_header(&resp, "Connection", "Upgrade");
+    resp_header(&resp, "Sec-WebSocket-Accept", accept);
+    if (resp_send_head(client_fd, &resp) != SERVER_OK) {
+        free(ws);
+        return -1;
+    }
+
+    conn->ws = ws;
+    stream_t *stream = &conn->stream;
+    stream->active = 1;
+    stream->paused = 0;
+    stream->on_drain = NULL;
+    stream->on_close = ws_stream_closed;
+    stream->ctx = ws;
+
+    if (handler->on_open) handler->on_open(ws, req);
+    return 0;
+}
@@ -0,0 +1,66 @@
+#ifndef WS_H
+#define WS_H
+
+#include <stddef.h>
+
+#include "server.h"
+
+#define WS_INLINE_BUFFER 4096
+#define WS_MAX_MESSAGE (16 * 1024 * 1024)
+
+typedef enum {
+    WS_CONTINUATION = 0x0,
+    WS_TEXT = 0x1,
+    WS_BINARY = 0x2,
+    WS_CLOSE = 0x8,
+    WS_PING = 0x9,
+    WS_PONG = 0xA
+} ws_opcode_t;
+
+struct ws_conn;
+
+/*
+*   Callbacks of a WebSocket route, all optional. on_open runs right after
+*   the handshake and may set ws->user. on_message receives complete,
+*   unmasked messages; data is only valid during the call. on_close runs
+*   once, with the peer's close code or 1006 if the connection dropped.
+*/
+typedef struct ws_handler {
+    void (*on_open)(struct ws_conn *ws, http_req_t *req);
+    void (*on_message)(struct ws_conn *ws, ws_opcode_t opcode, const char *data, size_t len);
+    void (*on_close)(struct ws_conn *ws, int code);
+} ws_handler_t;
+
+/*
+*   Per-connection state, allocated once at upgrade. Frames are parsed and
+*   unmasked in place in buf, which starts out as inline_buf and only
+*   moves to the heap for frames that do not fit. Fragmented messages are
+*   assembled in msg, which is kept for the next message.
+*/
+typedef struct ws_conn {
+    client_con_t *conn;
+    const ws_handler_t *handler;
+    void *user;
+    char *buf;
+    size_t len;
+    size_t cap;
+    char *msg;
+    size_t msg_len;
+    size_t msg_cap;
+    ws_opcode_t msg_opcode;
+    size_t need;
+    int close_code;
+    int parsing;
+    int close_sent;
+    int finished;
+    char inline_buf[WS_INLINE_BUFFER];
+} ws_t;
+
+int ws_upgrade(int client_fd, http_req_t *req, const ws_handler_t *handler);
+void ws_readable(client_con_t *conn);
+
+int ws_send(ws_t *ws, ws_opcode_t opcode, const char *data, size_t len);
+int ws_send_text(ws_t *ws, const char *text);
+void ws_close(ws_t *ws, int code, const char *reason);
+
+#endif
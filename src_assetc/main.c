@@ -0,0 +1,564 @@
+/*
+ * Static Asset Bundler
+ *
+ * Embeds every file under ./public and every .html file under ./routes into
+ * the server binary as read-only data.
+ *
+ * For each asset the bundler precomputes:
+ *   - MIME type and a content hash ETag
+ *   - gzip and brotli variants (kept only when they are actually smaller)
+ *   - the complete response head of every variant, plus a 304 head
+ *
+ * Lookup goes through a perfect hash (seeded FNV-1a, collision free for the
+ * bundled paths), followed by a single memcmp to reject unknown paths.
+ *
+ * Files under ./routes shadow files with the same path under ./public, which
+ * mirrors the lookup order of serve_file.
+ *
+ * Output format: ./src/assetc/assets.c (API in ./src/assets.h)
+ */
+
+#include <brotli/encode.h>
+#include <dirent.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#define SAVE_PATH "./src/assetc/"
+#define SAVE_FILE "./src/assetc/assets.c"
+#define SAVE_TMP SAVE_FILE ".tmp"
+#define PATH_TO_PUBLIC "./public"
+#define PATH_TO_ROUTES "./routes"
+
+#define MAX_ASSET_PATH 1024
+#define MAX_SEED_TRIES 100000
+#define MIN_COMPRESSION_GAIN 0.9
+
+typedef struct {
+    char extension[16];
+    char mime_type[64];
+} mime_entry_t;
+
+typedef struct {
+    char path[MAX_ASSET_PATH];
+    char mime_type[64];
+    char etag[32];
+    unsigned char *data;
+    size_t len;
+    unsigned char *gzip;
+    size_t gzip_len;
+    unsigned char *br;
+    size_t br_len;
+} asset_src_t;
+
+typedef struct {
+    asset_src_t *items;
+    int count;
+    int capacity;
+} asset_list_t;
+
+mime_entry_t mime_types[] = {
+    {".html", "text/html; charset=utf-8"},
+    {".css", "text/css"},
+    {".js", "application/javascript"},
+    {".png", "image/png"},
+    {".jpg", "image/jpeg"},
+    {".gif", "image/gif"},
+    {".txt", "text/plain"},
+    {".json", "application/json"},
+    {".svg", "image/svg+xml"},
+    {".pdf", "application/pdf"},
+};
+
+int is_hidden(const char *name) { return name[0] == '.'; }
+
+int has_extension(const char *filename, const char *ext) {
+    const char *dot = strrchr(filename, '.');
+    return (dot && strcmp(ext, dot) == 0);
+}
+
+int is_compressible(const char *mime_type) {
+    return strncmp(mime_type, "text/", 5) == 0 ||
+           strcmp(mime_type, "application/javascript") == 0 ||
+           strcmp(mime_type, "application/json") == 0 ||
+           strcmp(mime_type, "image/svg+xml") == 0;
+}
+
+const char *get_mime_type(const char *path) {
+    const char *ext = strrchr(path, '.');
+    if (!ext) return "application/octet-stream";
+
+    for (size_t i = 0; i < sizeof(mime_types) / sizeof(mime_types[0]); i++) {
+        if (strcmp(mime_types[i].extension, ext) == 0) {
+            return mime_types[i].mime_type;
+        }
+    }
+
+    return "application/octet-stream";
+}
+
+/*
+*   Must stay identical to the asset_hash emitted into the generated file.
+*/
+uint32_t asset_hash(const char *s, size_t len, uint32_t seed) {
+    uint32_t h = 2166136261u ^ seed;
+    for (size_t i = 0; i < len; i++) {
+        h ^= (unsigned char)s[i];
+        h *= 16777619u;
+    }
+    return h ^ (h >> 15);
+}
+
+int find_asset(asset_list_t *list, const char *path) {
+    for (int i = 0; i < list->count; i++) {
+        if (strcmp(list->items[i].path, path) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+unsigned char *read_file(const char *path, size_t *len) {
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) {
+        return NULL;
+    }
+
+    fseek(f, 0L, SEEK_END);
+    long length = ftell(f);
+    fseek(f, 0L, SEEK_SET);
+    if (length < 0) {
+        fclose(f);
+        return NULL;
+    }
+
+    unsigned char *data = malloc(length + 1);
+    if (data == NULL) {
+        fclose(f);
+        return NULL;
+    }
+
+    if (fread(data, 1, length, f) != (size_t)length) {
+        free(data);
+        fclose(f);
+        return NULL;
+    }
+
+    fclose(f);
+    *len = length;
+    return data;
+}
+
+unsigned char *gzip_data(const unsigned char *src, size_t len, size_t *out_len) {
+    z_stream zs = {0};
+    if (deflateInit2(&zs, Z_BEST_COMPRESSION, Z_DEFLATED, 15 + 16, 9,
+                     Z_DEFAULT_STRATEGY) != Z_OK) {
+        return NULL;
+    }
+
+    size_t bound = deflateBound(&zs, len);
+    unsigned char *out = malloc(bound);
+    if (out == NULL) {
+        deflateEnd(&zs);
+        return NULL;
+    }
+
+    zs.next_in = (unsigned char *)src;
+    zs.avail_in = len;
+    zs.next_out = out;
+    zs.avail_out = bound;
+
+    if (deflate(&zs, Z_FINISH) != Z_STREAM_END) {
+        free(out);
+        deflateEnd(&zs);
+        return NULL;
+    }
+
+    *out_len = zs.total_out;
+    deflateEnd(&zs);
+    return out;
+}
+
+unsigned char *brotli_data(const unsigned char *src, size_t len, size_t *out_len) {
+    size_t bound = BrotliEncoderMaxCompressedSize(len);
+    if (bound == 0) return NULL;
+
+    unsigned char *out = malloc(bound);
+    if (out == NULL) return NULL;
+
+    *out_len = bound;
+    if (!BrotliEncoderCompress(BROTLI_MAX_QUALITY, BROTLI_DEFAULT_WINDOW,
+                               BROTLI_MODE_GENERIC, len, src, out_len, out)) {
+        free(out);
+        return NULL;
+    }
+
+    return out;
+}
+
+int add_asset(asset_list_t *list, const char *full_path, const char *rel_path) {
+    if (find_asset(list, rel_path) >= 0) {
+        return 0;
+    }
+
+    if (list->count >= list->capacity) {
+        list->capacity = list->capacity ? list->capacity * 2 : 64;
+        asset_src_t *items = realloc(list->items, sizeof(asset_src_t) * list->capacity);
+        if (items == NULL) {
+            perror("Failed to expand asset array");
+            return -1;
+        }
+        list->items = items;
+    }
+
+    asset_src_t *a = &list->items[list->count];
+    memset(a, 0, sizeof(*a));
+
+    a->data = read_file(full_path, &a->len);
+    if (a->data == NULL) {
+        fprintf(stderr, "Failed to read %s\n", full_path);
+        return -1;
+    }
+
+    snprintf(a->path, sizeof(a->path), "%s", rel_path);
+    snprintf(a->mime_type, sizeof(a->mime_type), "%s", get_mime_type(rel_path));
+    snprintf(a->etag, sizeof(a->etag), "\"%08x-%zx\"",
+             asset_hash((const char *)a->data, a->len, 0), a->len);
+
+    if (is_compressible(a->mime_type) && a->len > 0) {
+        a->gzip = gzip_data(a->data, a->len, &a->gzip_len);
+        if (a->gzip && a->gzip_len >= a->len * MIN_COMPRESSION_GAIN) {
+            free(a->gzip);
+            a->gzip = NULL;
+            a->gzip_len = 0;
+        }
+
+        a->br = brotli_data(a->data, a->len, &a->br_len);
+        if (a->br && a->br_len >= a->len * MIN_COMPRESSION_GAIN) {
+            free(a->br);
+            a->br = NULL;
+            a->br_len = 0;
+        }
+    }
+
+    list->count++;
+    printf("Embedded: %s (%zu bytes, gzip %zu, br %zu)\n", rel_path, a->len,
+           a->gzip_len, a->br_len);
+    return 0;
+}
+
+int collect_directory(asset_list_t *list, const char *root, const char *rel,
+                      const char *only_ext) {
+    char dir_path[MAX_ASSET_PATH] = {0};
+    snprintf(dir_path, sizeof(dir_path), "%s%s", root, rel);
+
+    DIR *dir = opendir(dir_path);
+    if (dir == NULL) {
+        return 0;
+    }
+
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (is_hidden(entry->d_name)) {
+            continue;
+        }
+
+        char rel_path[MAX_ASSET_PATH] = {0};
+        snprintf(rel_path, sizeof(rel_path), "%s/%s", rel, entry->d_name);
+
+        char full_path[MAX_ASSET_PATH * 2] = {0};
+        snprintf(full_path, sizeof(full_path), "%s%s", root, rel_path);
+
+        if (entry->d_type == DT_DIR) {
+            if (collect_directory(list, root, rel_path, only_ext) != 0) {
+                closedir(dir);
+                return -1;
+            }
+        } else if (entry->d_type == DT_REG) {
+            if (only_ext && !has_extension(entry->d_name, only_ext)) {
+                continue;
+            }
+            /* Keys are stored without the leading slash. */
+            if (add_asset(list, full_path, rel_path + 1) != 0) {
+                closedir(dir);
+                return -1;
+            }
+        }
+    }
+
+    closedir(dir);
+    return 0;
+}
+
+/*
+*   Searches for a seed under which every path lands in its own slot.
+*   The table doubles whenever the seed search gives up.
+*/
+int build_perfect_hash(asset_list_t *list, uint32_t *seed_out, int **table_out,
+                       size_t *size_out) {
+    size_t size = 1;
+    while (size < (size_t)list->count * 2) size <<= 1;
+
+    while (1) {
+        int *table = malloc(sizeof(int) * size);
+        if (table == NULL) {
+            perror("Failed to allocate hash table");
+            return -1;
+        }
+
+        for (uint32_t seed = 1; seed < MAX_SEED_TRIES; seed++) {
+            memset(table, -1, sizeof(int) * size);
+
+            int ok = 1;
+            for (int i = 0; i < list->count && ok; i++) {
+                asset_src_t *a = &list->items[i];
+                uint32_t slot = asset_hash(a->path, strlen(a->path), seed) & (size - 1);
+                if (table[slot] >= 0) {
+                    ok = 0;
+                } else {
+                    table[slot] = i;
+                }
+            }
+
+            if (ok) {
+                *seed_out = seed;
+                *table_out = table;
+                *size_out = size;
+                return 0;
+            }
+        }
+
+        free(table);
+        size <<= 1;
+    }
+}
+
+void write_bytes(FILE *f, const char *name, const unsigned char *data, size_t len) {
+    fprintf(f, "static const unsigned char %s[%zu] = {", name, len ? len : 1);
+    for (size_t i = 0; i < len; i++) {
+        if (i % 16 == 0) fprintf(f, "\n    ");
+        fprintf(f, "0x%02x,", data[i]);
+    }
+    if (len == 0) fprintf(f, "0");
+    fprintf(f, "\n};\n");
+}
+
+void write_c_string(FILE *f, const char *s) {
+    fputc('"', f);
+    for (; *s; s++) {
+        if (*s == '\r') fputs("\\r", f);
+        else if (*s == '\n') fputs("\\n", f);
+        else if (*s == '"' || *s == '\\') fprintf(f, "\\%c", *s);
+        else fputc(*s, f);
+    }
+    fputc('"', f);
+}
+
+int format_headers(char *dst, size_t size, const asset_src_t *a, size_t len,
+                   const char *encoding) {
+    char encoding_line[64] = {0};
+    if (encoding) {
+        snprintf(encoding_line, sizeof(encoding_line),
+                 "Content-Encoding: %s\r\n", encoding);
+    }
+
+    const char *vary = (a->gzip || a->br) ? "Vary: Accept-Encoding\r\n" : "";
+
+    return snprintf(dst, size,
+                    "HTTP/1.1 200 OK\r\n"
+                    "Content-Type: %s\r\n"
+                    "Content-Length: %zu\r\n"
+                    "ETag: %s\r\n"
+                    "%s%s"
+                    "Connection: close\r\n"
+                    "Server: hehe/1.0\r\n"
+                    "\r\n",
+                    a->mime_type, len, a->etag, encoding_line, vary);
+}
+
+void write_variant(FILE *f, const asset_src_t *a, const char *data_name,
+                   size_t len, const char *encoding) {
+    if (data_name == NULL) {
+        fprintf(f, "        {NULL, 0, NULL, 0},\n");
+        return;
+    }
+
+    char headers[1024] = {0};
+    int headers_len = format_headers(headers, sizeof(headers), a, len, encoding);
+
+    fprintf(f, "        {%s, %zu, ", data_name, len);
+    write_c_string(f, headers);
+    fprintf(f, ", %d},\n", headers_len);
+}
+
+/*
+*   Moves tmp over path unless both hold the same bytes, so an unchanged
+*   output keeps its mtime and make does not recompile it.
+*/
+int replace_if_changed(const char *tmp, const char *path) {
+    FILE *a = fopen(tmp, "rb");
+    FILE *b = fopen(path, "rb");
+    int same = a && b;
+    while (same) {
+        char x[8192], y[8192];
+        size_t n = fread(x, 1, sizeof(x), a);
+        size_t m = fread(y, 1, sizeof(y), b);
+        if (n != m || memcmp(x, y, n) != 0) same = 0;
+        if (n == 0) break;
+    }
+    if (a) fclose(a);
+    if (b) fclose(b);
+
+    if (same) {
+        unlink(tmp);
+        return 0;
+    }
+    if (rename(tmp, path) != 0) {
+        perror("Error replacing output");
+        unlink(tmp);
+        return -1;
+    }
+    return 0;
+}
+
+int save_bundle(asset_list_t *list, uint32_t seed, int *table, size_t size) {
+    FILE *f = fopen(SAVE_TMP, "w");
+    if (f == NULL) {
+        perror("Error opening file for writing");
+        return -1;
+    }
+
+    fprintf(f, "#include <stdint.h>\n#include <string.h>\n\n#include \"../assets.h\"\n\n");
+
+    for (int i = 0; i < list->count; i++) {
+        asset_src_t *a = &list->items[i];
+        char name[64];
+
+        snprintf(name, sizeof(name), "asset_%d", i);
+        write_bytes(f, name, a->data, a->len);
+        if (a->gzip) {
+            snprintf(name, sizeof(name), "asset_%d_gz", i);
+            write_bytes(f, name, a->gzip, a->gzip_len);
+        }
+        if (a->br) {
+            snprintf(name, sizeof(name), "asset_%d_br", i);
+            write_bytes(f, name, a->br, a->br_len);
+        }
+        fprintf(f, "\n");
+    }
+
+    fprintf(f, "static const asset_t assets[%d] = {\n", list->count ? list->count : 1);
+    for (int i = 0; i < list->count; i++) {
+        asset_src_t *a = &list->items[i];
+        char name[64];
+        char not_modified[256];
+        int not_modified_len = snprintf(not_modified, sizeof(not_modified),
+                                        "HTTP/1.1 304 Not Modified\r\n"
+                                        "ETag: %s\r\n"
+                                        "Server: hehe/1.0\r\n"
+                                        "\r\n",
+                                        a->etag);
+
+        fprintf(f, "    {\n        ");
+        write_c_string(f, a->path);
+        fprintf(f, ", %zu, ", strlen(a->path));
+        write_c_string(f, a->mime_type);
+        fprintf(f, ", ");
+        write_c_string(f, a->etag);
+        fprintf(f, ", %zu,\n", strlen(a->etag));
+
+        snprintf(name, sizeof(name), "asset_%d", i);
+        write_variant(f, a, name, a->len, NULL);
+        snprintf(name, sizeof(name), "asset_%d_gz", i);
+        write_variant(f, a, a->gzip ? name : NULL, a->gzip_len, "gzip");
+        snprintf(name, sizeof(name), "asset_%d_br", i);
+        write_variant(f, a, a->br ? name : NULL, a->br_len, "br");
+
+        fprintf(f, "        ");
+        write_c_string(f, not_modified);
+        fprintf(f, ", %d\n    },\n", not_modified_len);
+    }
+    if (list->count == 0) fprintf(f, "    {0}\n");
+    fprintf(f, "};\n\n");
+
+    fprintf(f, "static const int asset_table[%zu] = {", size);
+    for (size_t i = 0; i < size; i++) {
+        if (i % 16 == 0) fprintf(f, "\n    ");
+        fprintf(f, "%d,", list->count ? table[i] : -1);
+    }
+    fprintf(f, "\n};\n\n");
+
+    fprintf(f,
+            "static inline uint32_t asset_hash(const char *s, size_t len) {\n"
+            "    uint32_t h = 2166136261u ^ %uu;\n"
+            "    for (size_t i = 0; i < len; i++) {\n"
+            "        h ^= (unsigned char)s[i];\n"
+            "        h *= 16777619u;\n"
+            "    }\n"
+            "    return h ^ (h >> 15);\n"
+            "}\n\n",
+            seed);
+
+    fprintf(f,
+            "const asset_t *asset_lookup(const char *path, size_t path_len) {\n"
+            "    while (path_len > 0 && *path == '/') {\n"
+            "        path++;\n"
+            "        path_len--;\n"
+            "    }\n\n"
+            "    int idx = asset_table[asset_hash(path, path_len) & %zuu];\n"
+            "    if (idx < 0) return NULL;\n\n"
+            "    const asset_t *a = &assets[idx];\n"
+            "    if (a->path_len != path_len || memcmp(a->path, path, path_len) != 0) return NULL;\n"
+            "    return a;\n"
+            "}\n\n"
+            "size_t asset_count(void) {\n"
+            "    return %d;\n"
+            "}\n",
+            size - 1, list->count);
+
+    fclose(f);
+    return replace_if_changed(SAVE_TMP, SAVE_FILE);
+}
+
+int main(void) {
+    struct stat st;
+    if (stat(SAVE_PATH, &st) == -1) {
+        mkdir(SAVE_PATH, 0755);
+    }
+
+    asset_list_t list = {0};
+
+    if (collect_directory(&list, PATH_TO_ROUTES, "", ".html") != 0 ||
+        collect_directory(&list, PATH_TO_PUBLIC, "", NULL) != 0) {
+        return EXIT_FAILURE;
+    }
+
+    uint32_t seed = 0;
+    int *table = NULL;
+    size_t size = 1;
+    if (list.count > 0 && build_perfect_hash(&list, &seed, &table, &size) != 0) {
+        return EXIT_FAILURE;
+    }
+
+    int res = save_bundle(&list, seed, table, size);
+
+    for (int i = 0; i < list.count; i++) {
+        free(list.items[i].data);
+        free(list.items[i].gzip);
+        free(list.items[i].br);
+    }
+    free(list.items);
+    free(table);
+
+    if (res != 0) {
+        return EXIT_FAILURE;
+    }
+
+    printf("\nEmbedded: %d assets (seed %u, %zu slots)\n", list.count, seed, size);
+    return EXIT_SUCCESS;
+}
@@ -1,16 +1,27 @@
 #include "%%NAME%%.h"
 
 #include <stdlib.h>
+#include <string.h>
 #include "../cx.h"
 
 %%PREPEND%%
 
 char *%%FUNC_NAME%%(%%PROPS_NAME%% *props)
 {
-    char *output = calloc(%%RESPONSE_SIZE%%+1, sizeof(char));
-    if(!output) return NULL;
+    cx_out_t output;
+    if (cx_out_init(&output, %%RESPONSE_SIZE%%) != 0) return NULL;
+    cx_out_t *out = &output;
 
     %%CODE%%
 
-    return output;
+    return cx_out_finish(out);
 }
+
+int %%FUNC_NAME%%_iov(%%PROPS_NAME%% *props, cx_iov_t *out)
+{
+    %%CODE%%
+
+    return out->failed ? -1 : 0;
+}
+
+%%PAGE%%
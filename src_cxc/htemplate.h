@@ -1,10 +1,21 @@
 #ifndef %%FILE_ID%%
 #define %%FILE_ID%%
 
+#include "../cx.h"
+
 typedef struct {
     %%PROPS%%
 } %%STRUCT_NAME%%;
 
 char *%%FUNC_NAME%%(%%STRUCT_NAME%% *props);
 
+/*
+*   Appends to out, initialized with cx_iov_init or cx_stream_begin. The
+*   caller releases it with cx_iov_free, cx_send or cx_stream_end even
+*   when rendering failed.
+*/
+int %%FUNC_NAME%%_iov(%%STRUCT_NAME%% *props, cx_iov_t *out);
+
+%%PAGE%%
+
 #endif
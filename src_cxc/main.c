@@ -4,38 +4,63 @@
  * .CX FILE SYNTAX:
  * ================
  * ({name: string, age: int})  - Props struct definition
+ * const ({.name = "x"})       - Constant props, adds page_{name}() that
+ *                               serves the page rendered once with them
  *
- * {{=props->name}}            - Output variable/expression
+ * {{=props->name}}            - Output variable/expression, HTML escaped
+ * {{!props->html}}            - Output variable/expression as is
  * {{=%props->src}}            - Include file from dynamic path (from props)
- * {{%./static/file.html}}     - Include file from static path
+ * {{%./static/file.html}}     - Include file from static path, inlined
+ * {{cache key ttl}}...{{/cache}} - Cache the rendered block for ttl
+ *                               seconds under the string key
+ * {{each item in arr, n}}...{{/each}} - Repeat the block for arr[0..n),
+ *                               item is a copy of the element and
+ *                               item_index its position
+ * {{flush}}                   - Send what is rendered so far when streaming
+ * {{ code }}                  - C code; append with cx_write(out, s)
  *
- * Standard HTML markup is passed through as-is.
+ * Every template becomes render_{name}, returning a malloc'd string, and
+ * render_{name}_iov, appending to a cx_iov_t for writev or streaming. Both share the same
+ * body, so code blocks must only use the cx_write* macros on out.
+ *
+ * Standard HTML markup is passed through as-is. Errors are reported as
+ * file:line: error: message.
  * Output format: ./src/cxc/{filename}.c and .h
+ *
+ * ./src/cxc/.manifest records a hash of every template and its static
+ * includes. Unchanged templates are skipped, outputs are only rewritten
+ * when their contents change, and the rest is split across one worker
+ * process per CPU.
  */
 
+#define _GNU_SOURCE
+
 #include <ctype.h>
 #include <dirent.h>
+#include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <sys/wait.h>
 #include <unistd.h>
 
 #define CTEMPLATE_PATH "./src_cxc/ctemplate.c"
 #define HTEMPLATE_PATH "./src_cxc/htemplate.h"
 #define SAVE_PATH "./src/cxc/"
 #define PATH_TO_CX_FILES "./cx_files"
+#define MANIFEST_PATH "./src/cxc/.manifest"
+#define MAX_WORKERS 32
 
 #define MAX_NAME 64
 #define MAX_FILE_NAME 128
-#define BUFFER_SIZE 1024 * 1024
 
 typedef enum { C, H } Template;
 
 typedef struct {
     char placeholder[128];
-    char *replacement;
+    const char *replacement;
 } placeholder_t;
 
 typedef struct {
@@ -44,7 +69,39 @@ typedef struct {
     int collision_count;
 } processed_file_t;
 
-unsigned long response_length = 1024 * 1024;
+/*
+*   Initial capacity of a renderer's output: the exact length of its
+*   static text and static includes, plus DYNAMIC_SEGMENT_HINT for every
+*   dynamic segment. The buffer grows at runtime if that is not enough.
+*/
+#define DYNAMIC_SEGMENT_HINT 32
+
+#define FRAGMENT_SIZE_HINT 1024
+
+/* larger static includes are read at runtime instead of being inlined */
+#define INLINE_INCLUDE_MAX (64 * 1024)
+
+unsigned long response_length = 0;
+
+/*
+*   Files whose contents end up in the current template's output, i.e. its
+*   static includes. Their hashes go into the manifest.
+*/
+#define MAX_DEPS 64
+
+char deps[MAX_DEPS][PATH_MAX];
+int deps_len = 0;
+
+void add_dependency(const char *path) {
+    for (int i = 0; i < deps_len; i++) {
+        if (strcmp(deps[i], path) == 0) return;
+    }
+    if (deps_len == MAX_DEPS) {
+        fprintf(stderr, "WARNING: more than %d includes, %s is not tracked\n", MAX_DEPS, path);
+        return;
+    }
+    snprintf(deps[deps_len++], PATH_MAX, "%s", path);
+}
 
 int is_hidden(const char *name) { return name[0] == '.'; }
 
@@ -57,88 +114,16 @@ int find_collision(processed_file_t *files, int count, const char *filename) {
     return -1;
 }
 
-int remove_files_recursive(const char *path) {
-    struct dirent *entry;
-    DIR *dir = opendir(path);
-
-    if (dir == NULL) {
-        return -1;
-    }
-
-    while ((entry = readdir(dir)) != NULL) {
-        if (strcmp(entry->d_name, ".") == 0 ||
-            strcmp(entry->d_name, "..") == 0) {
-            continue;
-        }
-
-        char full_path[1024] = {0};
-        snprintf(full_path, sizeof(full_path), "%s/%s", path, entry->d_name);
-
-        if (entry->d_type == DT_DIR) {
-            remove_files_recursive(full_path);
-            rmdir(full_path);
-        } else {
-            unlink(full_path);
-        }
-    }
-
-    closedir(dir);
-    return 0;
-}
-
-int clean_directory(const char *path) {
+int ensure_directory(const char *path) {
     struct stat st;
     if (stat(path, &st) == -1) {
-        mkdir(path, 0755);
-        return 0;
+        return mkdir(path, 0755);
     }
 
     if (!S_ISDIR(st.st_mode)) {
         fprintf(stderr, "Error: %s exists but is not a directory\n", path);
         return -1;
     }
-
-    if (remove_files_recursive(path) != 0) {
-        fprintf(stderr, "Error cleaning directory\n");
-        return -1;
-    }
-
-    return 0;
-}
-
-int replace_placeholder(char **buffer, const char *placeholder,
-                        const char *replacement) {
-    if (!buffer || !*buffer || !placeholder || !replacement) {
-        return -1;
-    }
-
-    size_t buffer_len = strlen(*buffer);
-    size_t placeholder_len = strlen(placeholder);
-    size_t replacement_len = strlen(replacement);
-
-    char *pos = strstr(*buffer, placeholder);
-
-    while (pos != NULL) {
-        size_t offset = pos - *buffer;
-        size_t new_len = buffer_len - placeholder_len + replacement_len;
-
-        char *new_buffer = realloc(*buffer, new_len + 256);
-        if (new_buffer == NULL) {
-            perror("Error allocating memory");
-            return -1;
-        }
-        *buffer = new_buffer;
-        pos = *buffer + offset;
-
-        memmove(pos + replacement_len, pos + placeholder_len,
-                buffer_len - offset - placeholder_len + 1);
-
-        memcpy(pos, replacement, replacement_len);
-
-        buffer_len = new_len;
-        pos = strstr(pos + replacement_len, placeholder);
-    }
-
     return 0;
 }
 
@@ -169,160 +154,413 @@ long get_file_length(FILE *f) {
     return length;
 }
 
-void process_text(char *s) {
-    if (!s)
-        return;
+/*
+*   Growable output buffer. The first failed allocation sets failed and
+*   every later append is ignored, so callers check once at the end.
+*/
+typedef struct {
+    char *data;
+    size_t len;
+    size_t cap;
+    int failed;
+} buffer_t;
 
-    char *temp_buf = malloc(strlen(s) * 2 + 1);
-    if (!temp_buf) {
-        perror("Malloc failed");
-        return;
+int buffer_reserve(buffer_t *b, size_t extra) {
+    if (b->failed) return -1;
+    if (b->len + extra < b->cap) return 0;
+
+    size_t cap = b->cap ? b->cap : 256;
+    while (cap <= b->len + extra) cap *= 2;
+
+    char *data = realloc(b->data, cap);
+    if (data == NULL) {
+        perror("Error allocating memory");
+        b->failed = 1;
+        return -1;
+    }
+    b->data = data;
+    b->cap = cap;
+    return 0;
+}
+
+void buffer_append(buffer_t *b, const char *s, size_t len) {
+    if (buffer_reserve(b, len) != 0) return;
+    memcpy(b->data + b->len, s, len);
+    b->len += len;
+    b->data[b->len] = '\0';
+}
+
+void buffer_printf(buffer_t *b, const char *fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    int n = vsnprintf(NULL, 0, fmt, args);
+    va_end(args);
+    if (n < 0 || buffer_reserve(b, n) != 0) return;
+
+    va_start(args, fmt);
+    vsnprintf(b->data + b->len, n + 1, fmt, args);
+    va_end(args);
+    b->len += n;
+}
+
+/* appends s escaped for the inside of a C string literal */
+void buffer_append_literal(buffer_t *b, const char *s, size_t len) {
+    if (buffer_reserve(b, len * 2) != 0) return;
+
+    char *w = b->data + b->len;
+    for (size_t i = 0; i < len; i++) {
+        switch (s[i]) {
+        case '\n': *w++ = '\\'; *w++ = 'n'; break;
+        case '\r': *w++ = '\\'; *w++ = 'r'; break;
+        case '\t': *w++ = '\\'; *w++ = 't'; break;
+        case '"': *w++ = '\\'; *w++ = '"'; break;
+        case '\\': *w++ = '\\'; *w++ = '\\'; break;
+        default: *w++ = s[i];
+        }
     }
+    b->len = w - b->data;
+    b->data[b->len] = '\0';
+}
+
+const char *buffer_str(const buffer_t *b) { return b->data ? b->data : ""; }
 
-    char *read_ptr = s;
-    char *write_ptr = temp_buf;
-
-    while (*read_ptr != '\0') {
-        if (*read_ptr == '\n') {
-            *write_ptr++ = '\\';
-            *write_ptr++ = 'n';
-            read_ptr++;
-        } else if (*read_ptr == '"') {
-            *write_ptr++ = '\\';
-            *write_ptr++ = '"';
-            read_ptr++;
-        } else if (*read_ptr == '\\') {
-            *write_ptr++ = '\\';
-            *write_ptr++ = '\\';
-            read_ptr++;
-        } else if (*read_ptr == '\t') {
-            *write_ptr++ = '\\';
-            *write_ptr++ = 't';
-            read_ptr++;
-        } else if (*read_ptr == '\r') {
-            read_ptr++;
-            *write_ptr++ = '\\';
-            *write_ptr++ = 'r';
-            read_ptr++;
-        } else if (((unsigned char)*read_ptr) >= 0x80) {
-            unsigned char byte = (unsigned char)*read_ptr;
-            int utf8_len = 1;
-
-            if ((byte & 0xE0) == 0xC0)
-                utf8_len = 2;
-            else if ((byte & 0xF0) == 0xE0)
-                utf8_len = 3;
-            else if ((byte & 0xF8) == 0xF0)
-                utf8_len = 4;
-
-            for (int i = 0; i < utf8_len && *read_ptr != '\0'; i++) {
-                *write_ptr++ = *read_ptr++;
+void buffer_free(buffer_t *b) {
+    free(b->data);
+    b->data = NULL;
+    b->len = b->cap = 0;
+}
+
+/*
+*   Copies tmpl into out in one pass, replacing every placeholder. Text
+*   substituted in is not scanned again.
+*/
+int expand_template(buffer_t *out, const char *tmpl, const placeholder_t *placeholders,
+                    int count) {
+    const char *p = tmpl;
+    const char *mark;
+
+    while ((mark = strstr(p, "%%")) != NULL) {
+        buffer_append(out, p, mark - p);
+
+        int matched = 0;
+        for (int i = 0; i < count; i++) {
+            size_t len = strlen(placeholders[i].placeholder);
+            if (strncmp(mark, placeholders[i].placeholder, len) == 0) {
+                buffer_append(out, placeholders[i].replacement,
+                              strlen(placeholders[i].replacement));
+                p = mark + len;
+                matched = 1;
+                break;
             }
-        } else {
-            *write_ptr++ = *read_ptr++;
+        }
+        if (!matched) {
+            buffer_append(out, mark, 1);
+            p = mark + 1;
         }
     }
+    buffer_append(out, p, strlen(p));
+    return out->failed ? -1 : 0;
+}
 
-    *write_ptr = '\0';
-    strcpy(s, temp_buf);
-    free(temp_buf);
+/*
+*   Position in the template being compiled, for error messages. line is
+*   kept up to date as pos moves forward, so the whole template is
+*   scanned once.
+*/
+typedef struct {
+    const char *path;
+    const char *src;
+    size_t len;
+    size_t pos;
+    int line;
+} lexer_t;
+
+void lexer_advance(lexer_t *lx, size_t to) {
+    const char *p = lx->src + lx->pos;
+    const char *end = lx->src + to;
+    while ((p = memchr(p, '\n', end - p)) != NULL) {
+        lx->line++;
+        p++;
+    }
+    lx->pos = to;
+}
+
+/* for the few errors reported before the body is lexed */
+int line_at(const char *src, size_t offset) {
+    int line = 1;
+    const char *p = src;
+    const char *end = src + offset;
+    while ((p = memchr(p, '\n', end - p)) != NULL) {
+        line++;
+        p++;
+    }
+    return line;
+}
+
+void lexer_report(const lexer_t *lx, int line, const char *kind, const char *fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    fprintf(stderr, "%s:%d: %s: ", lx->path, line, kind);
+    vfprintf(stderr, fmt, args);
+    fputc('\n', stderr);
+    va_end(args);
+}
+
+void emit_text(buffer_t *out, const char *s, size_t len) {
+    if (len == 0) return;
+    response_length += len;
+    buffer_append(out, "\tcx_write_static(out, \"", 23);
+    buffer_append_literal(out, s, len);
+    buffer_append(out, "\");\n", 4);
+}
+
+/*
+*   Emits a runtime include through the cx_include cache, so renders do no
+*   file I/O unless the file changed.
+*/
+void format_include(buffer_t *out, const char *source, const char *path) {
+    buffer_printf(out,
+                  "\t{\n"
+                  "\tconst char *include_data;\n"
+                  "\tsize_t include_len;\n"
+                  "\tif (cx_include(%s, &include_data, &include_len) == 0) {\n"
+                  "\t\tcx_write_len(out, include_data, include_len);\n"
+                  "\t} else {\n"
+                  "\t\tcx_write_static(out, \"HTML file not found : %s\");\n"
+                  "\t}\n"
+                  "\t}\n",
+                  source, path);
+}
+
+/*
+*   Embeds a static include as a literal. Returns -1 when the file cannot
+*   be read now or is too large to inline; the caller then falls back to
+*   a runtime include.
+*/
+int inline_include(buffer_t *out, const char *path) {
+    FILE *f = fopen(path, "rb");
+    if (!f) return -1;
+
+    long length = get_file_length(f);
+    if (length < 0 || length > INLINE_INCLUDE_MAX) {
+        fclose(f);
+        return -1;
+    }
+
+    char *content = malloc(length + 1);
+    if (!content) {
+        fclose(f);
+        return -1;
+    }
+    size_t read = fread(content, 1, length, f);
+    fclose(f);
+
+    if (memchr(content, '\0', read)) {
+        free(content);
+        return -1;
+    }
+
+    emit_text(out, content, read);
+    free(content);
+    return 0;
+}
+
+/*
+*   {{cache key ttl}}: the key is any C expression yielding a string, the
+*   ttl is the last word. Returns 0 when start is not a cache directive
+*   and should be treated as code.
+*/
+int is_cache_directive(const char *start) {
+    if (strncmp(start, "cache", 5) != 0 || !isspace((unsigned char)start[5])) return 0;
+
+    const char *args = start + 5;
+    while (isspace((unsigned char)*args)) args++;
+    return *args && !strchr("=+-*/%[.;,)&|<>!?", *args);
+}
+
+/*
+*   A hit copies the cached bytes. A miss renders the block into its own
+*   cx_out_t, which shadows out until {{/cache}} stores it.
+*/
+int format_cache_open(buffer_t *out, const char *start, const lexer_t *lx, int line) {
+    const char *key = start + 5;
+    while (isspace((unsigned char)*key)) key++;
+
+    char *args = strdup(key);
+    if (!args) return -1;
+
+    char *end = args + strlen(args);
+    while (end > args && isspace((unsigned char)end[-1])) end--;
+    *end = '\0';
+    char *ttl = end;
+    while (ttl > args && !isspace((unsigned char)ttl[-1])) ttl--;
+    if (ttl == args) {
+        lexer_report(lx, line, "error", "{{cache %s}} needs a key and a ttl", args);
+        free(args);
+        return -1;
+    }
+    ttl[-1] = '\0';
+
+    buffer_printf(out,
+                  "\t{\n"
+                  "\tconst char *fragment_key = (%s);\n"
+                  "\tint fragment_ttl = (%s);\n"
+                  "\tconst char *fragment_data;\n"
+                  "\tsize_t fragment_len;\n"
+                  "\tif (cx_fragment_get(fragment_key, &fragment_data, &fragment_len) == 0) {\n"
+                  "\t\tcx_write_len(out, fragment_data, fragment_len);\n"
+                  "\t} else {\n"
+                  "\tcx_out_t fragment_out;\n"
+                  "\tcx_out_init(&fragment_out, %d);\n"
+                  "\t{\n"
+                  "\tcx_out_t *out = &fragment_out;\n",
+                  args, ttl, FRAGMENT_SIZE_HINT);
+    free(args);
+    return 0;
+}
+
+/*
+*   Reads the loop variable of {{each name in ...}} and returns the text
+*   after "in", or NULL when start is not an each directive.
+*/
+const char *parse_each(const char *start, char *name) {
+    if (strncmp(start, "each", 4) != 0 || !isspace((unsigned char)start[4])) return NULL;
+
+    const char *p = start + 4;
+    while (isspace((unsigned char)*p)) p++;
+
+    int name_len = 0;
+    while ((isalnum((unsigned char)*p) || *p == '_') && name_len < MAX_NAME - 1) {
+        name[name_len++] = *p++;
+    }
+    name[name_len] = '\0';
+    while (isspace((unsigned char)*p)) p++;
+
+    if (name_len == 0 || isdigit((unsigned char)name[0]) ||
+        strncmp(p, "in", 2) != 0 || !isspace((unsigned char)p[2])) {
+        return NULL;
+    }
+    return p + 3;
 }
 
-void process_code(char *s) {
-    if (!s) return;
+/*
+*   {{each item in arr, n}}: the array and count are evaluated once, the
+*   split is at the last comma outside parentheses and brackets.
+*/
+int format_each_open(buffer_t *out, const char *start, const lexer_t *lx, int line) {
+    char name[MAX_NAME];
+    const char *p = parse_each(start, name);
+    if (!p) return -1;
+
+    char *array = strdup(p);
+    if (!array) return -1;
+
+    char *comma = NULL;
+    int depth = 0;
+    for (char *c = array; *c; c++) {
+        if (*c == '(' || *c == '[') depth++;
+        else if (*c == ')' || *c == ']') depth--;
+        else if (*c == ',' && depth == 0) comma = c;
+    }
+    if (!comma) {
+        lexer_report(lx, line, "error", "{{each %s}} needs a count", name);
+        free(array);
+        return -1;
+    }
+    *comma = '\0';
+
+    buffer_printf(out,
+                  "\t{\n"
+                  "\t__typeof__(&(%s)[0]) %s_array = (%s);\n"
+                  "\tlong %s_count = (long)(%s);\n"
+                  "\tfor (long %s_index = 0; %s_index < %s_count; %s_index++) {\n"
+                  "\t__typeof__(%s_array[0]) %s = %s_array[%s_index];\n"
+                  "\t(void)%s;\n",
+                  array, name, array,
+                  name, comma + 1,
+                  name, name, name, name,
+                  name, name, name, name,
+                  name);
+    free(array);
+    return 0;
+}
 
-    char tmp[BUFFER_SIZE] = {0};
-    char *start = s;
+/*
+*   Compiles the contents of one {{ }} that starts at line. Returns -1 on
+*   an invalid directive.
+*/
+int process_code(buffer_t *out, const lexer_t *lx, int line, const char *s, size_t len) {
+    while (len > 0 && isspace((unsigned char)*s)) {
+        s++;
+        len--;
+    }
+    while (len > 0 && isspace((unsigned char)s[len - 1])) len--;
 
-    while (isspace((unsigned char)*start)) start++;
+    char *start = strndup(s, len);
+    if (!start) return -1;
 
-    char *end = start + strlen(start) - 1;
-    while (end > start && isspace((unsigned char)*end)) end--;
-    *(end + 1) = '\0';
+    char each_name[MAX_NAME];
+    int res = 0;
 
     if (*start == '=' && *(start + 1) == '%') {
-        char path[PATH_MAX];
-        snprintf(path, PATH_MAX, "%s", start + 2);
-
-        snprintf(tmp, BUFFER_SIZE,
-                 "\tFILE *html_file = fopen(%s, \"r\");\n"
-                 "\tif(!html_file) {\n"
-                 "\t\tfast_strcat(output, \"HTML file not found : %s\");\n"
-                 "\t\treturn output;\n"
-                 "\t}\n"
-                 "\tint html_size = get_file_length(html_file);\n"
-                 "\tchar *html_content = malloc(html_size + 1);\n"
-                 "\tif(!html_content) {\n"
-                 "\t\tfast_strcat(output, \"Malloc failed?\");\n"
-                 "\t\treturn output;\n"
-                 "\t}\n"
-                 "\tfread(html_content, 1, html_size, html_file);\n"
-                 "\thtml_content[html_size] = '\\0';\n"
-                 "\tfast_strcat(output, html_content);\n"
-                 "\tfree(html_content);\n"
-                 "\tfclose(html_file);\n"
-                 "\t",
-                 path, path);
-
-        FILE *f = fopen(path, "r");
-        if (f) {
-            response_length += get_file_length(f);
-            fclose(f);
-        }
-        else {
-            response_length += 1024;
-        }
+        format_include(out, start + 2, start + 2);
+        response_length += DYNAMIC_SEGMENT_HINT;
     }
     else if (*start == '=') {
-        snprintf(tmp, BUFFER_SIZE, "\tfast_strcat(output, %s);", start + 1);
+        buffer_printf(out, "\tcx_write_escaped(out, %s);", start + 1);
+        response_length += DYNAMIC_SEGMENT_HINT;
+    }
+    else if (*start == '!') {
+        buffer_printf(out, "\tcx_write(out, %s);", start + 1);
+        response_length += DYNAMIC_SEGMENT_HINT;
+    }
+    else if (strcmp(start, "/each") == 0) {
+        buffer_printf(out, "\t}\n\t}\n");
+    }
+    else if (parse_each(start, each_name)) {
+        res = format_each_open(out, start, lx, line);
+    }
+    else if (strcmp(start, "flush") == 0) {
+        buffer_printf(out, "\tcx_flush(out);\n");
+    }
+    else if (strcmp(start, "/cache") == 0) {
+        buffer_printf(out,
+                      "\t}\n"
+                      "\tif (!fragment_out.failed) cx_write_len(out, fragment_out.data, fragment_out.len);\n"
+                      "\tcx_fragment_put(fragment_key, fragment_ttl, &fragment_out);\n"
+                      "\t}\n"
+                      "\t}\n");
+    }
+    else if (is_cache_directive(start)) {
+        res = format_cache_open(out, start, lx, line);
+        response_length += DYNAMIC_SEGMENT_HINT;
     }
     else if (*start == '/') {
-        snprintf(tmp, BUFFER_SIZE, "\t}\n");
+        buffer_printf(out, "\t}\n");
     }
     else if (*start == '?' && *(start + 1) != '\0') {
-        char condition[256] = {0};
-        strncpy(condition, start + 1, sizeof(condition) - 1);
-        snprintf(tmp, BUFFER_SIZE, "\tif (%s) {\n", condition);
+        buffer_printf(out, "\tif (%s) {\n", start + 1);
     }
     else if (*start == '%') {
-        char path[PATH_MAX];
-        snprintf(path, PATH_MAX, "%s", start + 1);
-
-        snprintf(tmp, BUFFER_SIZE,
-                 "\tFILE *html_file = fopen(\"%s\", \"r\");\n"
-                 "\tif(!html_file) {\n"
-                 "\t\tfast_strcat(output, \"HTML file not found : %s\");\n"
-                 "\t\treturn output;\n"
-                 "\t}\n"
-                 "\tint html_size = get_file_length(html_file);\n"
-                 "\tchar *html_content = malloc(html_size + 1);\n"
-                 "\tif(!html_content) {\n"
-                 "\t\tfast_strcat(output, \"Malloc failed?\");\n"
-                 "\t\treturn output;\n"
-                 "\t}\n"
-                 "\tfread(html_content, 1, html_size, html_file);\n"
-                 "\thtml_content[html_size] = '\\0';\n"
-                 "\tfast_strcat(output, html_content);\n"
-                 "\tfree(html_content);\n"
-                 "\tfclose(html_file);\n"
-                 "\t",
-                 path, path);
-
-        FILE *f = fopen(path, "r");
-        if (f) {
-            response_length += get_file_length(f);
-            fclose(f);
-        }
-        else {
-            response_length += 1024;
+        const char *path = start + 1;
+        add_dependency(path);
+
+        if (inline_include(out, path) != 0) {
+            lexer_report(lx, line, "warning", "%s cannot be inlined, including it at runtime", path);
+            buffer_t source = {0};
+            buffer_printf(&source, "\"%s\"", path);
+            format_include(out, buffer_str(&source), path);
+            buffer_free(&source);
+            response_length += DYNAMIC_SEGMENT_HINT;
         }
     }
     else {
-        snprintf(tmp, BUFFER_SIZE, "\t%s", start);
+        buffer_printf(out, "\t%s", start);
     }
 
-    strcpy(s, tmp);
-    strcat(s, "\n");
+    buffer_append(out, "\n", 1);
+    free(start);
+    return res;
 }
 
 char *get_template(Template t) {
@@ -353,21 +591,152 @@ char *get_template(Template t) {
     return content;
 }
 
-int save_file(const char *path, const char *buf) {
-    FILE *f = fopen(path, "w");
+/*
+*   Leaves the file alone when it already holds buf, so its mtime and the
+*   object make built from it stay valid.
+*/
+int save_file(const char *path, const char *buf, size_t len) {
+    FILE *f = fopen(path, "rb");
+    if (f != NULL) {
+        long old_length = get_file_length(f);
+        int same = 0;
+        if (old_length == (long)len) {
+            char *old = malloc(len + 1);
+            same = old && fread(old, 1, len, f) == len && memcmp(old, buf, len) == 0;
+            free(old);
+        }
+        fclose(f);
+        if (same) return 0;
+    }
+
+    char tmp[MAX_FILE_NAME + 8];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    f = fopen(tmp, "w");
     if (f == NULL) {
         perror("Error opening file for writing");
         return -1;
     }
 
-    fwrite(buf, 1, strlen(buf), f);
+    fwrite(buf, 1, len, f);
     fclose(f);
+    if (rename(tmp, path) != 0) {
+        perror("Error replacing output");
+        unlink(tmp);
+        return -1;
+    }
     return 0;
 }
 
-int generate(FILE *f, const char *filename, long length, char *ctemp,
-             char *htemp) {
-    response_length = 1024 * 1024;
+/*
+*   Returns the } matching the { at open, skipping braces inside string
+*   and character literals, or NULL if it is not closed before end.
+*/
+const char *match_brace(const char *open, const char *end) {
+    int depth = 0;
+    for (const char *p = open; p < end; p++) {
+        if (*p == '"' || *p == '\'') {
+            char quote = *p;
+            for (p++; p < end && *p != quote; p++) {
+                if (*p == '\\') p++;
+            }
+            if (p >= end) return NULL;
+        } else if (*p == '{') {
+            depth++;
+        } else if (*p == '}' && --depth == 0) {
+            return p;
+        }
+    }
+    return NULL;
+}
+
+/*
+*   const ({ .title = "x" }) declares constant props. The template then
+*   also gets page_{name}(), which renders it once with them into a
+*   cx_page_t. Only the preamble before the first HTML line is searched,
+*   and the declaration is blanked out of it so the props and prepend
+*   parsing never see it.
+*/
+int extract_const_props(char *content, const lexer_t *lx, const char *filename,
+                        const char *props_name, const char *func_name,
+                        buffer_t *page_code, buffer_t *page_decl) {
+    char *preamble_end = strstr(content, "\n<");
+    if (preamble_end == NULL) return 0;
+
+    char *start = memmem(content, preamble_end - content, "const (", 7);
+    if (start == NULL) return 0;
+
+    char *init = start + 7;
+    while (init < preamble_end && isspace((unsigned char)*init)) init++;
+
+    const char *close = init < preamble_end && *init == '{' ? match_brace(init, preamble_end) : NULL;
+    char *end = close ? (char *)close + 1 : NULL;
+    while (end && end < preamble_end && isspace((unsigned char)*end)) end++;
+    if (end == NULL || end >= preamble_end || *end != ')') {
+        lexer_report(lx, line_at(content, start - content), "error",
+                     "const props must be const ({ ... })");
+        return -1;
+    }
+
+    buffer_t initializer = {0};
+    buffer_append(&initializer, init, close + 1 - init);
+    for (char *p = start; p <= end; p++) {
+        if (*p != '\n') *p = ' ';
+    }
+
+    buffer_printf(page_code,
+                  "static cx_page_t %s_page;\n"
+                  "\n"
+                  "const cx_page_t *page_%s(void)\n"
+                  "{\n"
+                  "    if (!%s_page.data) {\n"
+                  "        %s props = %s;\n"
+                  "        cx_page_build(&%s_page, %s(&props), \"text/html; charset=utf-8\");\n"
+                  "    }\n"
+                  "    return &%s_page;\n"
+                  "}\n",
+                  filename, filename, filename, props_name, buffer_str(&initializer),
+                  filename, func_name, filename);
+    buffer_printf(page_decl,
+                  "/* rendered once with the constant props */\n"
+                  "const cx_page_t *page_%s(void);\n",
+                  filename);
+    buffer_free(&initializer);
+    return 0;
+}
+
+/*
+*   Compiles the template body in a single pass: text up to the next {{
+*   becomes a cx_write_static, the code up to the matching }} goes
+*   through process_code.
+*/
+int lex_body(lexer_t *lx, buffer_t *out) {
+    while (lx->pos < lx->len) {
+        const char *rest = lx->src + lx->pos;
+        const char *open = memmem(rest, lx->len - lx->pos, "{{", 2);
+        size_t text_end = open ? (size_t)(open - lx->src) : lx->len;
+
+        emit_text(out, rest, text_end - lx->pos);
+        lexer_advance(lx, text_end);
+        if (!open) break;
+
+        int line = lx->line;
+        const char *code = open + 2;
+        const char *close = memmem(code, lx->src + lx->len - code, "}}", 2);
+        if (close == NULL) {
+            lexer_report(lx, line, "error", "{{ is never closed");
+            return -1;
+        }
+
+        if (process_code(out, lx, line, code, close - code) != 0) return -1;
+        lexer_advance(lx, close + 2 - lx->src);
+    }
+    return out->failed ? -1 : 0;
+}
+
+int generate(FILE *f, const char *path, const char *filename, long length,
+             char *ctemp, char *htemp) {
+    response_length = 0;
+    deps_len = 0;
 
     char *content = calloc(length + 1, sizeof(char));
     if (content == NULL) {
@@ -375,30 +744,54 @@ int generate(FILE *f, const char *filename, long length, char *ctemp,
         return -1;
     }
 
-    fread(content, 1, length, f);
+    length = fread(content, 1, length, f);
     content[length] = '\0';
 
+    lexer_t lx = {.path = path, .src = content, .len = length, .pos = 0, .line = 1};
+
+    const char *nul = memchr(content, '\0', length);
+    if (nul != NULL) {
+        lexer_report(&lx, line_at(content, nul - content), "error", "template contains a NUL byte");
+        free(content);
+        return -1;
+    }
+
     char props_name[MAX_NAME] = {0};
     char main_function_name[MAX_NAME] = {0};
     char file_id[MAX_NAME] = {0};
-    char props_struct[BUFFER_SIZE] = {0};
-    char prepend[BUFFER_SIZE] = {0};
-    char function_code[BUFFER_SIZE] = {0};
+    char h_file_id[MAX_NAME + 4] = {0};
+    char response_length_buffer[32] = {0};
 
     get_props_name(props_name, filename);
     snprintf(main_function_name, sizeof(main_function_name), "render_%s",
              filename);
     snprintf(file_id, sizeof(file_id), "%s", filename);
+    snprintf(h_file_id, sizeof(h_file_id), "_%s_H", file_id);
 
-    char *props_start = strstr(content, "({") + 2;
+    buffer_t props_struct = {0};
+    buffer_t prepend = {0};
+    buffer_t function_code = {0};
+    buffer_t page_code = {0};
+    buffer_t page_decl = {0};
+    buffer_t c_output = {0};
+    buffer_t h_output = {0};
+    int res = -1;
+
+    if (extract_const_props(content, &lx, filename, props_name, main_function_name,
+                            &page_code, &page_decl) != 0) {
+        goto done;
+    }
+
+    char *props_start = strstr(content, "({");
     if (props_start != NULL) {
+        props_start += 2;
         char *props_end = strstr(props_start, "})");
         if (props_end == NULL) {
-            perror("Could not find }) closing props struct");
-            free(content);
-            return -1;
+            lexer_report(&lx, line_at(content, props_start - content), "error",
+                         "could not find }) closing props struct");
+            goto done;
         }
-        strncat(props_struct, props_start, props_end - props_start);
+        buffer_append(&props_struct, props_start, props_end - props_start);
         props_start = props_end + 2;
     } else {
         props_start = content;
@@ -406,121 +799,67 @@ int generate(FILE *f, const char *filename, long length, char *ctemp,
 
     char *first_html = strstr(props_start, "\n<");
     if (first_html == NULL) {
-        perror("No HTML found, aborting");
-        free(content);
-        return -1;
-    }
-    strncat(prepend, props_start, first_html - props_start);
-
-    char *ptr = first_html + 1;
-    char *code_start, *code_end;
-
-    while ((code_start = strstr(ptr, "{{")) && (code_end = strstr(ptr, "}}"))) {
-        char text[BUFFER_SIZE / 2] = {0};
-        strncpy(text, ptr, code_start - ptr);
-        process_text(text);
-        snprintf(function_code + strlen(function_code), BUFFER_SIZE,
-                 "\tfast_strcat(output, \"%s\");\n", text);
-        response_length += strlen(text);
-
-        char code[BUFFER_SIZE] = {0};
-        strncpy(code, code_start + 2, code_end - code_start - 2);
-        process_code(code);
-        strcat(function_code, code);
-        response_length += 10 + strlen(code);
-
-        ptr = code_end + 2;
-    }
-
-    if (ptr != NULL && *ptr != '\0') {
-        char remaining[BUFFER_SIZE / 2] = {0};
-        strcpy(remaining, ptr);
-        process_text(remaining);
-        snprintf(function_code + strlen(function_code), BUFFER_SIZE,
-                 "\tfast_strcat(output, \"%s\");\n", remaining);
-        response_length += strlen(remaining);
-    }
-
-    char *c_output = malloc(BUFFER_SIZE);
-    char *h_output = malloc(BUFFER_SIZE);
-
-    if (c_output == NULL || h_output == NULL) {
-        perror("Error allocating memory");
-        free(content);
-        return -1;
+        lexer_report(&lx, line_at(content, props_start - content), "error",
+                     "no HTML found after the props");
+        goto done;
     }
+    buffer_append(&prepend, props_start, first_html - props_start);
 
-    strcpy(c_output, ctemp);
-    strcpy(h_output, htemp);
+    lexer_advance(&lx, first_html + 1 - content);
+    if (lex_body(&lx, &function_code) != 0) goto done;
 
-    char response_length_buffer[128] = {0};
-    snprintf(response_length_buffer, 128, "%ld", response_length);
+    snprintf(response_length_buffer, sizeof(response_length_buffer), "%ld", response_length);
 
     placeholder_t c_placeholders[] = {
-        {"%%CODE%%", function_code},
+        {"%%CODE%%", buffer_str(&function_code)},
         {"%%FUNC_NAME%%", main_function_name},
         {"%%PROPS_NAME%%", props_name},
-        {"%%PREPEND%%", prepend},
+        {"%%PREPEND%%", buffer_str(&prepend)},
         {"%%NAME%%", file_id},
-        {"%%RESPONSE_SIZE%%", response_length_buffer}};
-
-    for (int i = 0; i < 6; i++) {
-        if (replace_placeholder(&c_output, c_placeholders[i].placeholder,
-                                c_placeholders[i].replacement) < 0) {
-            perror("Replace error");
-            free(c_output);
-            free(h_output);
-            free(content);
-            return -1;
-        }
-    }
-
-    char h_file_id[256] = {0};
-    snprintf(h_file_id, sizeof(h_file_id), "_%s_H", file_id);
+        {"%%RESPONSE_SIZE%%", response_length_buffer},
+        {"%%PAGE%%", buffer_str(&page_code)}};
 
     placeholder_t h_placeholders[] = {{"%%FILE_ID%%", h_file_id},
-                                    {"%%PROPS%%", props_struct},
+                                    {"%%PROPS%%", buffer_str(&props_struct)},
                                     {"%%STRUCT_NAME%%", props_name},
-                                    {"%%FUNC_NAME%%", main_function_name}};
-
-    for (int i = 0; i < 4; i++) {
-        if (replace_placeholder(&h_output, h_placeholders[i].placeholder,
-                                h_placeholders[i].replacement) < 0) {
-            perror("Replace error");
-            free(c_output);
-            free(h_output);
-            free(content);
-            return -1;
-        }
+                                    {"%%FUNC_NAME%%", main_function_name},
+                                    {"%%PAGE%%", buffer_str(&page_decl)}};
+
+    if (expand_template(&c_output, ctemp, c_placeholders, 7) != 0 ||
+        expand_template(&h_output, htemp, h_placeholders, 5) != 0) {
+        goto done;
     }
 
     char c_file[MAX_FILE_NAME] = {0};
     snprintf(c_file, sizeof(c_file), "%s%s.c", SAVE_PATH, filename);
-    if (save_file(c_file, c_output) != 0) {
-        free(c_output);
-        free(h_output);
-        free(content);
-        return -1;
-    }
-
     char h_file[MAX_FILE_NAME] = {0};
     snprintf(h_file, sizeof(h_file), "%s%s.h", SAVE_PATH, filename);
-    if (save_file(h_file, h_output) != 0) {
-        free(c_output);
-        free(h_output);
-        free(content);
-        return -1;
-    }
 
-    free(c_output);
-    free(h_output);
+    if (save_file(c_file, c_output.data, c_output.len) != 0 ||
+        save_file(h_file, h_output.data, h_output.len) != 0) {
+        goto done;
+    }
+    res = 0;
+
+done:
+    buffer_free(&props_struct);
+    buffer_free(&prepend);
+    buffer_free(&function_code);
+    buffer_free(&page_code);
+    buffer_free(&page_decl);
+    buffer_free(&c_output);
+    buffer_free(&h_output);
     free(content);
-    return 0;
+    return res;
 }
 
-int process_directory_recursive(const char *dir_path, char *ctemp, char *htemp,
-                                processed_file_t *files, int *processed_count,
-                                int *total_capacity) {
+typedef struct {
+    processed_file_t *items;
+    int count;
+    int capacity;
+} file_list_t;
+
+int collect_templates(const char *dir_path, file_list_t *files) {
     struct dirent *entry;
     DIR *dir = opendir(dir_path);
 
@@ -543,8 +882,10 @@ int process_directory_recursive(const char *dir_path, char *ctemp, char *htemp,
         snprintf(path, sizeof(path), "%s/%s", dir_path, entry->d_name);
 
         if (entry->d_type == DT_DIR) {
-            process_directory_recursive(path, ctemp, htemp, files,
-                                        processed_count, total_capacity);
+            if (collect_templates(path, files) != 0) {
+                closedir(dir);
+                return -1;
+            }
         } else if (entry->d_type == DT_REG && has_cx_extension(entry->d_name)) {
             char filename[MAX_NAME] = {0};
             const char *dot = strrchr(entry->d_name, '.');
@@ -555,74 +896,323 @@ int process_directory_recursive(const char *dir_path, char *ctemp, char *htemp,
             filename[name_len < MAX_NAME ? name_len : MAX_NAME - 1] = '\0';
 
             int collision_idx =
-                find_collision(files, *processed_count, filename);
+                find_collision(files->items, files->count, filename);
             if (collision_idx >= 0) {
-                files[collision_idx].collision_count++;
+                files->items[collision_idx].collision_count++;
                 fprintf(stderr,
                         "WARNING: Duplicate filename '%s' found (count: %d)\n",
-                        filename, files[collision_idx].collision_count);
+                        filename, files->items[collision_idx].collision_count);
                 fprintf(stderr, "  First:  %s\n",
-                        files[collision_idx].filepath);
+                        files->items[collision_idx].filepath);
                 fprintf(stderr, "  Current: %s\n", path);
                 fprintf(stderr,
                         "  Skipping current file to avoid overwriting.\n");
                 continue;
             }
 
-            if (*processed_count >= *total_capacity) {
-                *total_capacity *= 2;
-                processed_file_t *new_files =
-                    realloc(files, sizeof(processed_file_t) * (*total_capacity));
-                if (new_files == NULL) {
+            if (files->count >= files->capacity) {
+                int capacity = files->capacity ? files->capacity * 2 : 64;
+                processed_file_t *items =
+                    realloc(files->items, sizeof(processed_file_t) * capacity);
+                if (items == NULL) {
                     perror("Failed to expand file tracking array");
                     closedir(dir);
                     return -1;
                 }
-                files = new_files;
+                files->items = items;
+                files->capacity = capacity;
             }
 
-            FILE *file = fopen(path, "r");
-            if (file == NULL) {
-                fprintf(stderr, "Failed to open %s\n", path);
-                continue;
-            }
+            processed_file_t *file = &files->items[files->count++];
+            snprintf(file->filename, sizeof(file->filename), "%s", filename);
+            snprintf(file->filepath, sizeof(file->filepath), "%s", path);
+            file->collision_count = 0;
+        }
+    }
 
-            long length = get_file_length(file);
-            if (length <= 0) {
-                fprintf(stderr, "Invalid file length for %s: %ld\n", path,
-                        length);
-                fclose(file);
-                continue;
-            }
+    closedir(dir);
+    return 0;
+}
+
+/*
+*   The manifest has one line per template: name, hash and the static
+*   includes it depends on, separated by tabs. The hash covers the cxc
+*   binary, both code templates, the .cx file and its includes, so a
+*   template whose hash is unchanged is skipped without being parsed.
+*/
+typedef struct {
+    char name[MAX_NAME];
+    unsigned long long hash;
+    char *deps;
+} manifest_entry_t;
+
+typedef struct {
+    manifest_entry_t *items;
+    int count;
+} manifest_t;
+
+#define FNV_OFFSET 14695981039346656037ULL
+#define FNV_PRIME 1099511628211ULL
+
+unsigned long long hash_bytes(unsigned long long h, const char *data, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        h ^= (unsigned char)data[i];
+        h *= FNV_PRIME;
+    }
+    return h;
+}
+
+/* a missing file hashes differently from an empty one */
+unsigned long long hash_file(unsigned long long h, const char *path) {
+    h = hash_bytes(h, path, strlen(path) + 1);
+
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) return hash_bytes(h, "\x01", 1);
 
-            int res = generate(file, filename, length, ctemp, htemp);
-            fclose(file);
-
-            if (res < 0) {
-                fprintf(stderr, "Failed to generate files for %s\n", filename);
-            } else {
-                strcpy(files[*processed_count].filename, filename);
-                strcpy(files[*processed_count].filepath, path);
-                files[*processed_count].collision_count = 0;
-                printf("Generated: %s.c and %s.h (from %s)\n", filename,
-                       filename, path);
-                (*processed_count)++;
+    char buf[65536];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0) {
+        h = hash_bytes(h, buf, n);
+    }
+    fclose(f);
+    return h;
+}
+
+/* deps is a tab separated list of paths */
+unsigned long long hash_template(unsigned long long seed, const char *path, const char *deps) {
+    unsigned long long h = hash_file(seed, path);
+
+    char dep[PATH_MAX];
+    while (*deps) {
+        size_t len = strcspn(deps, "\t");
+        snprintf(dep, sizeof(dep), "%.*s", (int)len, deps);
+        h = hash_file(h, dep);
+        deps += len + (deps[len] == '\t');
+    }
+    return h;
+}
+
+int load_manifest(manifest_t *manifest) {
+    manifest->items = NULL;
+    manifest->count = 0;
+
+    FILE *f = fopen(MANIFEST_PATH, "r");
+    if (f == NULL) return 0;
+
+    char *line = NULL;
+    size_t line_cap = 0;
+    ssize_t line_len;
+    int capacity = 0;
+    while ((line_len = getline(&line, &line_cap, f)) > 0) {
+        if (line[line_len - 1] == '\n') line[--line_len] = '\0';
+
+        char *name = line;
+        char *hash = strchr(name, '\t');
+        if (hash == NULL) continue;
+        *hash++ = '\0';
+        char *deps = strchr(hash, '\t');
+        if (deps) *deps++ = '\0';
+
+        if (manifest->count == capacity) {
+            capacity = capacity ? capacity * 2 : 64;
+            manifest_entry_t *items = realloc(manifest->items, sizeof(manifest_entry_t) * capacity);
+            if (items == NULL) break;
+            manifest->items = items;
+        }
+
+        manifest_entry_t *e = &manifest->items[manifest->count];
+        snprintf(e->name, sizeof(e->name), "%s", name);
+        e->hash = strtoull(hash, NULL, 16);
+        e->deps = strdup(deps ? deps : "");
+        if (e->deps == NULL) break;
+        manifest->count++;
+    }
+
+    free(line);
+    fclose(f);
+    return 0;
+}
+
+manifest_entry_t *manifest_find(manifest_t *manifest, const char *name) {
+    for (int i = 0; i < manifest->count; i++) {
+        if (strcmp(manifest->items[i].name, name) == 0) return &manifest->items[i];
+    }
+    return NULL;
+}
+
+int outputs_exist(const char *name) {
+    char path[MAX_FILE_NAME];
+    struct stat st;
+
+    snprintf(path, sizeof(path), "%s%s.c", SAVE_PATH, name);
+    if (stat(path, &st) != 0) return 0;
+    snprintf(path, sizeof(path), "%s%s.h", SAVE_PATH, name);
+    return stat(path, &st) == 0;
+}
+
+/*
+*   Identifies this cxc build and its code templates. Any change to them
+*   regenerates every template.
+*/
+unsigned long long generator_hash(void) {
+    unsigned long long h = hash_file(FNV_OFFSET, "/proc/self/exe");
+    h = hash_file(h, CTEMPLATE_PATH);
+    return hash_file(h, HTEMPLATE_PATH);
+}
+
+/*
+*   Regenerates one template unless the manifest shows it is unchanged,
+*   and writes its new manifest line to out. Returns 1 when the template
+*   was regenerated, 0 when skipped and -1 on failure.
+*/
+int build_template(const processed_file_t *file, manifest_t *manifest, unsigned long long seed,
+                   char *ctemp, char *htemp, FILE *out) {
+    manifest_entry_t *old = manifest_find(manifest, file->filename);
+    if (old && outputs_exist(file->filename) &&
+        hash_template(seed, file->filepath, old->deps) == old->hash) {
+        fprintf(out, "%s\t%016llx\t%s\n", old->name, old->hash, old->deps);
+        return 0;
+    }
+
+    FILE *f = fopen(file->filepath, "r");
+    if (f == NULL) {
+        fprintf(stderr, "Failed to open %s\n", file->filepath);
+        return -1;
+    }
+
+    long length = get_file_length(f);
+    if (length <= 0) {
+        fprintf(stderr, "Invalid file length for %s: %ld\n", file->filepath, length);
+        fclose(f);
+        return -1;
+    }
+
+    int res = generate(f, file->filepath, file->filename, length, ctemp, htemp);
+    fclose(f);
+    if (res < 0) {
+        fprintf(stderr, "Failed to generate files for %s\n", file->filename);
+        return -1;
+    }
+
+    buffer_t dep_list = {0};
+    for (int i = 0; i < deps_len; i++) {
+        buffer_printf(&dep_list, "%s%s", i > 0 ? "\t" : "", deps[i]);
+    }
+
+    fprintf(out, "%s\t%016llx\t%s\n", file->filename,
+            hash_template(seed, file->filepath, buffer_str(&dep_list)), buffer_str(&dep_list));
+    buffer_free(&dep_list);
+    printf("Generated: %s.c and %s.h (from %s)\n", file->filename,
+           file->filename, file->filepath);
+    return 1;
+}
+
+/*
+*   Templates are split across one forked worker per CPU. Each worker
+*   sends its manifest lines back through a pipe; the parent collects
+*   them into the new manifest.
+*/
+int build_all(file_list_t *files, manifest_t *manifest, char *ctemp, char *htemp,
+              FILE *new_manifest) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int workers = cpus > 0 ? (int)cpus : 1;
+    if (workers > MAX_WORKERS) workers = MAX_WORKERS;
+    if (workers > files->count) workers = files->count;
+
+    unsigned long long seed = generator_hash();
+    pid_t pids[MAX_WORKERS];
+    int pipes[MAX_WORKERS];
+    int started = 0;
+
+    fflush(stdout);
+    for (int w = 0; w < workers; w++) {
+        int fds[2];
+        if (pipe(fds) != 0) {
+            perror("pipe");
+            break;
+        }
+
+        pid_t pid = fork();
+        if (pid < 0) {
+            perror("fork");
+            close(fds[0]);
+            close(fds[1]);
+            break;
+        }
+
+        if (pid == 0) {
+            close(fds[0]);
+            for (int i = 0; i < started; i++) close(pipes[i]);
+
+            FILE *out = fdopen(fds[1], "w");
+            int failed = 0;
+            for (int i = w; out && i < files->count; i += workers) {
+                if (build_template(&files->items[i], manifest, seed, ctemp, htemp, out) < 0) failed = 1;
             }
+            if (out) fclose(out);
+            fflush(stdout);
+            _exit(failed || !out ? EXIT_FAILURE : EXIT_SUCCESS);
+        }
+
+        close(fds[1]);
+        pids[started] = pid;
+        pipes[started] = fds[0];
+        started++;
+    }
+
+    int failed = started < workers;
+    for (int w = 0; w < started; w++) {
+        FILE *in = fdopen(pipes[w], "r");
+        char buf[4096];
+        size_t n;
+        while (in && (n = fread(buf, 1, sizeof(buf), in)) > 0) {
+            fwrite(buf, 1, n, new_manifest);
+        }
+        if (in) fclose(in);
+        else close(pipes[w]);
+
+        int status = 0;
+        if (waitpid(pids[w], &status, 0) < 0 || !WIFEXITED(status) ||
+            WEXITSTATUS(status) != EXIT_SUCCESS) {
+            failed = 1;
         }
     }
+    return failed ? -1 : 0;
+}
+
+/*
+*   Deletes generated files of templates that no longer exist.
+*/
+void remove_stale_outputs(file_list_t *files) {
+    DIR *dir = opendir(SAVE_PATH);
+    if (dir == NULL) return;
+
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        const char *dot = strrchr(entry->d_name, '.');
+        if (entry->d_type != DT_REG || is_hidden(entry->d_name) || dot == NULL ||
+            (strcmp(dot, ".c") != 0 && strcmp(dot, ".h") != 0)) {
+            continue;
+        }
 
+        char name[MAX_NAME] = {0};
+        snprintf(name, sizeof(name), "%.*s", (int)(dot - entry->d_name), entry->d_name);
+        if (find_collision(files->items, files->count, name) >= 0) continue;
+
+        char path[MAX_FILE_NAME + 256];
+        snprintf(path, sizeof(path), "%s%s", SAVE_PATH, entry->d_name);
+        unlink(path);
+        printf("Removed: %s\n", path);
+    }
     closedir(dir);
-    return 0;
 }
 
 int main(void) {
-    if (clean_directory(SAVE_PATH) != 0) {
-        fprintf(stderr, "Failed to clean output directory\n");
+    if (ensure_directory(SAVE_PATH) != 0) {
+        fprintf(stderr, "Failed to create output directory\n");
         return EXIT_FAILURE;
     }
 
-    printf("Cleaned output directory: %s\n\n", SAVE_PATH);
-
     char *ctemplate = get_template(C);
     char *htemplate = get_template(H);
 
@@ -634,29 +1224,40 @@ int main(void) {
         return EXIT_FAILURE;
     }
 
-    int processed_count = 0;
-    int capacity = 256;
-    processed_file_t *files = malloc(sizeof(processed_file_t) * capacity);
-
-    if (files == NULL) {
-        perror("Failed to allocate file tracking array");
+    file_list_t files = {0};
+    if (collect_templates(PATH_TO_CX_FILES, &files) != 0) {
         free(ctemplate);
         free(htemplate);
+        free(files.items);
         return EXIT_FAILURE;
     }
 
-    if (process_directory_recursive(PATH_TO_CX_FILES, ctemplate, htemplate,
-                                    files, &processed_count, &capacity) != 0) {
-        free(ctemplate);
-        free(htemplate);
-        free(files);
-        return EXIT_FAILURE;
+    manifest_t manifest;
+    load_manifest(&manifest);
+
+    int res = 0;
+    FILE *new_manifest = fopen(MANIFEST_PATH ".tmp", "w");
+    if (new_manifest == NULL) {
+        perror("Error opening manifest for writing");
+        res = -1;
+    } else {
+        res = build_all(&files, &manifest, ctemplate, htemplate, new_manifest);
+        fclose(new_manifest);
+        if (rename(MANIFEST_PATH ".tmp", MANIFEST_PATH) != 0) {
+            perror("Error replacing manifest");
+            res = -1;
+        }
     }
 
+    remove_stale_outputs(&files);
+
+    for (int i = 0; i < manifest.count; i++) free(manifest.items[i].deps);
+    free(manifest.items);
     free(ctemplate);
     free(htemplate);
-    free(files);
+    free(files.items);
 
-    printf("\nProcessed: %d files\n", processed_count);
+    if (res != 0) return EXIT_FAILURE;
+    printf("Processed: %d files\n", files.count);
     return EXIT_SUCCESS;
 }
@@ -0,0 +1,740 @@
+/*
+ * Route Table Compiler
+ *
+ * ROUTES FILE SYNTAX (./routes.rt):
+ * =================================
+ * METHOD PATH HANDLER [host=NAME] [cache=TTL] [stale=SEC] [sse=CHANNEL] [ws=HANDLERS] [page=TEMPLATE]
+ *
+ * GET  /robots.txt          handle_robots
+ * GET  /users/:id           handle_user      host=api
+ * GET  /                    handle_root      cache=60 stale=30
+ * GET  /events              -                sse=dashboard
+ * GET  /chat                -                ws=chat_ws
+ * GET  /about               -                page=about
+ *
+ * Lines starting with '#' are comments. PATH uses the same syntax as
+ * add_route ('*' and ':name' parameters), host= takes the same values as
+ * add_route's sub_dom ("api", "shop.example.org" or "*"). sse= subscribes
+ * the client to an event channel, ws= names a ws_handler_t that accepts
+ * WebSocket upgrades; HANDLER may then be '-' for none. page= serves the
+ * prebuilt page of a cx template with constant props (page_TEMPLATE),
+ * rendered by route_table_prerender at startup; HANDLER must be '-'.
+ *
+ * Every route becomes a statically initialised route_t, so startup does
+ * not allocate. Static paths are found through a generated perfect hash
+ * over (host level, host, method, path) plus one memcmp. Parameterized
+ * paths are found through a switch on the number of path segments and a
+ * generated matcher per route that records parameter slices.
+ *
+ * Output format: ./src/rtc/route_table.c (API in ./src/routes.h)
+ */
+
+#include <ctype.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#define ROUTES_FILE "./routes.rt"
+#define SAVE_PATH "./src/rtc/"
+#define SAVE_FILE "./src/rtc/route_table.c"
+#define SAVE_TMP SAVE_FILE ".tmp"
+
+#define MAX_LINE 1024
+#define MAX_FIELD 265
+#define MAX_PARAMS 16
+#define MAX_SEED_TRIES 100000
+#define CACHE_ENTRIES 64
+
+typedef struct {
+    char method[16];
+    char path[MAX_FIELD];
+    char handler[128];
+    char host[MAX_FIELD];
+    int has_host;
+    int cache_ttl;
+    int stale_ttl;
+    char sse_channel[128];
+    char ws_handler[128];
+    char page[128];
+    int is_static;
+    int segments;
+    char key[MAX_FIELD * 2 + 32];
+    size_t key_len;
+    int line;
+} route_decl_t;
+
+typedef struct {
+    route_decl_t *items;
+    int count;
+    int capacity;
+} route_list_t;
+
+static const char *methods[] = {"GET", "POST", "PUT", "DELETE", "HEAD", "OPTIONS"};
+
+/*
+*   Must stay identical to the route_table_hash emitted into the generated
+*   file.
+*/
+uint32_t key_hash(const char *s, size_t len, uint32_t seed) {
+    uint32_t h = 2166136261u ^ seed;
+    for (size_t i = 0; i < len; i++) {
+        h ^= (unsigned char)s[i];
+        h *= 16777619u;
+    }
+    return h ^ (h >> 15);
+}
+
+int is_param_start(const char *path, const char *p) {
+    return *p == '*' || (*p == ':' && (p == path || *(p - 1) == '/'));
+}
+
+int valid_method(const char *method) {
+    for (size_t i = 0; i < sizeof(methods) / sizeof(methods[0]); i++) {
+        if (strcmp(methods[i], method) == 0) return 1;
+    }
+    return 0;
+}
+
+char host_level(const route_decl_t *r) {
+    if (!r->has_host) return 'B';
+    if (strcmp(r->host, "*") == 0) return 'D';
+    return strchr(r->host, '.') ? 'F' : 'S';
+}
+
+/*
+*   Key layout: level byte, lowercase host, 0x1f, method, 0x1f, path.
+*/
+void build_key(route_decl_t *r) {
+    char level = host_level(r);
+    const char *host = (level == 'F' || level == 'S') ? r->host : "";
+
+    size_t pos = 0;
+    r->key[pos++] = level;
+    for (; *host; host++) r->key[pos++] = tolower((unsigned char)*host);
+    r->key[pos++] = 0x1f;
+    pos += snprintf(r->key + pos, sizeof(r->key) - pos, "%s", r->method);
+    r->key[pos++] = 0x1f;
+    pos += snprintf(r->key + pos, sizeof(r->key) - pos, "%s", r->path);
+    r->key_len = pos;
+}
+
+int parse_line(char *line, int line_no, route_decl_t *r) {
+    memset(r, 0, sizeof(*r));
+    r->line = line_no;
+
+    char *fields[8] = {0};
+    int count = 0;
+    for (char *tok = strtok(line, " \t\r\n"); tok && count < 8; tok = strtok(NULL, " \t\r\n")) {
+        fields[count++] = tok;
+    }
+
+    if (count == 0 || fields[0][0] == '#') return 1;
+    if (count < 3) {
+        fprintf(stderr, "%s:%d: expected METHOD PATH HANDLER\n", ROUTES_FILE, line_no);
+        return -1;
+    }
+
+    if (!valid_method(fields[0])) {
+        fprintf(stderr, "%s:%d: unsupported method %s\n", ROUTES_FILE, line_no, fields[0]);
+        return -1;
+    }
+    if (fields[1][0] != '/' || strlen(fields[1]) >= sizeof(r->path)) {
+        fprintf(stderr, "%s:%d: invalid path %s\n", ROUTES_FILE, line_no, fields[1]);
+        return -1;
+    }
+
+    snprintf(r->method, sizeof(r->method), "%s", fields[0]);
+    snprintf(r->path, sizeof(r->path), "%s", fields[1]);
+    snprintf(r->handler, sizeof(r->handler), "%s", fields[2]);
+
+    for (int i = 3; i < count; i++) {
+        if (strncmp(fields[i], "host=", 5) == 0) {
+            snprintf(r->host, sizeof(r->host), "%s", fields[i] + 5);
+            r->has_host = 1;
+        } else if (strncmp(fields[i], "cache=", 6) == 0) {
+            r->cache_ttl = atoi(fields[i] + 6);
+        } else if (strncmp(fields[i], "stale=", 6) == 0) {
+            r->stale_ttl = atoi(fields[i] + 6);
+        } else if (strncmp(fields[i], "sse=", 4) == 0 && fields[i][4]) {
+            snprintf(r->sse_channel, sizeof(r->sse_channel), "%s", fields[i] + 4);
+        } else if (strncmp(fields[i], "ws=", 3) == 0 && fields[i][3]) {
+            snprintf(r->ws_handler, sizeof(r->ws_handler), "%s", fields[i] + 3);
+        } else if (strncmp(fields[i], "page=", 5) == 0 && fields[i][5]) {
+            snprintf(r->page, sizeof(r->page), "%s", fields[i] + 5);
+        } else {
+            fprintf(stderr, "%s:%d: unknown option %s\n", ROUTES_FILE, line_no, fields[i]);
+            return -1;
+        }
+    }
+
+    if (strcmp(r->handler, "-") == 0 && !r->sse_channel[0] && !r->ws_handler[0] && !r->page[0]) {
+        fprintf(stderr, "%s:%d: handler '-' requires sse=, ws= or page=\n", ROUTES_FILE, line_no);
+        return -1;
+    }
+    if (r->page[0] && (strcmp(r->handler, "-") != 0 || r->sse_channel[0] || r->ws_handler[0])) {
+        fprintf(stderr, "%s:%d: page= serves the page itself, the handler must be '-'\n", ROUTES_FILE, line_no);
+        return -1;
+    }
+
+    r->is_static = 1;
+    int params = 0;
+    for (const char *p = r->path; *p; p++) {
+        if (*p == '/') r->segments++;
+        if (is_param_start(r->path, p)) {
+            r->is_static = 0;
+            params++;
+        }
+    }
+    if (params > MAX_PARAMS) {
+        fprintf(stderr, "%s:%d: more than %d parameters\n", ROUTES_FILE, line_no, MAX_PARAMS);
+        return -1;
+    }
+
+    build_key(r);
+    return 0;
+}
+
+int load_routes_file(route_list_t *list) {
+    FILE *f = fopen(ROUTES_FILE, "r");
+    if (f == NULL) {
+        return 0;
+    }
+
+    char line[MAX_LINE];
+    int line_no = 0;
+    while (fgets(line, sizeof(line), f)) {
+        line_no++;
+
+        size_t len = strlen(line);
+        if (len == sizeof(line) - 1 && line[len - 1] != '\n') {
+            int next = fgetc(f);
+            if (next != EOF && next != '\n') {
+                fprintf(stderr, "%s:%d: line too long, the limit is %d bytes\n", ROUTES_FILE,
+                        line_no, MAX_LINE - 1);
+                fclose(f);
+                return -1;
+            }
+        }
+
+        if (list->count >= list->capacity) {
+            list->capacity = list->capacity ? list->capacity * 2 : 64;
+            route_decl_t *items = realloc(list->items, sizeof(route_decl_t) * list->capacity);
+            if (items == NULL) {
+                perror("Failed to expand route array");
+                fclose(f);
+                return -1;
+            }
+            list->items = items;
+        }
+
+        route_decl_t *r = &list->items[list->count];
+        int res = parse_line(line, line_no, r);
+        if (res < 0) {
+            fclose(f);
+            return -1;
+        }
+        if (res > 0) continue;
+
+        for (int i = 0; i < list->count; i++) {
+            if (list->items[i].key_len == r->key_len &&
+                memcmp(list->items[i].key, r->key, r->key_len) == 0) {
+                fprintf(stderr, "%s:%d: duplicate of line %d\n", ROUTES_FILE, line_no,
+                        list->items[i].line);
+                fclose(f);
+                return -1;
+            }
+        }
+
+        list->count++;
+    }
+
+    fclose(f);
+    return 0;
+}
+
+/*
+*   Orders parameterized routes so that, segment by segment, a static
+*   segment is tried before a parameter segment.
+*/
+int specificity_cmp(const void *a, const void *b) {
+    const route_decl_t *ra = *(const route_decl_t *const *)a;
+    const route_decl_t *rb = *(const route_decl_t *const *)b;
+    const char *pa = ra->path, *pb = rb->path;
+
+    while (*pa && *pb) {
+        const char *ea = strchr(pa + 1, '/');
+        const char *eb = strchr(pb + 1, '/');
+        if (!ea) ea = pa + strlen(pa);
+        if (!eb) eb = pb + strlen(pb);
+
+        int da = 0, db = 0;
+        for (const char *p = pa; p < ea; p++) da |= is_param_start(ra->path, p);
+        for (const char *p = pb; p < eb; p++) db |= is_param_start(rb->path, p);
+        if (da != db) return da - db;
+
+        pa = ea;
+        pb = eb;
+    }
+
+    return ra->line - rb->line;
+}
+
+int build_perfect_hash(route_decl_t **items, int count, uint32_t *seed_out,
+                       int **table_out, size_t *size_out) {
+    size_t size = 1;
+    while (size < (size_t)count * 2) size <<= 1;
+
+    while (1) {
+        int *table = malloc(sizeof(int) * size);
+        if (table == NULL) {
+            perror("Failed to allocate hash table");
+            return -1;
+        }
+
+        for (uint32_t seed = 1; seed < MAX_SEED_TRIES; seed++) {
+            memset(table, -1, sizeof(int) * size);
+
+            int ok = 1;
+            for (int i = 0; i < count && ok; i++) {
+                uint32_t slot = key_hash(items[i]->key, items[i]->key_len, seed) & (size - 1);
+                if (table[slot] >= 0) {
+                    ok = 0;
+                } else {
+                    table[slot] = i;
+                }
+            }
+
+            if (ok) {
+                *seed_out = seed;
+                *table_out = table;
+                *size_out = size;
+                return 0;
+            }
+        }
+
+        free(table);
+        size <<= 1;
+    }
+}
+
+void write_c_string(FILE *f, const char *s, size_t len) {
+    fputc('"', f);
+    for (size_t i = 0; i < len; i++) {
+        unsigned char c = s[i];
+        if (c == '"' || c == '\\') fprintf(f, "\\%c", c);
+        else if (c < 0x20) fprintf(f, "\\x%02x\"\"", c);
+        else fputc(c, f);
+    }
+    fputc('"', f);
+}
+
+void write_route(FILE *f, const route_decl_t *r, int idx) {
+    fprintf(f, "    {\n");
+    if (r->has_host) {
+        fprintf(f, "        .sub_domain = (char *)");
+        write_c_string(f, r->host, strlen(r->host));
+        fprintf(f, ",\n");
+    }
+    fprintf(f, "        .method = \"%s\",\n", r->method);
+    fprintf(f, "        .path = ");
+    write_c_string(f, r->path, strlen(r->path));
+    fprintf(f, ",\n");
+
+    int param = 0;
+    fprintf(f, "        .param_names = {");
+    for (const char *p = r->path; *p; p++) {
+        if (!is_param_start(r->path, p)) continue;
+        if (*p == ':') {
+            const char *name = p + 1;
+            const char *end = name;
+            while (*end && *end != '/') end++;
+            fprintf(f, "(char *)");
+            write_c_string(f, name, end - name);
+            fprintf(f, ", ");
+        } else {
+            fprintf(f, "NULL, ");
+        }
+        param++;
+    }
+    fprintf(f, "},\n");
+    fprintf(f, "        .param_count = %d,\n", param);
+
+    if (r->cache_ttl > 0) {
+        fprintf(f, "        .cache = &route_table_cache_%d,\n", idx);
+    }
+    if (r->sse_channel[0]) {
+        fprintf(f, "        .sse_channel = (char *)");
+        write_c_string(f, r->sse_channel, strlen(r->sse_channel));
+        fprintf(f, ",\n");
+    }
+    if (r->ws_handler[0]) {
+        fprintf(f, "        .ws = &%s,\n", r->ws_handler);
+    }
+    if (r->page[0]) {
+        fprintf(f, "        .callback = route_table_page_%d,\n", idx);
+    } else {
+        fprintf(f, "        .callback = %s,\n", strcmp(r->handler, "-") == 0 ? "NULL" : r->handler);
+    }
+    fprintf(f, "    },\n");
+}
+
+/*
+*   Emits a matcher that walks the path once: static runs are compared with
+*   strncmp, parameters capture up to the next '/'.
+*/
+void write_matcher(FILE *f, const route_decl_t *r, int idx) {
+    fprintf(f, "static int route_table_match_%d(http_req_t *req) {\n", idx);
+    fprintf(f, "    const char *p = req->path;\n");
+    fprintf(f, "    const char *end;\n");
+    fprintf(f, "    (void)end;\n");
+
+    int param = 0;
+    const char *p = r->path;
+    while (*p) {
+        if (is_param_start(r->path, p)) {
+            if (*p == ':') {
+                p++;
+                while (*p && *p != '/') p++;
+            } else {
+                p++;
+            }
+            fprintf(f, "    end = p;\n");
+            fprintf(f, "    while (*end && *end != '/') end++;\n");
+            fprintf(f, "    req->params[%d] = (route_param_t){p - req->path, end - p};\n", param);
+            fprintf(f, "    p = end;\n");
+            param++;
+            continue;
+        }
+
+        const char *end = p;
+        while (*end && !is_param_start(r->path, end)) end++;
+        fprintf(f, "    if (strncmp(p, ");
+        write_c_string(f, p, end - p);
+        fprintf(f, ", %zu) != 0) return 0;\n", (size_t)(end - p));
+        fprintf(f, "    p += %zu;\n", (size_t)(end - p));
+        p = end;
+    }
+
+    fprintf(f, "    if (*p != '\\0') return 0;\n");
+    fprintf(f, "    req->param_count = %d;\n", param);
+    fprintf(f, "    return 1;\n");
+    fprintf(f, "}\n\n");
+}
+
+/*
+*   Moves tmp over path unless both hold the same bytes, so an unchanged
+*   output keeps its mtime and make does not recompile it.
+*/
+int replace_if_changed(const char *tmp, const char *path) {
+    FILE *a = fopen(tmp, "rb");
+    FILE *b = fopen(path, "rb");
+    int same = a && b;
+    while (same) {
+        char x[8192], y[8192];
+        size_t n = fread(x, 1, sizeof(x), a);
+        size_t m = fread(y, 1, sizeof(y), b);
+        if (n != m || memcmp(x, y, n) != 0) same = 0;
+        if (n == 0) break;
+    }
+    if (a) fclose(a);
+    if (b) fclose(b);
+
+    if (same) {
+        unlink(tmp);
+        return 0;
+    }
+    if (rename(tmp, path) != 0) {
+        perror("Error replacing output");
+        unlink(tmp);
+        return -1;
+    }
+    return 0;
+}
+
+int save_table(route_list_t *list) {
+    route_decl_t **statics = malloc(sizeof(route_decl_t *) * (list->count + 1));
+    route_decl_t **params = malloc(sizeof(route_decl_t *) * (list->count + 1));
+    if (statics == NULL || params == NULL) {
+        perror("Error allocating memory");
+        free(statics);
+        free(params);
+        return -1;
+    }
+
+    int static_count = 0, param_count = 0;
+    for (int i = 0; i < list->count; i++) {
+        if (list->items[i].is_static) statics[static_count++] = &list->items[i];
+        else params[param_count++] = &list->items[i];
+    }
+    qsort(params, param_count, sizeof(route_decl_t *), specificity_cmp);
+
+    uint32_t seed = 0;
+    int *table = NULL;
+    size_t size = 1;
+    if (static_count > 0 && build_perfect_hash(statics, static_count, &seed, &table, &size) != 0) {
+        free(statics);
+        free(params);
+        return -1;
+    }
+
+    FILE *f = fopen(SAVE_TMP, "w");
+    if (f == NULL) {
+        perror("Error opening file for writing");
+        free(statics);
+        free(params);
+        free(table);
+        return -1;
+    }
+
+    fprintf(f, "#include <ctype.h>\n#include <stdint.h>\n#include <string.h>\n#include <strings.h>\n\n");
+    fprintf(f, "#include \"../cache.h\"\n#include \"../cx.h\"\n#include \"../routes.h\"\n#include \"../server.h\"\n#include \"../utils.h\"\n#include \"../ws.h\"\n\n");
+
+    for (int i = 0; i < list->count; i++) {
+        int seen = 0;
+        for (int j = 0; j < i; j++) {
+            if (strcmp(list->items[j].handler, list->items[i].handler) == 0) seen = 1;
+        }
+        if (!seen && strcmp(list->items[i].handler, "-") != 0) {
+            fprintf(f, "void %s(int client_fd, http_req_t *req);\n", list->items[i].handler);
+        }
+    }
+    for (int i = 0; i < list->count; i++) {
+        int seen = 0;
+        for (int j = 0; j < i; j++) {
+            if (strcmp(list->items[j].ws_handler, list->items[i].ws_handler) == 0) seen = 1;
+        }
+        if (!seen && list->items[i].ws_handler[0]) {
+            fprintf(f, "extern const ws_handler_t %s;\n", list->items[i].ws_handler);
+        }
+    }
+    for (int i = 0; i < list->count; i++) {
+        int seen = 0;
+        for (int j = 0; j < i; j++) {
+            if (strcmp(list->items[j].page, list->items[i].page) == 0) seen = 1;
+        }
+        if (!seen && list->items[i].page[0]) {
+            fprintf(f, "const cx_page_t *page_%s(void);\n", list->items[i].page);
+        }
+    }
+    fprintf(f, "\n");
+
+    for (int i = 0; i < list->count; i++) {
+        route_decl_t *r = &list->items[i];
+        if (!r->page[0]) continue;
+        fprintf(f, "static void route_table_page_%d(int client_fd, http_req_t *req) {\n", i);
+        fprintf(f, "    (void)req;\n");
+        fprintf(f, "    cx_page_send(client_fd, page_%s());\n", r->page);
+        fprintf(f, "}\n\n");
+    }
+
+    fprintf(f, "void route_table_prerender(void) {\n");
+    for (int i = 0; i < list->count; i++) {
+        route_decl_t *r = &list->items[i];
+        if (!r->page[0]) continue;
+        fprintf(f, "    if (!page_%s()->data) LOG(\"Failed to prerender page %s\");\n", r->page, r->page);
+    }
+    fprintf(f, "}\n\n");
+
+    for (int i = 0; i < list->count; i++) {
+        route_decl_t *r = &list->items[i];
+        if (r->cache_ttl <= 0) continue;
+        fprintf(f, "static route_cache_entry_t route_table_cache_entries_%d[%d];\n", i, CACHE_ENTRIES);
+        fprintf(f, "static route_cache_t route_table_cache_%d = {\n", i);
+        fprintf(f, "    .opts = {.ttl = %d, .stale_ttl = %d, .max_entries = %d},\n",
+                r->cache_ttl, r->stale_ttl, CACHE_ENTRIES);
+        fprintf(f, "    .entries = route_table_cache_entries_%d,\n", i);
+        fprintf(f, "};\n\n");
+    }
+
+    fprintf(f, "static route_t route_table[%d] = {\n", list->count ? list->count : 1);
+    for (int i = 0; i < list->count; i++) {
+        write_route(f, &list->items[i], i);
+    }
+    if (list->count == 0) fprintf(f, "    {0}\n");
+    fprintf(f, "};\n\n");
+
+    fprintf(f, "static const char *const route_table_keys[%d] = {\n", static_count ? static_count : 1);
+    for (int i = 0; i < static_count; i++) {
+        fprintf(f, "    ");
+        write_c_string(f, statics[i]->key, statics[i]->key_len);
+        fprintf(f, ",\n");
+    }
+    if (static_count == 0) fprintf(f, "    \"\"\n");
+    fprintf(f, "};\n\n");
+
+    fprintf(f, "static const unsigned short route_table_key_lens[%d] = {", static_count ? static_count : 1);
+    for (int i = 0; i < static_count; i++) fprintf(f, "%zu,", statics[i]->key_len);
+    if (static_count == 0) fprintf(f, "0");
+    fprintf(f, "};\n\n");
+
+    fprintf(f, "static const int route_table_static_routes[%d] = {", static_count ? static_count : 1);
+    for (int i = 0; i < static_count; i++) fprintf(f, "%d,", (int)(statics[i] - list->items));
+    if (static_count == 0) fprintf(f, "-1");
+    fprintf(f, "};\n\n");
+
+    fprintf(f, "static const int route_table_slots[%zu] = {", size);
+    for (size_t i = 0; i < size; i++) {
+        if (i % 16 == 0) fprintf(f, "\n    ");
+        fprintf(f, "%d,", static_count ? table[i] : -1);
+    }
+    fprintf(f, "\n};\n\n");
+
+    for (int i = 0; i < param_count; i++) {
+        write_matcher(f, params[i], (int)(params[i] - list->items));
+    }
+
+    fprintf(f,
+            "static uint32_t route_table_hash(char level, const char *host, size_t host_len,\n"
+            "                                 const char *method, const char *path, size_t *key_len) {\n"
+            "    uint32_t h = 2166136261u ^ %uu;\n"
+            "    size_t len = 0;\n\n"
+            "    h ^= (unsigned char)level;\n"
+            "    h *= 16777619u;\n"
+            "    len++;\n"
+            "    for (size_t i = 0; i < host_len; i++, len++) {\n"
+            "        h ^= (unsigned char)tolower((unsigned char)host[i]);\n"
+            "        h *= 16777619u;\n"
+            "    }\n"
+            "    h ^= 0x1f;\n"
+            "    h *= 16777619u;\n"
+            "    len++;\n"
+            "    for (; *method; method++, len++) {\n"
+            "        h ^= (unsigned char)*method;\n"
+            "        h *= 16777619u;\n"
+            "    }\n"
+            "    h ^= 0x1f;\n"
+            "    h *= 16777619u;\n"
+            "    len++;\n"
+            "    for (; *path; path++, len++) {\n"
+            "        h ^= (unsigned char)*path;\n"
+            "        h *= 16777619u;\n"
+            "    }\n\n"
+            "    *key_len = len;\n"
+            "    return h ^ (h >> 15);\n"
+            "}\n\n",
+            seed);
+
+    fprintf(f,
+            "static route_t *route_table_static(char level, const char *host, size_t host_len, http_req_t *req) {\n"
+            "    size_t key_len = 0;\n"
+            "    uint32_t h = route_table_hash(level, host, host_len, req->method, req->path, &key_len);\n"
+            "    int idx = route_table_slots[h & %zuu];\n"
+            "    if (idx < 0 || route_table_key_lens[idx] != key_len) return NULL;\n\n"
+            "    const char *key = route_table_keys[idx];\n"
+            "    size_t method_len = strlen(req->method);\n"
+            "    if (key[0] != level ||\n"
+            "        strncasecmp(key + 1, host, host_len) != 0 ||\n"
+            "        memcmp(key + 2 + host_len, req->method, method_len) != 0 ||\n"
+            "        memcmp(key + 3 + host_len + method_len, req->path, key_len - 3 - host_len - method_len) != 0) {\n"
+            "        return NULL;\n"
+            "    }\n\n"
+            "    req->param_count = 0;\n"
+            "    return &route_table[route_table_static_routes[idx]];\n"
+            "}\n\n",
+            size - 1);
+
+    if (param_count > 0) fprintf(f,
+            "static int route_table_host_is(const route_t *r, char level, const char *host, size_t host_len) {\n"
+            "    switch (level) {\n"
+            "        case 'B': return r->sub_domain == NULL;\n"
+            "        case 'D': return r->sub_domain && strcmp(r->sub_domain, \"*\") == 0;\n"
+            "        default:\n"
+            "            return r->sub_domain && strlen(r->sub_domain) == host_len &&\n"
+            "                   strncasecmp(r->sub_domain, host, host_len) == 0 &&\n"
+            "                   (level == 'F') == (strchr(r->sub_domain, '.') != NULL);\n"
+            "    }\n"
+            "}\n\n");
+
+    fprintf(f,
+            "static route_t *route_table_params(char level, const char *host, size_t host_len, http_req_t *req) {\n"
+            "    int segments = 0;\n"
+            "    for (const char *p = req->path; *p; p++) segments += (*p == '/');\n\n"
+            "    switch (segments) {\n");
+
+    for (int seg = 0; seg <= MAX_FIELD; seg++) {
+        int any = 0;
+        for (int i = 0; i < param_count; i++) {
+            if (params[i]->segments != seg) continue;
+            if (!any) fprintf(f, "        case %d:\n", seg);
+            any = 1;
+
+            int idx = (int)(params[i] - list->items);
+            fprintf(f,
+                    "            if (strcmp(req->method, \"%s\") == 0 &&\n"
+                    "                route_table_host_is(&route_table[%d], level, host, host_len) &&\n"
+                    "                route_table_match_%d(req)) return &route_table[%d];\n",
+                    params[i]->method, idx, idx, idx);
+        }
+        if (any) fprintf(f, "            break;\n");
+    }
+
+    fprintf(f,
+            "        default:\n"
+            "            break;\n"
+            "    }\n\n"
+            "    (void)level;\n"
+            "    (void)host;\n"
+            "    (void)host_len;\n"
+            "    return NULL;\n"
+            "}\n\n");
+
+    fprintf(f,
+            "static route_t *route_table_level(char level, const char *host, size_t host_len, http_req_t *req) {\n"
+            "    route_t *r = route_table_static(level, host, host_len, req);\n"
+            "    if (r) return r;\n"
+            "    return route_table_params(level, host, host_len, req);\n"
+            "}\n\n"
+            "route_t *route_table_find(http_req_t *req) {\n"
+            "    route_t *r = NULL;\n"
+            "    if (req->host_len > 0) {\n"
+            "        r = route_table_level('F', req->host, req->host_len, req);\n"
+            "        if (r) return r;\n"
+            "    }\n\n"
+            "    if (req->sub_domain_len > 0) {\n"
+            "        r = route_table_level('S', req->sub_domain, req->sub_domain_len, req);\n"
+            "    } else {\n"
+            "        r = route_table_level('B', \"\", 0, req);\n"
+            "    }\n"
+            "    if (r) return r;\n\n"
+            "    return route_table_level('D', \"\", 0, req);\n"
+            "}\n\n"
+            "const route_t *route_table_routes(size_t *count) {\n"
+            "    *count = %d;\n"
+            "    return route_table;\n"
+            "}\n",
+            list->count);
+
+    fclose(f);
+    free(statics);
+    free(params);
+    free(table);
+    return replace_if_changed(SAVE_TMP, SAVE_FILE);
+}
+
+int main(void) {
+    struct stat st;
+    if (stat(SAVE_PATH, &st) == -1) {
+        mkdir(SAVE_PATH, 0755);
+    }
+
+    route_list_t list = {0};
+    if (load_routes_file(&list) != 0) {
+        free(list.items);
+        return EXIT_FAILURE;
+    }
+
+    int res = save_table(&list);
+    free(list.items);
+
+    if (res != 0) {
+        return EXIT_FAILURE;
+    }
+
+    printf("Compiled: %d routes from %s\n", list.count, ROUTES_FILE);
+    return EXIT_SUCCESS;
+}